@@ -0,0 +1,144 @@
+#include "blockCache.hpp"
+#include "util.hpp"
+
+extern "C" {
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+}
+
+using namespace android;
+
+/* Upper bound of the read-ahead window, in blocks */
+static const size_t MAX_READ_AHEAD_BLOCKS = 16;
+
+bool preadFully(int fd, unsigned char *outBuffer, size_t size, off_t position) {
+    size_t readTotal = 0;
+    while (readTotal < size) {
+        ssize_t readCount = pread(fd, outBuffer + readTotal, size - readTotal,
+                                  position + readTotal);
+        if (readCount < 0) {
+            if (errno == EINTR) continue;
+            LOGE("Cannot read from file descriptor. Error:%d", errno);
+            return false;
+        }
+        if (readCount == 0) {
+            LOGE("Unexpected end of file at %ld", (long) (position + readTotal));
+            return false;
+        }
+        readTotal += readCount;
+    }
+    return true;
+}
+
+BlockCache::BlockCache(int fd, size_t fileSize, size_t blockSize, size_t budget)
+    : fd(fd), fileSize(fileSize), blockSize(blockSize), budget(budget) {
+    blockCount = (fileSize + blockSize - 1) / blockSize;
+
+    // Keep the window well below the budget so read-ahead can't flush the working set
+    maxReadAhead = budget / blockSize / 4;
+    if (maxReadAhead < 1) maxReadAhead = 1;
+    if (maxReadAhead > MAX_READ_AHEAD_BLOCKS) maxReadAhead = MAX_READ_AHEAD_BLOCKS;
+}
+
+int BlockCache::read(unsigned long position, unsigned char *outBuffer, unsigned long size) {
+    Mutex::Autolock autolock(lock);
+
+    unsigned long done = 0;
+    while (done < size) {
+        unsigned long offset = position + done;
+        const Block *block = getBlock(offset / blockSize);
+        if (block == NULL) {
+            return 0;
+        }
+
+        size_t inBlock = offset % blockSize;
+        size_t count = block->data.size() - inBlock;
+        if (count > size - done) count = size - done;
+
+        memcpy(outBuffer + done, &block->data[inBlock], count);
+        done += count;
+    }
+    return 1;
+}
+
+const BlockCache::Block *BlockCache::getBlock(size_t index) {
+    auto found = blocks.find(index);
+    if (found != blocks.end()) {
+        stats.hits++;
+        lru.splice(lru.begin(), lru, found->second);
+        return &*found->second;
+    }
+
+    stats.misses++;
+
+    // Grow the window while misses keep hitting the block right after the previous one
+    if (lastMissIndex != SIZE_MAX && index == lastMissIndex + 1) {
+        readAhead = readAhead * 2 > maxReadAhead ? maxReadAhead : readAhead * 2;
+    } else {
+        readAhead = 1;
+    }
+
+    size_t count = 1;
+    while (count < readAhead && index + count < blockCount
+        && blocks.find(index + count) == blocks.end()) {
+        count++;
+    }
+
+    if (!fetch(index, count)) {
+        return NULL;
+    }
+    lastMissIndex = index + count - 1;
+    stats.readAheadBlocks += count - 1;
+
+    // fetch() inserts in reverse so the requested block ends up at the front
+    const Block *block = &lru.front();
+    evictIfNeeded();
+    return block;
+}
+
+bool BlockCache::fetch(size_t index, size_t count) {
+    size_t start = index * blockSize;
+    size_t end = (index + count) * blockSize;
+    if (end > fileSize) end = fileSize;
+    if (start >= end) {
+        LOGE("Block %zu out of file bounds", index);
+        return false;
+    }
+
+    std::vector<unsigned char> buffer(end - start);
+    if (!preadFully(fd, buffer.data(), buffer.size(), (off_t) start)) {
+        return false;
+    }
+    stats.bytesRead += buffer.size();
+
+    for (size_t i = count; i-- > 0;) {
+        size_t blockStart = i * blockSize;
+        size_t blockEnd = blockStart + blockSize;
+        if (blockEnd > buffer.size()) blockEnd = buffer.size();
+
+        lru.push_front(Block());
+        Block &block = lru.front();
+        block.index = index + i;
+        block.data.assign(buffer.begin() + blockStart, buffer.begin() + blockEnd);
+        blocks[block.index] = lru.begin();
+        stats.cachedBytes += block.data.size();
+    }
+    return true;
+}
+
+void BlockCache::evictIfNeeded() {
+    // Never evict the block that was just returned
+    while ((size_t) stats.cachedBytes > budget && lru.size() > 1) {
+        Block &victim = lru.back();
+        stats.cachedBytes -= victim.data.size();
+        stats.evictions++;
+        blocks.erase(victim.index);
+        lru.pop_back();
+    }
+}
+
+BlockCache::Stats BlockCache::getStats() {
+    Mutex::Autolock autolock(lock);
+    return stats;
+}
@@ -0,0 +1,69 @@
+#ifndef _BLOCK_CACHE_HPP_
+#define _BLOCK_CACHE_HPP_
+
+extern "C" {
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+}
+
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include "utils/Mutex.h"
+
+/* Reads exactly size bytes at position, retrying short reads. Returns false on error or EOF */
+bool preadFully(int fd, unsigned char *outBuffer, size_t size, off_t position);
+
+/*
+ * Fixed size block cache sitting between PDFium's FPDF_FILEACCESS reads and a file descriptor.
+ * Sequential misses grow a read-ahead window, least recently used blocks are evicted once the
+ * cached bytes exceed the budget.
+ */
+class BlockCache {
+ public:
+  /* Must match PdfDocument.BlockCacheStats field order */
+  struct Stats {
+      int64_t hits = 0;
+      int64_t misses = 0;
+      int64_t readAheadBlocks = 0;
+      int64_t bytesRead = 0;
+      int64_t evictions = 0;
+      int64_t cachedBytes = 0;
+  };
+
+  BlockCache(int fd, size_t fileSize, size_t blockSize, size_t budget);
+
+  int read(unsigned long position, unsigned char *outBuffer, unsigned long size);
+  Stats getStats();
+
+ private:
+  struct Block {
+      size_t index;
+      std::vector<unsigned char> data;
+  };
+  typedef std::list<Block> BlockList;
+
+  const Block *getBlock(size_t index);
+  bool fetch(size_t index, size_t count);
+  void evictIfNeeded();
+
+  int fd;
+  size_t fileSize;
+  size_t blockSize;
+  size_t budget;
+  size_t blockCount;
+  size_t maxReadAhead;
+
+  /* Most recently used block first */
+  BlockList lru;
+  std::unordered_map<size_t, BlockList::iterator> blocks;
+
+  size_t lastMissIndex = SIZE_MAX;
+  size_t readAhead = 1;
+
+  Stats stats;
+  android::Mutex lock;
+};
+
+#endif
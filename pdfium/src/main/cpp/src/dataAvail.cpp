@@ -0,0 +1,73 @@
+#include "dataAvail.hpp"
+
+using namespace android;
+
+DataAvailability::DataAvailability(size_t fileSize) : fileSize(fileSize) {
+    fileAvail.version = 1;
+    fileAvail.IsDataAvail = &isDataAvail;
+    fileAvail.owner = this;
+
+    downloadHints.version = 1;
+    downloadHints.AddSegment = &addSegment;
+    downloadHints.owner = this;
+}
+
+void DataAvailability::addAvailableRange(size_t offset, size_t size) {
+    if (offset >= fileSize || size == 0) {
+        return;
+    }
+    size_t start = offset;
+    size_t end = size > fileSize - offset ? fileSize : offset + size;
+
+    Mutex::Autolock autolock(lock);
+
+    // Merge with every range that overlaps or touches [start, end)
+    auto it = available.upper_bound(start);
+    if (it != available.begin()) {
+        auto prev = std::prev(it);
+        if (prev->second >= start) {
+            it = prev;
+        }
+    }
+    while (it != available.end() && it->first <= end) {
+        if (it->first < start) start = it->first;
+        if (it->second > end) end = it->second;
+        it = available.erase(it);
+    }
+    available[start] = end;
+}
+
+bool DataAvailability::isAvailable(size_t offset, size_t size) {
+    if (offset > fileSize || size > fileSize - offset) {
+        return false;
+    }
+
+    Mutex::Autolock autolock(lock);
+
+    auto it = available.upper_bound(offset);
+    if (it == available.begin()) {
+        return false;
+    }
+    --it;
+    return it->second >= offset + size;
+}
+
+std::vector<DataAvailability::Range> DataAvailability::takeRequestedRanges() {
+    Mutex::Autolock autolock(lock);
+
+    std::vector<Range> ranges;
+    ranges.swap(requested);
+    return ranges;
+}
+
+FPDF_BOOL DataAvailability::isDataAvail(FX_FILEAVAIL *pThis, size_t offset, size_t size) {
+    DataAvailability *owner = static_cast<FileAvail *>(pThis)->owner;
+    return owner->isAvailable(offset, size);
+}
+
+void DataAvailability::addSegment(FX_DOWNLOADHINTS *pThis, size_t offset, size_t size) {
+    DataAvailability *owner = static_cast<DownloadHints *>(pThis)->owner;
+
+    Mutex::Autolock autolock(owner->lock);
+    owner->requested.push_back(Range(offset, size));
+}
@@ -0,0 +1,54 @@
+#ifndef _DATA_AVAIL_HPP_
+#define _DATA_AVAIL_HPP_
+
+extern "C" {
+#include <stddef.h>
+}
+
+#include <iterator>
+#include <map>
+#include <utility>
+#include <vector>
+#include <fpdf_dataavail.h>
+#include "utils/Mutex.h"
+
+/*
+ * Tracks which byte ranges of a partially downloaded file are present, and collects the
+ * ranges PDFium asks for through FX_DOWNLOADHINTS so the downloader can fetch them next.
+ * Ranges are added from the downloader thread while PDFium queries them on the render thread.
+ */
+class DataAvailability {
+ public:
+  typedef std::pair<size_t, size_t> Range; /* offset, size */
+
+  explicit DataAvailability(size_t fileSize);
+
+  FX_FILEAVAIL *getFileAvail() { return &fileAvail; }
+  FX_DOWNLOADHINTS *getDownloadHints() { return &downloadHints; }
+
+  void addAvailableRange(size_t offset, size_t size);
+  bool isAvailable(size_t offset, size_t size);
+  std::vector<Range> takeRequestedRanges();
+
+ private:
+  struct FileAvail : FX_FILEAVAIL {
+      DataAvailability *owner;
+  };
+  struct DownloadHints : FX_DOWNLOADHINTS {
+      DataAvailability *owner;
+  };
+
+  static FPDF_BOOL isDataAvail(FX_FILEAVAIL *pThis, size_t offset, size_t size);
+  static void addSegment(FX_DOWNLOADHINTS *pThis, size_t offset, size_t size);
+
+  size_t fileSize;
+  FileAvail fileAvail;
+  DownloadHints downloadHints;
+
+  /* Disjoint, non adjacent available ranges: start -> end (exclusive) */
+  std::map<size_t, size_t> available;
+  std::vector<Range> requested;
+  android::Mutex lock;
+};
+
+#endif
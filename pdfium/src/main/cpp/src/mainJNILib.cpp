@@ -1,11 +1,19 @@
 #include "util.hpp"
+#include "blockCache.hpp"
+#include "dataAvail.hpp"
+#include "pixelConvert.hpp"
+#include "scratchArena.hpp"
+#include "tileCache.hpp"
 
 extern "C" {
 #include <unistd.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <errno.h>
 #include <string.h>
 #include <stdio.h>
+#include <math.h>
+#include <time.h>
 }
 
 #include <android/native_window.h>
@@ -15,8 +23,15 @@ extern "C" {
 using namespace android;
 
 #include <fpdfview.h>
+#include <fpdf_annot.h>
+#include <fpdf_dataavail.h>
 #include <fpdf_doc.h>
+#include <fpdf_edit.h>
+#include <fpdf_progressive.h>
 #include <fpdf_text.h>
+#include <fpdf_thumbnail.h>
+#include <algorithm>
+#include <atomic>
 #include <string>
 #include <vector>
 
@@ -24,6 +39,51 @@ static Mutex sLibraryLock;
 
 static int sLibraryReferenceCount = 0;
 
+/*
+ * Buffers of closed renders, taken by the next ones instead of allocating an atlas or BGR copy of
+ * several megabytes per render while scrolling. Freed when the last document closes or on trimMemory
+ */
+static Mutex sRenderBuffersLock;
+static std::vector<std::vector<uint8_t>> sRenderBuffers;
+static const size_t MAX_POOLED_RENDER_BUFFERS = 2;
+static const size_t MAX_POOLED_RENDER_BUFFER_BYTES = 16 * 1024 * 1024;
+
+static void takeRenderBuffer(std::vector<uint8_t> &buffer, size_t size) {
+    {
+        Mutex::Autolock lock(sRenderBuffersLock);
+        auto largest = sRenderBuffers.end();
+        for (auto it = sRenderBuffers.begin(); it != sRenderBuffers.end(); ++it) {
+            if (largest == sRenderBuffers.end() || it->capacity() > largest->capacity()) {
+                largest = it;
+            }
+        }
+        if (largest != sRenderBuffers.end()) {
+            buffer.swap(*largest);
+            sRenderBuffers.erase(largest);
+        }
+    }
+    buffer.resize(size);
+}
+
+static void releaseRenderBuffer(std::vector<uint8_t> &buffer) {
+    if (buffer.capacity() == 0 || buffer.capacity() > MAX_POOLED_RENDER_BUFFER_BYTES) {
+        return;
+    }
+    Mutex::Autolock lock(sRenderBuffersLock);
+    if (sRenderBuffers.size() < MAX_POOLED_RENDER_BUFFERS) {
+        sRenderBuffers.push_back(std::move(buffer));
+    }
+}
+
+static void freeRenderBuffers() {
+    std::vector<std::vector<uint8_t>> buffers;
+    {
+        Mutex::Autolock lock(sRenderBuffersLock);
+        // Freed after unlocking, renders taking a buffer don't wait for munmap
+        buffers.swap(sRenderBuffers);
+    }
+}
+
 static void initLibraryIfNeed() {
     Mutex::Autolock lock(sLibraryLock);
     if (sLibraryReferenceCount == 0) {
@@ -39,6 +99,8 @@ static void destroyLibraryIfNeed() {
     if (sLibraryReferenceCount == 0) {
         LOGD("Destroy FPDF library");
         FPDF_DestroyLibrary();
+        // No renders without documents, don't keep their buffers until the next document
+        freeRenderBuffers();
     }
 }
 
@@ -48,19 +110,44 @@ struct rgb {
   uint8_t blue;
 };
 
+/* Must match PdfiumCore.OPEN_MODE_* */
+enum OpenMode {
+    OPEN_MODE_PREAD = 0,
+    OPEN_MODE_MMAP = 1,
+    OPEN_MODE_MMAP_SEQUENTIAL = 2,
+    OPEN_MODE_CACHED = 3,
+};
+
 class DocumentFile {
  private:
-  int fileFd;
+  int fileFd = -1;
+  /* Read-only mapping of the whole file, NULL when blocks are read with pread */
+  unsigned char *mappedData = NULL;
+  /* Block cache in front of pread, only used in OPEN_MODE_CACHED */
+  BlockCache *blockCache = NULL;
 
  public:
   FPDF_DOCUMENT pdfDocument = NULL;
-  size_t fileSize;
+  size_t fileSize = 0;
 
  public:
   jbyte *cDataCopy = NULL;
+  /* Global reference keeping a direct ByteBuffer alive while PDFium reads from its memory */
+  jobject directBufferRef = NULL;
+
+  /* Progressive loading of a partially downloaded file, NULL otherwise */
+  DataAvailability *dataAvail = NULL;
+  FPDF_AVAIL pdfAvail = NULL;
+  /* FPDFAvail keeps a pointer to the file access, so it has to live as long as the document */
+  FPDF_FILEACCESS fileAccess;
 
   DocumentFile() { initLibraryIfNeed(); }
   ~DocumentFile();
+
+  void attachFile(int fd, size_t size, int openMode, size_t cacheBlockSize, size_t cacheBudget);
+  bool isMapped() const { return mappedData != NULL; }
+  BlockCache *getBlockCache() const { return blockCache; }
+  int readBlock(unsigned long position, unsigned char *outBuffer, unsigned long size);
 };
 DocumentFile::~DocumentFile() {
     if (pdfDocument != NULL) {
@@ -68,14 +155,82 @@ DocumentFile::~DocumentFile() {
         pdfDocument = NULL;
     }
 
+    if (pdfAvail != NULL) {
+        FPDFAvail_Destroy(pdfAvail);
+        pdfAvail = NULL;
+    }
+
+    if (dataAvail != NULL) {
+        delete dataAvail;
+        dataAvail = NULL;
+    }
+
+    if (mappedData != NULL) {
+        munmap(mappedData, fileSize);
+        mappedData = NULL;
+    }
+
+    if (blockCache != NULL) {
+        delete blockCache;
+        blockCache = NULL;
+    }
+
     if (cDataCopy != NULL) {
-        delete (cDataCopy);
+        delete[] cDataCopy;
         cDataCopy = NULL;
     }
 
     destroyLibraryIfNeed();
 }
 
+void DocumentFile::attachFile(int fd, size_t size, int openMode,
+                              size_t cacheBlockSize, size_t cacheBudget) {
+    fileFd = fd;
+    fileSize = size;
+
+    if (openMode == OPEN_MODE_CACHED && cacheBlockSize > 0 && cacheBudget > 0) {
+        blockCache = new BlockCache(fd, size, cacheBlockSize, cacheBudget);
+        return;
+    }
+
+    if (openMode != OPEN_MODE_MMAP && openMode != OPEN_MODE_MMAP_SEQUENTIAL) {
+        return;
+    }
+
+    void *addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        // Pipes, sockets and some FUSE/content provider descriptors can't be mapped
+        LOGD("Cannot map file descriptor, falling back to pread. Error:%d", errno);
+        return;
+    }
+
+    int advice = (openMode == OPEN_MODE_MMAP_SEQUENTIAL) ? MADV_SEQUENTIAL : MADV_RANDOM;
+    if (madvise(addr, size, advice) != 0) {
+        LOGD("madvise failed. Error:%d", errno);
+    }
+    mappedData = static_cast<unsigned char *>(addr);
+}
+
+int DocumentFile::readBlock(unsigned long position,
+                            unsigned char *outBuffer,
+                            unsigned long size) {
+    if (position > fileSize || size > fileSize - position) {
+        LOGE("Block out of file bounds. Position:%lu Size:%lu", position, size);
+        return 0;
+    }
+
+    if (mappedData != NULL) {
+        memcpy(outBuffer, mappedData + position, size);
+        return 1;
+    }
+
+    if (blockCache != NULL) {
+        return blockCache->read(position, outBuffer, size);
+    }
+
+    return preadFully(fileFd, outBuffer, size, (off_t) position) ? 1 : 0;
+}
+
 template<class string_type>
 inline typename string_type::value_type *
 WriteInto(string_type *str, size_t length_with_null) {
@@ -160,26 +315,30 @@ jobject NewInteger(JNIEnv *env, jint value) {
     return env->NewObject(cls, methodID, value);
 }
 
-uint16_t rgbTo565(rgb *color) {
-    return ((color->red >> 3) << 11) | ((color->green >> 2) << 5)
-        | (color->blue >> 3);
-}
+/* Ordered dithering of RGB_565 renders, set from PdfiumCore.setRgb565Dithering */
+static std::atomic<bool> sDither565(false);
 
 void rgbBitmapTo565(void *source,
                     int sourceStride,
                     void *dest,
                     AndroidBitmapInfo *info) {
-    rgb *srcLine;
-    uint16_t *dstLine;
-    int y, x;
-    for (y = 0; y < info->height; y++) {
-        srcLine = (rgb *) source;
-        dstLine = (uint16_t *) dest;
-        for (x = 0; x < info->width; x++) {
-            dstLine[x] = rgbTo565(&srcLine[x]);
-        }
-        source = (char *) source + sourceStride;
-        dest = (char *) dest + info->stride;
+    convertRgbTo565(static_cast<const uint8_t *>(source), sourceStride,
+                    static_cast<uint16_t *>(dest), (int) info->stride,
+                    (int) info->width, (int) info->height,
+                    sDither565.load(std::memory_order_relaxed));
+}
+
+static void throwLoadDocumentException(JNIEnv *env) {
+    const long errorNum = FPDF_GetLastError();
+    if (errorNum == FPDF_ERR_PASSWORD) {
+        jniThrowException(env, "com/shockwave/pdfium/PdfPasswordException",
+                          "Password required or incorrect password.");
+    } else {
+        char *error = getErrorDescription(errorNum);
+        jniThrowExceptionFmt(env, "java/io/IOException",
+                             "cannot create document: %s", error);
+
+        free(error);
     }
 }
 
@@ -189,20 +348,18 @@ static int getBlock(void *param,
                     unsigned long position,
                     unsigned char *outBuffer,
                     unsigned long size) {
-    const int fd = reinterpret_cast<intptr_t>(param);
-    const int readCount = pread(fd, outBuffer, size, position);
-    if (readCount < 0) {
-        LOGE("Cannot read from file descriptor. Error:%d", errno);
-        return 0;
-    }
-    return 1;
+    DocumentFile *docFile = reinterpret_cast<DocumentFile *>(param);
+    return docFile->readBlock(position, outBuffer, size);
 }
 
 JNIEXPORT jlong JNICALL Java_com_shockwave_pdfium_PdfiumCore_nativeOpenDocument(
     JNIEnv *env,
     jobject thiz,
     jint fd,
-    jstring password) {
+    jstring password,
+    jint openMode,
+    jint cacheBlockSize,
+    jlong cacheBudget) {
 
     size_t fileLength = (size_t) getFileSize(fd);
     if (fileLength <= 0) {
@@ -212,10 +369,12 @@ JNIEXPORT jlong JNICALL Java_com_shockwave_pdfium_PdfiumCore_nativeOpenDocument(
     }
 
     DocumentFile *docFile = new DocumentFile();
+    docFile->attachFile(fd, fileLength, (int) openMode,
+                        (size_t) cacheBlockSize, (size_t) cacheBudget);
 
     FPDF_FILEACCESS loader;
     loader.m_FileLen = fileLength;
-    loader.m_Param = reinterpret_cast<void *>(intptr_t(fd));
+    loader.m_Param = reinterpret_cast<void *>(docFile);
     loader.m_GetBlock = &getBlock;
 
     const char *cpassword = NULL;
@@ -232,17 +391,7 @@ JNIEXPORT jlong JNICALL Java_com_shockwave_pdfium_PdfiumCore_nativeOpenDocument(
     if (!document) {
         delete docFile;
 
-        const long errorNum = FPDF_GetLastError();
-        if (errorNum == FPDF_ERR_PASSWORD) {
-            jniThrowException(env, "com/shockwave/pdfium/PdfPasswordException",
-                              "Password required or incorrect password.");
-        } else {
-            char *error = getErrorDescription(errorNum);
-            jniThrowExceptionFmt(env, "java/io/IOException",
-                                 "cannot create document: %s", error);
-
-            free(error);
-        }
+        throwLoadDocumentException(env);
 
         return -1;
     }
@@ -278,27 +427,247 @@ Java_com_shockwave_pdfium_PdfiumCore_nativeOpenMemDocument(JNIEnv *env,
     if (!document) {
         delete docFile;
 
-        const long errorNum = FPDF_GetLastError();
-        if (errorNum == FPDF_ERR_PASSWORD) {
-            jniThrowException(env, "com/shockwave/pdfium/PdfPasswordException",
-                              "Password required or incorrect password.");
-        } else {
-            char *error = getErrorDescription(errorNum);
-            jniThrowExceptionFmt(env, "java/io/IOException",
-                                 "cannot create document: %s", error);
-
-            free(error);
-        }
+        throwLoadDocumentException(env);
 
         return -1;
     }
 
     docFile->pdfDocument = document;
     docFile->cDataCopy = cDataCopy;
+    docFile->fileSize = (size_t) size;
+
+    return reinterpret_cast<jlong>(docFile);
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativeOpenDirectBufferDocument(JNIEnv *env,
+                                                                    jobject thiz,
+                                                                    jobject buffer,
+                                                                    jint offset,
+                                                                    jint length,
+                                                                    jstring password) {
+    auto *data = static_cast<unsigned char *>(env->GetDirectBufferAddress(buffer));
+    jlong capacity = env->GetDirectBufferCapacity(buffer);
+    if (data == NULL || capacity < 0) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                          "ByteBuffer is not direct");
+        return -1;
+    }
+    if (offset < 0 || length <= 0 || (jlong) offset + length > capacity) {
+        jniThrowException(env, "java/io/IOException",
+                          "Buffer is empty");
+        return -1;
+    }
+
+    DocumentFile *docFile = new DocumentFile();
+
+    const char *cpassword = NULL;
+    if (password != NULL) {
+        cpassword = env->GetStringUTFChars(password, NULL);
+    }
+
+    FPDF_DOCUMENT document =
+        FPDF_LoadMemDocument64(reinterpret_cast<const void *>(data + offset),
+                               (size_t) length, cpassword);
+
+    if (cpassword != NULL) {
+        env->ReleaseStringUTFChars(password, cpassword);
+    }
+
+    if (!document) {
+        delete docFile;
+
+        throwLoadDocumentException(env);
+
+        return -1;
+    }
+
+    docFile->pdfDocument = document;
+    docFile->fileSize = (size_t) length;
+    docFile->directBufferRef = env->NewGlobalRef(buffer);
+
+    return reinterpret_cast<jlong>(docFile);
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativeOpenProgressiveDocument(JNIEnv *env,
+                                                                   jobject thiz,
+                                                                   jint fd,
+                                                                   jlong fileLength) {
+    if (fileLength <= 0) {
+        jniThrowException(env, "java/io/IOException",
+                          "File is empty");
+        return -1;
+    }
+
+    DocumentFile *docFile = new DocumentFile();
+    // The file is still being written, so it can't be mapped
+    docFile->attachFile(fd, (size_t) fileLength, OPEN_MODE_PREAD, 0, 0);
+    docFile->dataAvail = new DataAvailability((size_t) fileLength);
+
+    docFile->fileAccess.m_FileLen = (unsigned long) fileLength;
+    docFile->fileAccess.m_Param = reinterpret_cast<void *>(docFile);
+    docFile->fileAccess.m_GetBlock = &getBlock;
+
+    docFile->pdfAvail = FPDFAvail_Create(docFile->dataAvail->getFileAvail(),
+                                         &docFile->fileAccess);
+    if (docFile->pdfAvail == NULL) {
+        delete docFile;
+        jniThrowException(env, "java/io/IOException",
+                          "cannot create document availability provider");
+        return -1;
+    }
 
     return reinterpret_cast<jlong>(docFile);
 }
 
+JNIEXPORT void JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativeAddAvailableRange(JNIEnv *env,
+                                                             jobject thiz,
+                                                             jlong docPtr,
+                                                             jlong offset,
+                                                             jlong size) {
+    DocumentFile *doc = reinterpret_cast<DocumentFile *>(docPtr);
+    if (doc == NULL || doc->dataAvail == NULL || offset < 0 || size <= 0) {
+        return;
+    }
+    doc->dataAvail->addAvailableRange((size_t) offset, (size_t) size);
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativeTakeRequestedRanges(JNIEnv *env,
+                                                               jobject thiz,
+                                                               jlong docPtr) {
+    DocumentFile *doc = reinterpret_cast<DocumentFile *>(docPtr);
+    if (doc == NULL || doc->dataAvail == NULL) {
+        return NULL;
+    }
+
+    std::vector<DataAvailability::Range> ranges = doc->dataAvail->takeRequestedRanges();
+    std::vector<jlong> values;
+    for (const DataAvailability::Range &range : ranges) {
+        values.push_back((jlong) range.first);
+        values.push_back((jlong) range.second);
+    }
+
+    jlongArray result = env->NewLongArray(values.size());
+    env->SetLongArrayRegion(result, 0, values.size(), values.data());
+    return result;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativeIsDocumentAvailable(JNIEnv *env,
+                                                               jobject thiz,
+                                                               jlong docPtr,
+                                                               jstring password) {
+    DocumentFile *doc = reinterpret_cast<DocumentFile *>(docPtr);
+    if (doc->pdfAvail == NULL || doc->pdfDocument != NULL) {
+        return JNI_TRUE;
+    }
+
+    int status = FPDFAvail_IsDocAvail(doc->pdfAvail, doc->dataAvail->getDownloadHints());
+    if (status == PDF_DATA_NOTAVAIL) {
+        return JNI_FALSE;
+    }
+    if (status == PDF_DATA_ERROR) {
+        jniThrowException(env, "java/io/IOException",
+                          "cannot create document: File not in PDF format or corrupted.");
+        return JNI_FALSE;
+    }
+
+    const char *cpassword = NULL;
+    if (password != NULL) {
+        cpassword = env->GetStringUTFChars(password, NULL);
+    }
+
+    FPDF_DOCUMENT document = FPDFAvail_GetDocument(doc->pdfAvail, cpassword);
+
+    if (cpassword != NULL) {
+        env->ReleaseStringUTFChars(password, cpassword);
+    }
+
+    if (!document) {
+        throwLoadDocumentException(env);
+        return JNI_FALSE;
+    }
+
+    doc->pdfDocument = document;
+    return JNI_TRUE;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativeIsPageAvailable(JNIEnv *env,
+                                                           jobject thiz,
+                                                           jlong docPtr,
+                                                           jint pageIndex) {
+    DocumentFile *doc = reinterpret_cast<DocumentFile *>(docPtr);
+    if (doc->pdfAvail == NULL) {
+        return JNI_TRUE;
+    }
+    if (doc->pdfDocument == NULL) {
+        return JNI_FALSE;
+    }
+
+    int status = FPDFAvail_IsPageAvail(doc->pdfAvail, pageIndex,
+                                       doc->dataAvail->getDownloadHints());
+    // Let errors through, page loading will report them
+    return (jboolean) (status != PDF_DATA_NOTAVAIL);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativeGetFirstAvailablePage(JNIEnv *env,
+                                                                 jobject thiz,
+                                                                 jlong docPtr) {
+    DocumentFile *doc = reinterpret_cast<DocumentFile *>(docPtr);
+    if (doc->pdfDocument == NULL) {
+        return 0;
+    }
+    return (jint) FPDFAvail_GetFirstPageNum(doc->pdfDocument);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativeIsLinearized(JNIEnv *env,
+                                                        jobject thiz,
+                                                        jlong docPtr) {
+    DocumentFile *doc = reinterpret_cast<DocumentFile *>(docPtr);
+    if (doc->pdfAvail == NULL) {
+        return PDF_LINEARIZATION_UNKNOWN;
+    }
+    return (jint) FPDFAvail_IsLinearized(doc->pdfAvail);
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativeGetBlockCacheStats(JNIEnv *env,
+                                                              jobject thiz,
+                                                              jlong docPtr) {
+    DocumentFile *doc = reinterpret_cast<DocumentFile *>(docPtr);
+    if (doc == NULL || doc->getBlockCache() == NULL) {
+        return NULL;
+    }
+
+    BlockCache::Stats stats = doc->getBlockCache()->getStats();
+    jlong values[] = {stats.hits, stats.misses, stats.readAheadBlocks,
+                      stats.bytesRead, stats.evictions, stats.cachedBytes};
+    jsize count = (jsize) (sizeof(values) / sizeof(values[0]));
+
+    jlongArray result = env->NewLongArray(count);
+    env->SetLongArrayRegion(result, 0, count, values);
+    return result;
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativeGetScratchArenaStats(JNIEnv *env,
+                                                                jobject thiz) {
+    ScratchArena::Stats stats = ScratchArena::getStats();
+    jlong values[] = {stats.allocations, stats.allocatedBytes, stats.growths,
+                      stats.trims, stats.reservedBytes, stats.peakReservedBytes};
+    jsize count = (jsize) (sizeof(values) / sizeof(values[0]));
+
+    jlongArray result = env->NewLongArray(count);
+    env->SetLongArrayRegion(result, 0, count, values);
+    return result;
+}
+
 JNIEXPORT jint JNICALL Java_com_shockwave_pdfium_PdfiumCore_nativeGetPageCount(
     JNIEnv *env,
     jobject thiz,
@@ -312,7 +681,13 @@ JNIEXPORT void JNICALL Java_com_shockwave_pdfium_PdfiumCore_nativeCloseDocument(
     jobject thiz,
     jlong documentPtr) {
     DocumentFile *doc = reinterpret_cast<DocumentFile *>(documentPtr);
+    jobject directBufferRef = doc->directBufferRef;
     delete doc;
+
+    // The buffer may only be released once PDFium no longer reads from it
+    if (directBufferRef != NULL) {
+        env->DeleteGlobalRef(directBufferRef);
+    }
 }
 
 static jlong loadPageInternal(JNIEnv *env, DocumentFile *doc, int pageIndex) {
@@ -454,64 +829,286 @@ Java_com_shockwave_pdfium_PdfiumCore_nativeGetPageSizeByIndex(JNIEnv *env,
     return env->NewObject(clazz, constructorID, widthInt, heightInt);
 }
 
-static void renderPageInternal(FPDF_PAGE page,
-                               ANativeWindow_Buffer *windowBuffer,
-                               int startX, int startY,
-                               int canvasHorSize, int canvasVerSize,
-                               int drawSizeHor, int drawSizeVer,
-                               bool renderAnnot) {
+// Must match PdfiumCore.PAGE_GEOMETRY_* layout
+enum PageGeometry {
+    GEOMETRY_WIDTH = 0,
+    GEOMETRY_HEIGHT,
+    GEOMETRY_ROTATION,
+    GEOMETRY_CROP_LEFT,
+    GEOMETRY_CROP_BOTTOM,
+    GEOMETRY_CROP_RIGHT,
+    GEOMETRY_CROP_TOP,
+    GEOMETRY_STRIDE
+};
 
-    FPDF_BITMAP pdfBitmap = FPDFBitmap_CreateEx(canvasHorSize,
-                                                canvasVerSize,
-                                                FPDFBitmap_BGRA,
-                                                windowBuffer->bits,
-                                                (int) (windowBuffer->stride)
-                                                    * 4);
+JNIEXPORT jfloatArray JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativeGetPagesGeometry(JNIEnv *env,
+                                                            jobject thiz,
+                                                            jlong docPtr,
+                                                            jintArray pageIndices,
+                                                            jboolean includePageBoxes) {
+    DocumentFile *doc = reinterpret_cast<DocumentFile *>(docPtr);
+    if (doc == NULL) {
+        LOGE("Document is null");
 
-    /*LOGD("Start X: %d", startX);
-    LOGD("Start Y: %d", startY);
-    LOGD("Canvas Hor: %d", canvasHorSize);
-    LOGD("Canvas Ver: %d", canvasVerSize);
-    LOGD("Draw Hor: %d", drawSizeHor);
-    LOGD("Draw Ver: %d", drawSizeVer);*/
+        jniThrowException(env, "java/lang/IllegalStateException",
+                          "Document is null");
+        return NULL;
+    }
 
-    if (drawSizeHor < canvasHorSize || drawSizeVer < canvasVerSize) {
-        FPDFBitmap_FillRect(pdfBitmap, 0, 0, canvasHorSize, canvasVerSize,
-                            0x848484FF); //Gray
+    int count = pageIndices != NULL ? env->GetArrayLength(pageIndices)
+                                    : FPDF_GetPageCount(doc->pdfDocument);
+    std::vector<jint> indices(count);
+    if (pageIndices != NULL) {
+        env->GetIntArrayRegion(pageIndices, 0, count, indices.data());
+    } else {
+        for (int i = 0; i < count; i++) { indices[i] = i; }
     }
 
-    int baseHorSize =
-        (canvasHorSize < drawSizeHor) ? canvasHorSize : drawSizeHor;
-    int baseVerSize =
-        (canvasVerSize < drawSizeVer) ? canvasVerSize : drawSizeVer;
-    int baseX = (startX < 0) ? 0 : startX;
-    int baseY = (startY < 0) ? 0 : startY;
-    int flags = FPDF_REVERSE_BYTE_ORDER;
+    std::vector<jfloat> geometry((size_t) count * GEOMETRY_STRIDE, NAN);
+    for (int i = 0; i < count; i++) {
+        jfloat *entry = &geometry[(size_t) i * GEOMETRY_STRIDE];
+
+        // Size is read from the page dictionary without parsing page content
+        FS_SIZEF size;
+        if (FPDF_GetPageSizeByIndexF(doc->pdfDocument, indices[i], &size)) {
+            entry[GEOMETRY_WIDTH] = size.width;
+            entry[GEOMETRY_HEIGHT] = size.height;
+        } else {
+            entry[GEOMETRY_WIDTH] = 0;
+            entry[GEOMETRY_HEIGHT] = 0;
+        }
 
-    if (renderAnnot) {
-        flags |= FPDF_ANNOT;
+        if (!includePageBoxes) {
+            continue;
+        }
+        FPDF_PAGE page = FPDF_LoadPage(doc->pdfDocument, indices[i]);
+        if (page == NULL) {
+            continue;
+        }
+        entry[GEOMETRY_ROTATION] = (jfloat) (FPDFPage_GetRotation(page) * 90);
+        FS_RECTF box;
+        if (FPDF_GetPageBoundingBox(page, &box)) {
+            entry[GEOMETRY_CROP_LEFT] = box.left;
+            entry[GEOMETRY_CROP_BOTTOM] = box.bottom;
+            entry[GEOMETRY_CROP_RIGHT] = box.right;
+            entry[GEOMETRY_CROP_TOP] = box.top;
+        }
+        FPDF_ClosePage(page);
     }
 
-    FPDFBitmap_FillRect(pdfBitmap, baseX, baseY, baseHorSize, baseVerSize,
-                        0xFFFFFFFF); //White
+    jfloatArray result = env->NewFloatArray((jsize) geometry.size());
+    if (result == NULL) {
+        return NULL;
+    }
+    env->SetFloatArrayRegion(result, 0, (jsize) geometry.size(), geometry.data());
+    return result;
+}
 
-    FPDF_RenderPageBitmap(pdfBitmap, page,
-                          startX, startY,
-                          drawSizeHor, drawSizeVer,
-                          0, flags);
+/* Form XObjects nest, PDFium refuses deeper nesting when parsing anyway */
+static const int MAX_FORM_DEPTH = 16;
+
+struct PageComplexity {
+    jlong objects = 0;
+    jlong images = 0;
+    bool color = false;
+};
+
+static bool isGray(unsigned int r, unsigned int g, unsigned int b) {
+    return r == g && g == b;
 }
 
-JNIEXPORT void JNICALL Java_com_shockwave_pdfium_PdfiumCore_nativeRenderPage(
-    JNIEnv *env,
-    jobject thiz,
-    jlong pagePtr,
-    jobject objSurface,
-    jint dpi,
-    jint startX,
-    jint startY,
-    jint drawSizeHor,
-    jint drawSizeVer,
-    jboolean renderAnnot) {
+/* Conservative, anything that can't be proven gray counts as color */
+static bool hasColor(FPDF_PAGE page, FPDF_PAGEOBJECT object, int type) {
+    if (type == FPDF_PAGEOBJ_SHADING) {
+        return true;
+    }
+    if (type == FPDF_PAGEOBJ_IMAGE) {
+        FPDF_IMAGEOBJ_METADATA metadata;
+        if (!FPDFImageObj_GetImageMetadata(object, page, &metadata)) {
+            return true;
+        }
+        if (metadata.colorspace == FPDF_COLORSPACE_DEVICEGRAY
+            || metadata.colorspace == FPDF_COLORSPACE_CALGRAY) {
+            return false;
+        }
+        // Stencil masks have no color space, they're painted with the fill color
+        if (metadata.colorspace != FPDF_COLORSPACE_UNKNOWN || metadata.bits_per_pixel != 1) {
+            return true;
+        }
+    }
+
+    unsigned int r, g, b, a;
+    if (!FPDFPageObj_GetFillColor(object, &r, &g, &b, &a) || !isGray(r, g, b)) {
+        return true;
+    }
+    if (type != FPDF_PAGEOBJ_IMAGE
+        && (!FPDFPageObj_GetStrokeColor(object, &r, &g, &b, &a) || !isGray(r, g, b))) {
+        return true;
+    }
+    return false;
+}
+
+static void countPageObjects(FPDF_PAGE page, FPDF_PAGEOBJECT object, int depth,
+                             PageComplexity *complexity) {
+    int type = FPDFPageObj_GetType(object);
+    if (type == FPDF_PAGEOBJ_FORM) {
+        if (depth >= MAX_FORM_DEPTH) {
+            return;
+        }
+        int count = FPDFFormObj_CountObjects(object);
+        for (int i = 0; i < count; i++) {
+            countPageObjects(page, FPDFFormObj_GetObject(object, (unsigned long) i), depth + 1,
+                             complexity);
+        }
+        return;
+    }
+
+    complexity->objects++;
+    if (type == FPDF_PAGEOBJ_IMAGE) {
+        complexity->images++;
+    }
+    if (!complexity->color) {
+        complexity->color = hasColor(page, object, type);
+    }
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativeGetPageComplexity(JNIEnv *env,
+                                                             jobject thiz,
+                                                             jlong pagePtr) {
+    FPDF_PAGE page = reinterpret_cast<FPDF_PAGE>(pagePtr);
+    if (page == NULL) {
+        return NULL;
+    }
+
+    PageComplexity complexity;
+    int count = FPDFPage_CountObjects(page);
+    for (int i = 0; i < count; i++) {
+        countPageObjects(page, FPDFPage_GetObject(page, i), 0, &complexity);
+    }
+
+    jlong values[] = {complexity.objects, complexity.images,
+                      FPDFPage_HasTransparency(page) ? 1 : 0,
+                      complexity.color ? 1 : 0,
+                      FPDFPage_GetAnnotCount(page)};
+    jsize length = (jsize) (sizeof(values) / sizeof(values[0]));
+
+    jlongArray result = env->NewLongArray(length);
+    env->SetLongArrayRegion(result, 0, length, values);
+    return result;
+}
+
+/* Rough memory a loaded page takes besides its objects, and every parsed object */
+static const jlong PAGE_BASE_BYTES = 16 * 1024;
+static const jlong PAGE_OBJECT_BYTES = 256;
+
+static jlong estimateObjectBytes(FPDF_PAGEOBJECT object, int depth) {
+    int type = FPDFPageObj_GetType(object);
+    if (type == FPDF_PAGEOBJ_FORM) {
+        if (depth >= MAX_FORM_DEPTH) {
+            return 0;
+        }
+        jlong bytes = 0;
+        int count = FPDFFormObj_CountObjects(object);
+        for (int i = 0; i < count; i++) {
+            bytes += estimateObjectBytes(FPDFFormObj_GetObject(object, (unsigned long) i), depth + 1);
+        }
+        return bytes;
+    }
+
+    jlong bytes = PAGE_OBJECT_BYTES;
+    unsigned int width, height;
+    if (type == FPDF_PAGEOBJ_IMAGE && FPDFImageObj_GetImagePixelSize(object, &width, &height)) {
+        // Decoded images stay in the page image cache once rendered
+        bytes += (jlong) width * height * 4;
+    }
+    return bytes;
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativeEstimatePageBytes(JNIEnv *env,
+                                                             jobject thiz,
+                                                             jlong pagePtr) {
+    FPDF_PAGE page = reinterpret_cast<FPDF_PAGE>(pagePtr);
+    if (page == NULL) {
+        return 0;
+    }
+
+    jlong bytes = PAGE_BASE_BYTES;
+    int count = FPDFPage_CountObjects(page);
+    for (int i = 0; i < count; i++) {
+        bytes += estimateObjectBytes(FPDFPage_GetObject(page, i), 0);
+    }
+    return bytes;
+}
+
+/* Render flags callers may pass, must match PdfiumCore.RENDER_FLAG_* */
+static const int CALLER_RENDER_FLAGS = FPDF_ANNOT
+                                       | FPDF_CONVERT_FILL_TO_STROKE
+                                       | FPDF_RENDER_LIMITEDIMAGECACHE
+                                       | FPDF_RENDER_NO_SMOOTHTEXT
+                                       | FPDF_RENDER_NO_SMOOTHIMAGE
+                                       | FPDF_RENDER_NO_SMOOTHPATH;
+
+static int toPdfiumRenderFlags(jint renderFlags) {
+    return FPDF_REVERSE_BYTE_ORDER | (renderFlags & CALLER_RENDER_FLAGS);
+}
+
+static void renderPageInternal(FPDF_PAGE page,
+                               ANativeWindow_Buffer *windowBuffer,
+                               int startX, int startY,
+                               int canvasHorSize, int canvasVerSize,
+                               int drawSizeHor, int drawSizeVer,
+                               int renderFlags) {
+
+    FPDF_BITMAP pdfBitmap = FPDFBitmap_CreateEx(canvasHorSize,
+                                                canvasVerSize,
+                                                FPDFBitmap_BGRA,
+                                                windowBuffer->bits,
+                                                (int) (windowBuffer->stride)
+                                                    * 4);
+
+    /*LOGD("Start X: %d", startX);
+    LOGD("Start Y: %d", startY);
+    LOGD("Canvas Hor: %d", canvasHorSize);
+    LOGD("Canvas Ver: %d", canvasVerSize);
+    LOGD("Draw Hor: %d", drawSizeHor);
+    LOGD("Draw Ver: %d", drawSizeVer);*/
+
+    if (drawSizeHor < canvasHorSize || drawSizeVer < canvasVerSize) {
+        FPDFBitmap_FillRect(pdfBitmap, 0, 0, canvasHorSize, canvasVerSize,
+                            0x848484FF); //Gray
+    }
+
+    int baseHorSize =
+        (canvasHorSize < drawSizeHor) ? canvasHorSize : drawSizeHor;
+    int baseVerSize =
+        (canvasVerSize < drawSizeVer) ? canvasVerSize : drawSizeVer;
+    int baseX = (startX < 0) ? 0 : startX;
+    int baseY = (startY < 0) ? 0 : startY;
+    int flags = toPdfiumRenderFlags(renderFlags);
+
+    FPDFBitmap_FillRect(pdfBitmap, baseX, baseY, baseHorSize, baseVerSize,
+                        0xFFFFFFFF); //White
+
+    FPDF_RenderPageBitmap(pdfBitmap, page,
+                          startX, startY,
+                          drawSizeHor, drawSizeVer,
+                          0, flags);
+}
+
+JNIEXPORT void JNICALL Java_com_shockwave_pdfium_PdfiumCore_nativeRenderPage(
+    JNIEnv *env,
+    jobject thiz,
+    jlong pagePtr,
+    jobject objSurface,
+    jint dpi,
+    jint startX,
+    jint startY,
+    jint drawSizeHor,
+    jint drawSizeVer,
+    jint renderFlags) {
     ANativeWindow *nativeWindow = ANativeWindow_fromSurface(env, objSurface);
     if (nativeWindow == NULL) {
         LOGE("native window pointer null");
@@ -543,7 +1140,7 @@ JNIEXPORT void JNICALL Java_com_shockwave_pdfium_PdfiumCore_nativeRenderPage(
                        (int) startX, (int) startY,
                        buffer.width, buffer.height,
                        (int) drawSizeHor, (int) drawSizeVer,
-                       (bool) renderAnnot);
+                       (int) renderFlags);
 
     ANativeWindow_unlockAndPost(nativeWindow);
     ANativeWindow_release(nativeWindow);
@@ -559,7 +1156,7 @@ Java_com_shockwave_pdfium_PdfiumCore_nativeRenderPageBitmap(JNIEnv *env,
                                                             jint startY,
                                                             jint drawSizeHor,
                                                             jint drawSizeVer,
-                                                            jboolean renderAnnot) {
+                                                            jint renderFlags) {
 
     FPDF_PAGE page = reinterpret_cast<FPDF_PAGE>(pagePtr);
 
@@ -579,8 +1176,9 @@ Java_com_shockwave_pdfium_PdfiumCore_nativeRenderPageBitmap(JNIEnv *env,
     int canvasVerSize = info.height;
 
     if (info.format != ANDROID_BITMAP_FORMAT_RGBA_8888
-        && info.format != ANDROID_BITMAP_FORMAT_RGB_565) {
-        LOGE("Bitmap format must be RGBA_8888 or RGB_565");
+        && info.format != ANDROID_BITMAP_FORMAT_RGB_565
+        && info.format != ANDROID_BITMAP_FORMAT_A_8) {
+        LOGE("Bitmap format must be RGBA_8888, RGB_565 or ALPHA_8");
         return;
     }
 
@@ -590,17 +1188,22 @@ Java_com_shockwave_pdfium_PdfiumCore_nativeRenderPageBitmap(JNIEnv *env,
         return;
     }
 
+    ScratchArena::Scope scratch;
     void *tmp;
     int format;
     int sourceStride;
     if (info.format == ANDROID_BITMAP_FORMAT_RGB_565) {
-        tmp = malloc(canvasVerSize * canvasHorSize * sizeof(rgb));
+        tmp = scratch.alloc((size_t) canvasVerSize * canvasHorSize * sizeof(rgb));
+        if (tmp == NULL) {
+            AndroidBitmap_unlockPixels(env, bitmap);
+            return;
+        }
         sourceStride = canvasHorSize * sizeof(rgb);
         format = FPDFBitmap_BGR;
     } else {
         tmp = addr;
         sourceStride = info.stride;
-        format = FPDFBitmap_BGRA;
+        format = info.format == ANDROID_BITMAP_FORMAT_A_8 ? FPDFBitmap_Gray : FPDFBitmap_BGRA;
     }
 
     FPDF_BITMAP pdfBitmap = FPDFBitmap_CreateEx(canvasHorSize, canvasVerSize,
@@ -624,10 +1227,9 @@ Java_com_shockwave_pdfium_PdfiumCore_nativeRenderPageBitmap(JNIEnv *env,
         (canvasVerSize < drawSizeVer) ? canvasVerSize : (int) drawSizeVer;
     int baseX = (startX < 0) ? 0 : (int) startX;
     int baseY = (startY < 0) ? 0 : (int) startY;
-    int flags = FPDF_REVERSE_BYTE_ORDER;
-
-    if (renderAnnot) {
-        flags |= FPDF_ANNOT;
+    int flags = toPdfiumRenderFlags(renderFlags);
+    if (format == FPDFBitmap_Gray) {
+        flags |= FPDF_GRAYSCALE;
     }
 
     FPDFBitmap_FillRect(pdfBitmap, baseX, baseY, baseHorSize, baseVerSize,
@@ -640,10 +1242,536 @@ Java_com_shockwave_pdfium_PdfiumCore_nativeRenderPageBitmap(JNIEnv *env,
 
     if (info.format == ANDROID_BITMAP_FORMAT_RGB_565) {
         rgbBitmapTo565(tmp, sourceStride, addr, &info);
-        free(tmp);
+    } else if (info.format == ANDROID_BITMAP_FORMAT_A_8) {
+        convertGrayToAlpha(static_cast<uint8_t *>(addr), info.stride, info.width, info.height);
+    }
+
+    AndroidBitmap_unlockPixels(env, bitmap);
+}
+
+/* Bytes per pixel of a PDFium bitmap format, 0 if unknown */
+static int bitmapChannels(int format) {
+    switch (format) {
+        case FPDFBitmap_Gray:
+            return 1;
+        case FPDFBitmap_BGR:
+            return 3;
+        case FPDFBitmap_BGRx:
+        case FPDFBitmap_BGRA:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+/*
+ * Embedded thumbnail width may be this fraction, or a pixel at least, off the width the page
+ * aspect ratio gives for its height. Anything further off is not a picture of this page.
+ */
+static const float THUMBNAIL_ASPECT_TOLERANCE = 0.02f;
+
+static bool matchesPageAspect(FPDF_PAGE page, int thumbnailWidth, int thumbnailHeight) {
+    float pageWidth = FPDF_GetPageWidthF(page);
+    float pageHeight = FPDF_GetPageHeightF(page);
+    if (pageWidth <= 0 || pageHeight <= 0) {
+        return false;
+    }
+    float expectedWidth = thumbnailHeight * pageWidth / pageHeight;
+    float tolerance = fmaxf(1.0f, expectedWidth * THUMBNAIL_ASPECT_TOLERANCE);
+    return fabsf(thumbnailWidth - expectedWidth) <= tolerance;
+}
+
+/*
+ * Draws the thumbnail image embedded in the page, if any, scaled to the whole bitmap. Returns false
+ * without touching the bitmap when there is none, it's smaller than minScale of the bitmap
+ * size in either direction or its aspect ratio isn't the page's, the page then has to be rendered.
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativeRenderEmbeddedThumbnail(JNIEnv *env,
+                                                                   jobject thiz,
+                                                                   jlong pagePtr,
+                                                                   jobject bitmap,
+                                                                   jfloat minScale) {
+    FPDF_PAGE page = reinterpret_cast<FPDF_PAGE>(pagePtr);
+    if (page == NULL || bitmap == NULL) {
+        LOGE("Render page pointers invalid");
+        return JNI_FALSE;
+    }
+
+    AndroidBitmapInfo info;
+    int ret;
+    if ((ret = AndroidBitmap_getInfo(env, bitmap, &info)) < 0) {
+        LOGE("Fetching bitmap info failed: %s", strerror(ret * -1));
+        return JNI_FALSE;
+    }
+    if (info.format != ANDROID_BITMAP_FORMAT_RGBA_8888
+        && info.format != ANDROID_BITMAP_FORMAT_RGB_565
+        && info.format != ANDROID_BITMAP_FORMAT_A_8) {
+        LOGE("Bitmap format must be RGBA_8888, RGB_565 or ALPHA_8");
+        return JNI_FALSE;
+    }
+
+    FPDF_BITMAP thumbnail = FPDFPage_GetThumbnailAsBitmap(page);
+    if (thumbnail == NULL) {
+        return JNI_FALSE;
+    }
+
+    int thumbnailWidth = FPDFBitmap_GetWidth(thumbnail);
+    int thumbnailHeight = FPDFBitmap_GetHeight(thumbnail);
+    int sourceChannels = bitmapChannels(FPDFBitmap_GetFormat(thumbnail));
+    const uint8_t *source = static_cast<const uint8_t *>(FPDFBitmap_GetBuffer(thumbnail));
+    if (sourceChannels == 0 || source == NULL
+        || thumbnailWidth < info.width * minScale || thumbnailHeight < info.height * minScale
+        || !matchesPageAspect(page, thumbnailWidth, thumbnailHeight)) {
+        FPDFBitmap_Destroy(thumbnail);
+        return JNI_FALSE;
+    }
+
+    void *addr;
+    if ((ret = AndroidBitmap_lockPixels(env, bitmap, &addr)) != 0) {
+        LOGE("Locking bitmap failed: %s", strerror(ret * -1));
+        FPDFBitmap_Destroy(thumbnail);
+        return JNI_FALSE;
+    }
+
+    int sourceStride = FPDFBitmap_GetStride(thumbnail);
+    bool drawn = true;
+    if (info.format == ANDROID_BITMAP_FORMAT_RGB_565) {
+        ScratchArena::Scope scratch;
+        int rgbStride = info.width * sizeof(rgb);
+        void *tmp = scratch.alloc((size_t) info.height * rgbStride);
+        if (tmp == NULL) {
+            drawn = false;
+        } else {
+            scaleBilinear(source, sourceStride, thumbnailWidth, thumbnailHeight, sourceChannels,
+                          static_cast<uint8_t *>(tmp), rgbStride, info.width, info.height, 3);
+            rgbBitmapTo565(tmp, rgbStride, addr, &info);
+        }
+    } else if (info.format == ANDROID_BITMAP_FORMAT_A_8) {
+        scaleBilinear(source, sourceStride, thumbnailWidth, thumbnailHeight, sourceChannels,
+                      static_cast<uint8_t *>(addr), info.stride, info.width, info.height, 1);
+        convertGrayToAlpha(static_cast<uint8_t *>(addr), info.stride, info.width, info.height);
+    } else {
+        scaleBilinear(source, sourceStride, thumbnailWidth, thumbnailHeight, sourceChannels,
+                      static_cast<uint8_t *>(addr), info.stride, info.width, info.height, 4);
     }
 
     AndroidBitmap_unlockPixels(env, bitmap);
+    FPDFBitmap_Destroy(thumbnail);
+    return drawn ? JNI_TRUE : JNI_FALSE;
+}
+
+static int64_t monotonicMillis() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+JNIEXPORT void JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativeTrimMemory(JNIEnv *env, jobject thiz) {
+    freeRenderBuffers();
+}
+
+/*
+ * Page render split into time slices. PDFium keeps the render progress in the page between
+ * slices, so the page must not be rendered or closed elsewhere until the render is closed.
+ */
+struct ProgressiveRender {
+    IFSDK_PAUSE pause;
+    int64_t deadline = 0;
+
+    FPDF_PAGE page;
+    int startX, startY;
+    int drawSizeHor, drawSizeVer;
+    int flags;
+
+    /* Colors text and paths are drawn in, see PdfiumCore ColorScheme */
+    bool hasColorScheme = false;
+    FPDF_COLORSCHEME colorScheme;
+    /* Page background, ARGB */
+    uint32_t background = 0xFFFFFFFF;
+
+    FPDF_BITMAP pdfBitmap = NULL;
+    bool started = false;
+    /* Locked pixels of the target bitmap, must stay the same for every slice. NULL for atlas renders */
+    void *pixels = NULL;
+    /*
+     * Atlas of an atlas render, or BGR copy when rendering to an RGB_565 bitmap. Outlives a single
+     * call so not in the scratch arena, pooled between renders instead
+     */
+    std::vector<uint8_t> buffer;
+    int bufferStride = 0;
+    int status = FPDF_RENDER_TOBECONTINUED;
+
+    ~ProgressiveRender() {
+        if (started) {
+            FPDF_RenderPage_Close(page);
+        }
+        if (pdfBitmap != NULL) {
+            FPDFBitmap_Destroy(pdfBitmap);
+        }
+        releaseRenderBuffer(buffer);
+    }
+};
+
+static FPDF_BOOL needToPauseNow(IFSDK_PAUSE *pause) {
+    ProgressiveRender *render = reinterpret_cast<ProgressiveRender *>(pause->user);
+    return monotonicMillis() >= render->deadline;
+}
+
+/* Layout of the color scheme array, must match ColorScheme.toArray() */
+enum {
+    COLOR_SCHEME_BACKGROUND,
+    COLOR_SCHEME_PATH_FILL,
+    COLOR_SCHEME_PATH_STROKE,
+    COLOR_SCHEME_TEXT_FILL,
+    COLOR_SCHEME_TEXT_STROKE,
+    COLOR_SCHEME_LENGTH
+};
+
+static ProgressiveRender *newRender(JNIEnv *env, FPDF_PAGE page,
+                                    int startX, int startY,
+                                    int drawSizeHor, int drawSizeVer,
+                                    jint renderFlags, jintArray colorScheme) {
+    ProgressiveRender *render = new ProgressiveRender();
+    render->pause.version = 1;
+    render->pause.NeedToPauseNow = needToPauseNow;
+    render->pause.user = render;
+    render->page = page;
+    render->startX = startX;
+    render->startY = startY;
+    render->drawSizeHor = drawSizeHor;
+    render->drawSizeVer = drawSizeVer;
+    render->flags = toPdfiumRenderFlags(renderFlags);
+
+    if (colorScheme != NULL && env->GetArrayLength(colorScheme) == COLOR_SCHEME_LENGTH) {
+        jint colors[COLOR_SCHEME_LENGTH];
+        env->GetIntArrayRegion(colorScheme, 0, COLOR_SCHEME_LENGTH, colors);
+        render->hasColorScheme = true;
+        render->background = (uint32_t) colors[COLOR_SCHEME_BACKGROUND];
+        render->colorScheme.path_fill_color = (FPDF_DWORD) colors[COLOR_SCHEME_PATH_FILL];
+        render->colorScheme.path_stroke_color = (FPDF_DWORD) colors[COLOR_SCHEME_PATH_STROKE];
+        render->colorScheme.text_fill_color = (FPDF_DWORD) colors[COLOR_SCHEME_TEXT_FILL];
+        render->colorScheme.text_stroke_color = (FPDF_DWORD) colors[COLOR_SCHEME_TEXT_STROKE];
+    }
+    return render;
+}
+
+/*
+ * FPDFBitmap_FillRect writes B, G, R, but pages are rendered with FPDF_REVERSE_BYTE_ORDER,
+ * swap red and blue so the fill matches them
+ */
+static uint32_t toFillColor(uint32_t argb, int format) {
+    if (format == FPDFBitmap_Gray) {
+        return argb;
+    }
+    return (argb & 0xFF00FF00) | ((argb >> 16) & 0xFF) | ((argb & 0xFF) << 16);
+}
+
+/* Wrap target pixels in a PDFium bitmap and paint the background, like a blocking render does */
+static bool createRenderBitmap(ProgressiveRender *render,
+                               int canvasHorSize, int canvasVerSize,
+                               int format, void *target, int stride) {
+    render->pdfBitmap = FPDFBitmap_CreateEx(canvasHorSize, canvasVerSize, format, target, stride);
+    if (render->pdfBitmap == NULL) {
+        return false;
+    }
+    if (format == FPDFBitmap_Gray) {
+        render->flags |= FPDF_GRAYSCALE;
+    }
+
+    if (render->drawSizeHor < canvasHorSize || render->drawSizeVer < canvasVerSize) {
+        FPDFBitmap_FillRect(render->pdfBitmap, 0, 0, canvasHorSize, canvasVerSize,
+                            0x848484FF); //Gray
+    }
+
+    int baseHorSize =
+        (canvasHorSize < render->drawSizeHor) ? canvasHorSize : render->drawSizeHor;
+    int baseVerSize =
+        (canvasVerSize < render->drawSizeVer) ? canvasVerSize : render->drawSizeVer;
+    int baseX = (render->startX < 0) ? 0 : render->startX;
+    int baseY = (render->startY < 0) ? 0 : render->startY;
+
+    FPDFBitmap_FillRect(render->pdfBitmap, baseX, baseY, baseHorSize, baseVerSize,
+                        toFillColor(render->background, format));
+    return true;
+}
+
+static bool createBitmapRender(ProgressiveRender *render, AndroidBitmapInfo *info, void *addr) {
+    render->pixels = addr;
+    if (info->format == ANDROID_BITMAP_FORMAT_RGB_565) {
+        render->bufferStride = info->width * sizeof(rgb);
+        takeRenderBuffer(render->buffer, (size_t) info->height * render->bufferStride);
+        return createRenderBitmap(render, info->width, info->height, FPDFBitmap_BGR,
+                                  render->buffer.data(), render->bufferStride);
+    }
+    return createRenderBitmap(render, info->width, info->height,
+                              info->format == ANDROID_BITMAP_FORMAT_A_8 ? FPDFBitmap_Gray
+                                                                        : FPDFBitmap_BGRA,
+                              addr, info->stride);
+}
+
+static void renderSlice(ProgressiveRender *render, int budgetMillis) {
+    render->deadline = monotonicMillis() + budgetMillis;
+    if (!render->started) {
+        render->started = true;
+        if (render->hasColorScheme) {
+            // Text and paths are drawn in the scheme colors while rasterizing, images are untouched
+            render->status = FPDF_RenderPageBitmapWithColorScheme_Start(
+                render->pdfBitmap, render->page,
+                render->startX, render->startY,
+                render->drawSizeHor, render->drawSizeVer,
+                0, render->flags, &render->colorScheme, &render->pause);
+        } else {
+            render->status = FPDF_RenderPageBitmap_Start(render->pdfBitmap, render->page,
+                                                         render->startX, render->startY,
+                                                         render->drawSizeHor, render->drawSizeVer,
+                                                         0, render->flags, &render->pause);
+        }
+    } else {
+        render->status = FPDF_RenderPage_Continue(render->page, &render->pause);
+    }
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativeOpenRender(JNIEnv *env,
+                                                      jobject thiz,
+                                                      jlong pagePtr,
+                                                      jint startX,
+                                                      jint startY,
+                                                      jint drawSizeHor,
+                                                      jint drawSizeVer,
+                                                      jint renderFlags,
+                                                      jintArray colorScheme) {
+    FPDF_PAGE page = reinterpret_cast<FPDF_PAGE>(pagePtr);
+    if (page == NULL) {
+        LOGE("Render page pointers invalid");
+        return 0;
+    }
+    return reinterpret_cast<jlong>(newRender(env, page, startX, startY, drawSizeHor, drawSizeVer,
+                                             renderFlags, colorScheme));
+}
+
+/*
+ * Render of several tiles of one page at the same zoom in one pass over the page, into an atlas
+ * covering all of them. tiles holds startX, startY, width, height of every tile, the same values
+ * a separate render of the tile would get. The atlas is rendered for the format of formatBitmap.
+ */
+JNIEXPORT jlong JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativeOpenAtlasRender(JNIEnv *env,
+                                                           jobject thiz,
+                                                           jlong pagePtr,
+                                                           jintArray tiles,
+                                                           jint drawSizeHor,
+                                                           jint drawSizeVer,
+                                                           jint renderFlags,
+                                                           jintArray colorScheme,
+                                                           jobject formatBitmap) {
+    FPDF_PAGE page = reinterpret_cast<FPDF_PAGE>(pagePtr);
+    jsize length = env->GetArrayLength(tiles);
+    if (page == NULL || length == 0 || length % 4 != 0) {
+        LOGE("Render page pointers invalid");
+        return 0;
+    }
+
+    AndroidBitmapInfo info;
+    int ret;
+    if ((ret = AndroidBitmap_getInfo(env, formatBitmap, &info)) < 0) {
+        LOGE("Fetching bitmap info failed: %s", strerror(ret * -1));
+        return 0;
+    }
+
+    std::vector<jint> rects((size_t) length);
+    env->GetIntArrayRegion(tiles, 0, length, rects.data());
+
+    // Tile origin in page pixels is -start, the atlas is the bounding box of all tiles
+    int left = INT32_MAX, top = INT32_MAX, right = INT32_MIN, bottom = INT32_MIN;
+    for (jsize i = 0; i < length; i += 4) {
+        left = std::min(left, -rects[i]);
+        top = std::min(top, -rects[i + 1]);
+        right = std::max(right, -rects[i] + rects[i + 2]);
+        bottom = std::max(bottom, -rects[i + 1] + rects[i + 3]);
+    }
+    int atlasWidth = right - left;
+    int atlasHeight = bottom - top;
+    if (atlasWidth <= 0 || atlasHeight <= 0) {
+        return 0;
+    }
+
+    ProgressiveRender *render = newRender(env, page, -left, -top, drawSizeHor, drawSizeVer,
+                                          renderFlags, colorScheme);
+    int format;
+    if (info.format == ANDROID_BITMAP_FORMAT_RGB_565) {
+        render->bufferStride = atlasWidth * sizeof(rgb);
+        format = FPDFBitmap_BGR;
+    } else if (info.format == ANDROID_BITMAP_FORMAT_A_8) {
+        render->bufferStride = atlasWidth;
+        format = FPDFBitmap_Gray;
+    } else {
+        render->bufferStride = atlasWidth * 4;
+        format = FPDFBitmap_BGRA;
+    }
+    takeRenderBuffer(render->buffer, (size_t) atlasHeight * render->bufferStride);
+
+    if (!createRenderBitmap(render, atlasWidth, atlasHeight, format,
+                            render->buffer.data(), render->bufferStride)) {
+        delete render;
+        return 0;
+    }
+    return reinterpret_cast<jlong>(render);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativeContinueRender(JNIEnv *env,
+                                                          jobject thiz,
+                                                          jlong renderPtr,
+                                                          jobject bitmap,
+                                                          jint budgetMillis) {
+    ProgressiveRender *render = reinterpret_cast<ProgressiveRender *>(renderPtr);
+    if (render->status != FPDF_RENDER_TOBECONTINUED) {
+        return render->status;
+    }
+
+    // Atlas renders draw into their own buffer
+    if (bitmap == NULL) {
+        renderSlice(render, budgetMillis);
+        return render->status;
+    }
+
+    AndroidBitmapInfo info;
+    int ret;
+    if ((ret = AndroidBitmap_getInfo(env, bitmap, &info)) < 0) {
+        LOGE("Fetching bitmap info failed: %s", strerror(ret * -1));
+        return render->status = FPDF_RENDER_FAILED;
+    }
+
+    if (info.format != ANDROID_BITMAP_FORMAT_RGBA_8888
+        && info.format != ANDROID_BITMAP_FORMAT_RGB_565
+        && info.format != ANDROID_BITMAP_FORMAT_A_8) {
+        LOGE("Bitmap format must be RGBA_8888, RGB_565 or ALPHA_8");
+        return render->status = FPDF_RENDER_FAILED;
+    }
+
+    void *addr;
+    if ((ret = AndroidBitmap_lockPixels(env, bitmap, &addr)) != 0) {
+        LOGE("Locking bitmap failed: %s", strerror(ret * -1));
+        return render->status = FPDF_RENDER_FAILED;
+    }
+
+    if (render->pdfBitmap == NULL && !createBitmapRender(render, &info, addr)) {
+        render->status = FPDF_RENDER_FAILED;
+    } else if (addr != render->pixels) {
+        LOGE("Bitmap pixels moved between render slices");
+        render->status = FPDF_RENDER_FAILED;
+    } else {
+        renderSlice(render, budgetMillis);
+    }
+
+    if (render->status == FPDF_RENDER_DONE && info.format == ANDROID_BITMAP_FORMAT_RGB_565) {
+        rgbBitmapTo565(render->buffer.data(), render->bufferStride, addr, &info);
+    } else if (render->status == FPDF_RENDER_DONE && info.format == ANDROID_BITMAP_FORMAT_A_8) {
+        convertGrayToAlpha(static_cast<uint8_t *>(addr), info.stride, info.width, info.height);
+    }
+
+    AndroidBitmap_unlockPixels(env, bitmap);
+    return render->status;
+}
+
+/*
+ * Copy tiles out of a finished atlas render, bitmaps and tiles in the order the render was
+ * opened with. Bitmaps must have the format the atlas was rendered for.
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativeCopyAtlasTiles(JNIEnv *env,
+                                                          jobject thiz,
+                                                          jlong renderPtr,
+                                                          jobjectArray bitmaps,
+                                                          jintArray tiles) {
+    ProgressiveRender *render = reinterpret_cast<ProgressiveRender *>(renderPtr);
+    if (render->status != FPDF_RENDER_DONE) {
+        return JNI_FALSE;
+    }
+
+    jsize count = env->GetArrayLength(bitmaps);
+    if (env->GetArrayLength(tiles) != count * 4) {
+        return JNI_FALSE;
+    }
+    std::vector<jint> rects((size_t) count * 4);
+    env->GetIntArrayRegion(tiles, 0, count * 4, rects.data());
+
+    int atlasWidth = FPDFBitmap_GetWidth(render->pdfBitmap);
+    int atlasHeight = FPDFBitmap_GetHeight(render->pdfBitmap);
+    int atlasFormat = FPDFBitmap_GetFormat(render->pdfBitmap);
+    int pixelSize;
+    uint32_t bitmapFormat;
+    if (atlasFormat == FPDFBitmap_BGR) {
+        pixelSize = sizeof(rgb);
+        bitmapFormat = ANDROID_BITMAP_FORMAT_RGB_565;
+    } else if (atlasFormat == FPDFBitmap_Gray) {
+        pixelSize = 1;
+        bitmapFormat = ANDROID_BITMAP_FORMAT_A_8;
+    } else {
+        pixelSize = 4;
+        bitmapFormat = ANDROID_BITMAP_FORMAT_RGBA_8888;
+    }
+
+    for (jsize i = 0; i < count; i++) {
+        jobject bitmap = env->GetObjectArrayElement(bitmaps, i);
+        // Tile position in the atlas, the atlas origin is -render->start in page pixels
+        int x = render->startX - rects[i * 4];
+        int y = render->startY - rects[i * 4 + 1];
+
+        AndroidBitmapInfo info;
+        void *addr;
+        if (bitmap == NULL
+            || AndroidBitmap_getInfo(env, bitmap, &info) < 0
+            || (int) info.width != rects[i * 4 + 2] || (int) info.height != rects[i * 4 + 3]
+            || x < 0 || y < 0
+            || x + (int) info.width > atlasWidth || y + (int) info.height > atlasHeight
+            || (uint32_t) info.format != bitmapFormat) {
+            LOGE("Tile %d doesn't match the atlas", i);
+            return JNI_FALSE;
+        }
+        if (AndroidBitmap_lockPixels(env, bitmap, &addr) != 0) {
+            LOGE("Locking bitmap failed");
+            return JNI_FALSE;
+        }
+
+        const uint8_t *src = render->buffer.data()
+            + (size_t) y * render->bufferStride + (size_t) x * pixelSize;
+        if (bitmapFormat == ANDROID_BITMAP_FORMAT_RGB_565) {
+            rgbBitmapTo565((void *) src, render->bufferStride, addr, &info);
+        } else {
+            uint8_t *dst = static_cast<uint8_t *>(addr);
+            for (uint32_t row = 0; row < info.height; row++) {
+                memcpy(dst + (size_t) row * info.stride,
+                       src + (size_t) row * render->bufferStride,
+                       (size_t) info.width * pixelSize);
+            }
+            if (bitmapFormat == ANDROID_BITMAP_FORMAT_A_8) {
+                convertGrayToAlpha(dst, info.stride, info.width, info.height);
+            }
+        }
+
+        AndroidBitmap_unlockPixels(env, bitmap);
+        env->DeleteLocalRef(bitmap);
+    }
+    return JNI_TRUE;
+}
+
+JNIEXPORT void JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativeCloseRender(JNIEnv *env,
+                                                       jobject thiz,
+                                                       jlong renderPtr) {
+    delete reinterpret_cast<ProgressiveRender *>(renderPtr);
+}
+
+JNIEXPORT void JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativeSetRgb565Dithering(JNIEnv *env,
+                                                              jobject thiz,
+                                                              jboolean dithering) {
+    LOGD("RGB_565 conversion kernel: %s, dithering: %d", getRgbTo565KernelName(), dithering);
+    sDither565.store(dithering == JNI_TRUE, std::memory_order_relaxed);
 }
 
 JNIEXPORT jstring JNICALL
@@ -670,6 +1798,57 @@ Java_com_shockwave_pdfium_PdfiumCore_nativeGetDocumentMetaText(JNIEnv *env,
     return env->NewString((jchar *) text.c_str(), bufferLen / 2 - 1);
 }
 
+JNIEXPORT jbyteArray JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativeGetFileIdentifier(JNIEnv *env,
+                                                             jobject thiz,
+                                                             jlong docPtr,
+                                                             jint idType) {
+    DocumentFile *doc = reinterpret_cast<DocumentFile *>(docPtr);
+    FPDF_FILEIDTYPE type = idType == FILEIDTYPE_CHANGING ? FILEIDTYPE_CHANGING
+                                                         : FILEIDTYPE_PERMANENT;
+
+    unsigned long bufferLen = FPDF_GetFileIdentifier(doc->pdfDocument, type, NULL, 0);
+    if (bufferLen <= 1) {
+        return NULL;
+    }
+    std::vector<jbyte> id(bufferLen);
+    FPDF_GetFileIdentifier(doc->pdfDocument, type, id.data(), bufferLen);
+
+    // Drop NUL terminator
+    jbyteArray result = env->NewByteArray((jsize) (bufferLen - 1));
+    if (result != NULL) {
+        env->SetByteArrayRegion(result, 0, (jsize) (bufferLen - 1), id.data());
+    }
+    return result;
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativeGetFileSize(JNIEnv *env,
+                                                       jobject thiz,
+                                                       jlong docPtr) {
+    DocumentFile *doc = reinterpret_cast<DocumentFile *>(docPtr);
+    return (jlong) doc->fileSize;
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativeGetPageLabel(JNIEnv *env,
+                                                        jobject thiz,
+                                                        jlong docPtr,
+                                                        jint pageIndex) {
+    DocumentFile *doc = reinterpret_cast<DocumentFile *>(docPtr);
+
+    unsigned long bufferLen = FPDF_GetPageLabel(doc->pdfDocument, pageIndex, NULL, 0);
+    if (bufferLen <= 2) {
+        return NULL;
+    }
+    std::wstring label;
+    FPDF_GetPageLabel(doc->pdfDocument,
+                      pageIndex,
+                      WriteInto(&label, bufferLen + 1),
+                      bufferLen);
+    return env->NewString((jchar *) label.c_str(), bufferLen / 2 - 1);
+}
+
 JNIEXPORT jobject JNICALL
 Java_com_shockwave_pdfium_PdfiumCore_nativeGetFirstChildBookmark(JNIEnv *env,
                                                                  jobject thiz,
@@ -919,15 +2098,17 @@ JNIEXPORT jint JNICALL Java_com_shockwave_pdfium_PdfiumCore_nativeTextGetText(
     jcharArray result) {
     FPDF_TEXTPAGE textPage = reinterpret_cast<FPDF_TEXTPAGE>(textPagePtr);
 
-    auto cResult = static_cast<unsigned short *>(malloc(
-        (count + 1) * sizeof(unsigned short)));
+    ScratchArena::Scope scratch;
+    auto cResult = scratch.alloc<unsigned short>(count + 1);
+    if (cResult == NULL) {
+        return -1;
+    }
     int retCount = FPDFText_GetText(textPage, startIndex, (count + 1), cResult);
 
     env->SetCharArrayRegion(result,
                             0,
                             count < retCount ? count : retCount,
                             reinterpret_cast<jchar *>(cResult));
-    free(cResult);
 
     return retCount - 1;
 }
@@ -944,7 +2125,11 @@ Java_com_shockwave_pdfium_PdfiumCore_nativeTextGetBoundedText(JNIEnv *env,
                                                               jcharArray result) {
     FPDF_TEXTPAGE textPage = reinterpret_cast<FPDF_TEXTPAGE>(textPagePtr);
 
-    auto cResult = (unsigned short *) malloc(count * sizeof(unsigned short));
+    ScratchArena::Scope scratch;
+    auto cResult = scratch.alloc<unsigned short>(count);
+    if (cResult == NULL) {
+        return 0;
+    }
     int retCount = FPDFText_GetBoundedText(textPage,
                                            left,
                                            top,
@@ -955,8 +2140,206 @@ Java_com_shockwave_pdfium_PdfiumCore_nativeTextGetBoundedText(JNIEnv *env,
     if (count > 0) {
         env->SetCharArrayRegion(result, 0, retCount, (jchar *) cResult);
     }
-    free(cResult);
     return retCount;
 }
 
+JNIEXPORT jlong JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativeOpenTileCache(JNIEnv *env,
+                                                         jobject thiz,
+                                                         jlong budget) {
+    return reinterpret_cast<jlong>(new TileCache((size_t) budget));
+}
+
+JNIEXPORT void JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativeCloseTileCache(JNIEnv *env,
+                                                          jobject thiz,
+                                                          jlong cachePtr) {
+    delete reinterpret_cast<TileCache *>(cachePtr);
+}
+
+JNIEXPORT void JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativeClearTileCache(JNIEnv *env,
+                                                          jobject thiz,
+                                                          jlong cachePtr) {
+    reinterpret_cast<TileCache *>(cachePtr)->clear();
+}
+
+static uint32_t floatBits(jfloat value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+/* Key of the tile the bitmap holds, false if the bitmap can't hold a tile */
+static bool getTileKey(JNIEnv *env, jobject bitmap, jint pageIndex,
+                       jfloat left, jfloat top, jfloat right, jfloat bottom, jintArray colorScheme,
+                       TileCache::Key *key, uint32_t *stride) {
+    AndroidBitmapInfo info;
+    int ret;
+    if ((ret = AndroidBitmap_getInfo(env, bitmap, &info)) < 0) {
+        LOGE("Fetching bitmap info failed: %s", strerror(ret * -1));
+        return false;
+    }
+    if (TileCache::bytesPerPixel(info.format) == 0) {
+        LOGE("Tile bitmap format must be RGBA_8888, RGB_565 or A_8");
+        return false;
+    }
+
+    key->page = pageIndex;
+    key->left = floatBits(left);
+    key->top = floatBits(top);
+    key->right = floatBits(right);
+    key->bottom = floatBits(bottom);
+    key->width = info.width;
+    key->height = info.height;
+    key->format = info.format;
+    key->hasColorScheme = colorScheme != NULL;
+    memset(key->colors, 0, sizeof(key->colors));
+    if (colorScheme != NULL) {
+        if (env->GetArrayLength(colorScheme) != COLOR_SCHEME_LENGTH) {
+            LOGE("Color scheme must have %d colors", COLOR_SCHEME_LENGTH);
+            return false;
+        }
+        env->GetIntArrayRegion(colorScheme, 0, COLOR_SCHEME_LENGTH,
+                               reinterpret_cast<jint *>(key->colors));
+    }
+    *stride = info.stride;
+    return true;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativePutTile(JNIEnv *env,
+                                                   jobject thiz,
+                                                   jlong cachePtr,
+                                                   jint pageIndex,
+                                                   jfloat left,
+                                                   jfloat top,
+                                                   jfloat right,
+                                                   jfloat bottom,
+                                                   jintArray colorScheme,
+                                                   jobject bitmap) {
+    TileCache *cache = reinterpret_cast<TileCache *>(cachePtr);
+    TileCache::Key key;
+    uint32_t stride;
+    if (!getTileKey(env, bitmap, pageIndex, left, top, right, bottom, colorScheme, &key, &stride)) {
+        return JNI_FALSE;
+    }
+
+    void *addr;
+    int ret;
+    if ((ret = AndroidBitmap_lockPixels(env, bitmap, &addr)) != 0) {
+        LOGE("Locking bitmap failed: %s", strerror(ret * -1));
+        return JNI_FALSE;
+    }
+    bool stored = cache->put(key, addr, stride);
+    AndroidBitmap_unlockPixels(env, bitmap);
+    return (jboolean) stored;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativeTakeTile(JNIEnv *env,
+                                                    jobject thiz,
+                                                    jlong cachePtr,
+                                                    jint pageIndex,
+                                                    jfloat left,
+                                                    jfloat top,
+                                                    jfloat right,
+                                                    jfloat bottom,
+                                                    jintArray colorScheme,
+                                                    jobject bitmap) {
+    TileCache *cache = reinterpret_cast<TileCache *>(cachePtr);
+    TileCache::Key key;
+    uint32_t stride;
+    if (!getTileKey(env, bitmap, pageIndex, left, top, right, bottom, colorScheme, &key, &stride)) {
+        return JNI_FALSE;
+    }
+
+    void *addr;
+    int ret;
+    if ((ret = AndroidBitmap_lockPixels(env, bitmap, &addr)) != 0) {
+        LOGE("Locking bitmap failed: %s", strerror(ret * -1));
+        return JNI_FALSE;
+    }
+    bool taken = cache->take(key, addr, stride);
+    AndroidBitmap_unlockPixels(env, bitmap);
+    return (jboolean) taken;
+}
+
+JNIEXPORT jbyteArray JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativeCompressTile(JNIEnv *env,
+                                                        jobject thiz,
+                                                        jobject bitmap) {
+    TileCache::Key key;
+    uint32_t stride;
+    if (!getTileKey(env, bitmap, 0, 0, 0, 0, 0, NULL, &key, &stride)) {
+        return NULL;
+    }
+
+    void *addr;
+    int ret;
+    if ((ret = AndroidBitmap_lockPixels(env, bitmap, &addr)) != 0) {
+        LOGE("Locking bitmap failed: %s", strerror(ret * -1));
+        return NULL;
+    }
+    std::vector<unsigned char> data;
+    bool compressed = TileCache::compress(key.format, key.width, key.height, addr, stride, data);
+    AndroidBitmap_unlockPixels(env, bitmap);
+    if (!compressed) {
+        return NULL;
+    }
+
+    jbyteArray result = env->NewByteArray((jsize) data.size());
+    if (result == NULL) {
+        return NULL;
+    }
+    env->SetByteArrayRegion(result, 0, (jsize) data.size(), reinterpret_cast<const jbyte *>(data.data()));
+    return result;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativeDecompressTile(JNIEnv *env,
+                                                          jobject thiz,
+                                                          jobject buffer,
+                                                          jint offset,
+                                                          jint length,
+                                                          jobject bitmap) {
+    const unsigned char *data = static_cast<const unsigned char *>(env->GetDirectBufferAddress(buffer));
+    jlong capacity = env->GetDirectBufferCapacity(buffer);
+    if (data == NULL || offset < 0 || length < 0 || (jlong) offset + length > capacity) {
+        LOGE("Tile data must be within a direct buffer");
+        return JNI_FALSE;
+    }
+
+    TileCache::Key key;
+    uint32_t stride;
+    if (!getTileKey(env, bitmap, 0, 0, 0, 0, 0, NULL, &key, &stride)) {
+        return JNI_FALSE;
+    }
+
+    void *addr;
+    int ret;
+    if ((ret = AndroidBitmap_lockPixels(env, bitmap, &addr)) != 0) {
+        LOGE("Locking bitmap failed: %s", strerror(ret * -1));
+        return JNI_FALSE;
+    }
+    bool decompressed = TileCache::decompress(key.format, key.width, key.height,
+                                              data + offset, (size_t) length, addr, stride);
+    AndroidBitmap_unlockPixels(env, bitmap);
+    return (jboolean) decompressed;
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_com_shockwave_pdfium_PdfiumCore_nativeGetTileCacheStats(JNIEnv *env,
+                                                             jobject thiz,
+                                                             jlong cachePtr) {
+    TileCache::Stats stats = reinterpret_cast<TileCache *>(cachePtr)->getStats();
+    jlong values[] = {stats.hits, stats.misses, stats.stores, stats.evictions,
+                      stats.tiles, stats.compressedBytes, stats.rawBytes};
+    jsize count = (jsize) (sizeof(values) / sizeof(values[0]));
+
+    jlongArray result = env->NewLongArray(count);
+    env->SetLongArrayRegion(result, 0, count, values);
+    return result;
+}
+
 }//extern C
@@ -0,0 +1,340 @@
+#include "pixelConvert.hpp"
+
+extern "C" {
+#include <string.h>
+}
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PIXEL_CONVERT_NEON
+#elif defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#define PIXEL_CONVERT_X86
+#endif
+
+/*
+ * Dither offsets added to every channel before truncation, 4x4 Bayer matrix scaled to the
+ * quantization step: 8 for 5-bit red and blue, 4 for 6-bit green. Rows repeat the 4 pixel
+ * pattern to the 16 pixels vector kernels process at once.
+ */
+static const uint8_t DITHER_RB[4][16] = {
+    {0, 4, 1, 5, 0, 4, 1, 5, 0, 4, 1, 5, 0, 4, 1, 5},
+    {6, 2, 7, 3, 6, 2, 7, 3, 6, 2, 7, 3, 6, 2, 7, 3},
+    {1, 5, 0, 4, 1, 5, 0, 4, 1, 5, 0, 4, 1, 5, 0, 4},
+    {7, 3, 6, 2, 7, 3, 6, 2, 7, 3, 6, 2, 7, 3, 6, 2},
+};
+
+static const uint8_t DITHER_G[4][16] = {
+    {0, 2, 0, 2, 0, 2, 0, 2, 0, 2, 0, 2, 0, 2, 0, 2},
+    {3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1},
+    {0, 2, 0, 2, 0, 2, 0, 2, 0, 2, 0, 2, 0, 2, 0, 2},
+    {3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1},
+};
+
+/*
+ * Converts a row starting at pixel 0 and returns number of pixels done, the rest of the row
+ * is finished by the scalar loop. Dither rows are NULL when dithering is off.
+ */
+typedef int (*RowKernel)(const uint8_t *source, uint16_t *dest, int width,
+                         const uint8_t *ditherRb, const uint8_t *ditherG);
+
+static inline uint8_t addSaturated(uint8_t value, uint8_t offset) {
+    unsigned sum = (unsigned) value + offset;
+    return (uint8_t) (sum > 255 ? 255 : sum);
+}
+
+static void convertRowScalar(const uint8_t *source, uint16_t *dest, int from, int width,
+                             const uint8_t *ditherRb, const uint8_t *ditherG) {
+    for (int x = from; x < width; x++) {
+        const uint8_t *pixel = source + x * 3;
+        uint8_t red = pixel[0];
+        uint8_t green = pixel[1];
+        uint8_t blue = pixel[2];
+        if (ditherRb != NULL) {
+            red = addSaturated(red, ditherRb[x & 15]);
+            green = addSaturated(green, ditherG[x & 15]);
+            blue = addSaturated(blue, ditherRb[x & 15]);
+        }
+        dest[x] = (uint16_t) (((red >> 3) << 11) | ((green >> 2) << 5) | (blue >> 3));
+    }
+}
+
+static int convertRowNone(const uint8_t *source, uint16_t *dest, int width,
+                          const uint8_t *ditherRb, const uint8_t *ditherG) {
+    return 0;
+}
+
+#ifdef PIXEL_CONVERT_NEON
+
+static int convertRowNeon(const uint8_t *source, uint16_t *dest, int width,
+                          const uint8_t *ditherRb, const uint8_t *ditherG) {
+    uint8x16_t offsetRb = ditherRb != NULL ? vld1q_u8(ditherRb) : vdupq_n_u8(0);
+    uint8x16_t offsetG = ditherG != NULL ? vld1q_u8(ditherG) : vdupq_n_u8(0);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x3_t pixels = vld3q_u8(source + x * 3);
+        uint8x16_t red = vqaddq_u8(pixels.val[0], offsetRb);
+        uint8x16_t green = vqaddq_u8(pixels.val[1], offsetG);
+        uint8x16_t blue = vqaddq_u8(pixels.val[2], offsetRb);
+
+        // Channel in the high byte, then shift-right-insert keeps the top bits of what's already there
+        uint16x8_t low = vshll_n_u8(vget_low_u8(red), 8);
+        low = vsriq_n_u16(low, vshll_n_u8(vget_low_u8(green), 8), 5);
+        low = vsriq_n_u16(low, vshll_n_u8(vget_low_u8(blue), 8), 11);
+
+        uint16x8_t high = vshll_n_u8(vget_high_u8(red), 8);
+        high = vsriq_n_u16(high, vshll_n_u8(vget_high_u8(green), 8), 5);
+        high = vsriq_n_u16(high, vshll_n_u8(vget_high_u8(blue), 8), 11);
+
+        vst1q_u16(dest + x, low);
+        vst1q_u16(dest + x + 8, high);
+    }
+    return x;
+}
+
+#endif
+
+#ifdef PIXEL_CONVERT_X86
+
+/* Splits 16 packed R, G, B pixels from three 16 byte loads into one vector per channel */
+__attribute__((target("ssse3")))
+static inline void deinterleaveRgb(const uint8_t *source, __m128i *red, __m128i *green, __m128i *blue) {
+    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source));
+    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + 16));
+    const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + 32));
+
+    *red = _mm_or_si128(_mm_or_si128(
+        _mm_shuffle_epi8(a, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+        _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1))),
+        _mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13)));
+    *green = _mm_or_si128(_mm_or_si128(
+        _mm_shuffle_epi8(a, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+        _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1))),
+        _mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14)));
+    *blue = _mm_or_si128(_mm_or_si128(
+        _mm_shuffle_epi8(a, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+        _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1))),
+        _mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)));
+}
+
+__attribute__((target("ssse3")))
+static inline __m128i pack565(__m128i red, __m128i green, __m128i blue) {
+    __m128i r = _mm_slli_epi16(_mm_and_si128(red, _mm_set1_epi16(0xF8)), 8);
+    __m128i g = _mm_slli_epi16(_mm_and_si128(green, _mm_set1_epi16(0xFC)), 3);
+    __m128i b = _mm_srli_epi16(blue, 3);
+    return _mm_or_si128(_mm_or_si128(r, g), b);
+}
+
+__attribute__((target("ssse3")))
+static int convertRowSsse3(const uint8_t *source, uint16_t *dest, int width,
+                           const uint8_t *ditherRb, const uint8_t *ditherG) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i offsetRb = ditherRb != NULL
+                             ? _mm_loadu_si128(reinterpret_cast<const __m128i *>(ditherRb)) : zero;
+    const __m128i offsetG = ditherG != NULL
+                            ? _mm_loadu_si128(reinterpret_cast<const __m128i *>(ditherG)) : zero;
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i red, green, blue;
+        deinterleaveRgb(source + x * 3, &red, &green, &blue);
+        red = _mm_adds_epu8(red, offsetRb);
+        green = _mm_adds_epu8(green, offsetG);
+        blue = _mm_adds_epu8(blue, offsetRb);
+
+        __m128i low = pack565(_mm_unpacklo_epi8(red, zero), _mm_unpacklo_epi8(green, zero),
+                              _mm_unpacklo_epi8(blue, zero));
+        __m128i high = pack565(_mm_unpackhi_epi8(red, zero), _mm_unpackhi_epi8(green, zero),
+                               _mm_unpackhi_epi8(blue, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + x), low);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + x + 8), high);
+    }
+    return x;
+}
+
+__attribute__((target("avx2")))
+static int convertRowAvx2(const uint8_t *source, uint16_t *dest, int width,
+                          const uint8_t *ditherRb, const uint8_t *ditherG) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i offsetRb = ditherRb != NULL
+                             ? _mm_loadu_si128(reinterpret_cast<const __m128i *>(ditherRb)) : zero;
+    const __m128i offsetG = ditherG != NULL
+                            ? _mm_loadu_si128(reinterpret_cast<const __m128i *>(ditherG)) : zero;
+    const __m256i maskRb = _mm256_set1_epi16(0xF8);
+    const __m256i maskG = _mm256_set1_epi16(0xFC);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i red, green, blue;
+        deinterleaveRgb(source + x * 3, &red, &green, &blue);
+
+        // All 16 pixels fit one register once widened to 16 bits
+        __m256i r = _mm256_cvtepu8_epi16(_mm_adds_epu8(red, offsetRb));
+        __m256i g = _mm256_cvtepu8_epi16(_mm_adds_epu8(green, offsetG));
+        __m256i b = _mm256_cvtepu8_epi16(_mm_adds_epu8(blue, offsetRb));
+
+        __m256i pixels = _mm256_or_si256(
+            _mm256_or_si256(_mm256_slli_epi16(_mm256_and_si256(r, maskRb), 8),
+                            _mm256_slli_epi16(_mm256_and_si256(g, maskG), 3)),
+            _mm256_srli_epi16(b, 3));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest + x), pixels);
+    }
+    return x;
+}
+
+#endif
+
+struct Kernel {
+    RowKernel convertRow;
+    const char *name;
+};
+
+static Kernel selectKernel() {
+#if defined(PIXEL_CONVERT_NEON)
+    // NEON is mandatory on arm64-v8a and enabled by default for armeabi-v7a
+    return {convertRowNeon, "neon"};
+#elif defined(PIXEL_CONVERT_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return {convertRowAvx2, "avx2"};
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        return {convertRowSsse3, "ssse3"};
+    }
+#endif
+    return {convertRowNone, "scalar"};
+}
+
+static const Kernel &getKernel() {
+    static const Kernel kernel = selectKernel();
+    return kernel;
+}
+
+static void convert(RowKernel convertRow,
+                    const uint8_t *source, int sourceStride,
+                    uint16_t *dest, int destStride,
+                    int width, int height, bool dither) {
+    for (int y = 0; y < height; y++) {
+        const uint8_t *ditherRb = dither ? DITHER_RB[y & 3] : NULL;
+        const uint8_t *ditherG = dither ? DITHER_G[y & 3] : NULL;
+
+        int done = convertRow(source, dest, width, ditherRb, ditherG);
+        convertRowScalar(source, dest, done, width, ditherRb, ditherG);
+
+        source += sourceStride;
+        dest = reinterpret_cast<uint16_t *>(reinterpret_cast<uint8_t *>(dest) + destStride);
+    }
+}
+
+void convertRgbTo565(const uint8_t *source, int sourceStride,
+                     uint16_t *dest, int destStride,
+                     int width, int height, bool dither) {
+    convert(getKernel().convertRow, source, sourceStride, dest, destStride, width, height, dither);
+}
+
+void convertRgbTo565Scalar(const uint8_t *source, int sourceStride,
+                           uint16_t *dest, int destStride,
+                           int width, int height, bool dither) {
+    convert(convertRowNone, source, sourceStride, dest, destStride, width, height, dither);
+}
+
+bool convertRgbTo565WithKernel(const char *kernel,
+                               const uint8_t *source, int sourceStride,
+                               uint16_t *dest, int destStride,
+                               int width, int height, bool dither) {
+    RowKernel convertRow = NULL;
+    if (strcmp(kernel, "scalar") == 0) {
+        convertRow = convertRowNone;
+#if defined(PIXEL_CONVERT_NEON)
+    } else if (strcmp(kernel, "neon") == 0) {
+        convertRow = convertRowNeon;
+#elif defined(PIXEL_CONVERT_X86)
+    } else if (strcmp(kernel, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        convertRow = convertRowAvx2;
+    } else if (strcmp(kernel, "ssse3") == 0 && __builtin_cpu_supports("ssse3")) {
+        convertRow = convertRowSsse3;
+#endif
+    }
+    if (convertRow == NULL) {
+        return false;
+    }
+    convert(convertRow, source, sourceStride, dest, destStride, width, height, dither);
+    return true;
+}
+
+const char *getRgbTo565KernelName() {
+    return getKernel().name;
+}
+
+void convertGrayToAlpha(uint8_t *pixels, int stride, int width, int height) {
+    // Simple enough for the compiler to vectorize on every target
+    for (int y = 0; y < height; y++) {
+        uint8_t *row = pixels + (size_t) y * stride;
+        for (int x = 0; x < width; x++) {
+            row[x] = (uint8_t) (255 - row[x]);
+        }
+    }
+}
+
+static inline int sourceCoord(int destCoord, int sourceSize, int destSize) {
+    // 16.16 fixed point position of the dest pixel center in source pixels
+    int64_t position = (((int64_t) destCoord * 2 + 1) * sourceSize << 16) / (destSize * 2) - (1 << 15);
+    int64_t max = (int64_t) (sourceSize - 1) << 16;
+    return (int) (position < 0 ? 0 : (position > max ? max : position));
+}
+
+static inline void readBgr(const uint8_t *pixel, int channels, int *bgr) {
+    if (channels == 1) {
+        bgr[0] = bgr[1] = bgr[2] = pixel[0];
+    } else {
+        bgr[0] = pixel[0];
+        bgr[1] = pixel[1];
+        bgr[2] = pixel[2];
+    }
+}
+
+void scaleBilinear(const uint8_t *source, int sourceStride,
+                   int sourceWidth, int sourceHeight, int sourceChannels,
+                   uint8_t *dest, int destStride,
+                   int destWidth, int destHeight, int destChannels) {
+    for (int y = 0; y < destHeight; y++) {
+        int sy = sourceCoord(y, sourceHeight, destHeight);
+        int y0 = sy >> 16;
+        int y1 = y0 + 1 < sourceHeight ? y0 + 1 : y0;
+        int fy = (sy & 0xFFFF) >> 8;
+        const uint8_t *row0 = source + (size_t) y0 * sourceStride;
+        const uint8_t *row1 = source + (size_t) y1 * sourceStride;
+        uint8_t *out = dest + (size_t) y * destStride;
+
+        for (int x = 0; x < destWidth; x++) {
+            int sx = sourceCoord(x, sourceWidth, destWidth);
+            int x0 = sx >> 16;
+            int x1 = x0 + 1 < sourceWidth ? x0 + 1 : x0;
+            int fx = (sx & 0xFFFF) >> 8;
+
+            int p00[3], p01[3], p10[3], p11[3], bgr[3];
+            readBgr(row0 + x0 * sourceChannels, sourceChannels, p00);
+            readBgr(row0 + x1 * sourceChannels, sourceChannels, p01);
+            readBgr(row1 + x0 * sourceChannels, sourceChannels, p10);
+            readBgr(row1 + x1 * sourceChannels, sourceChannels, p11);
+            for (int c = 0; c < 3; c++) {
+                int top = p00[c] * (256 - fx) + p01[c] * fx;
+                int bottom = p10[c] * (256 - fx) + p11[c] * fx;
+                bgr[c] = (top * (256 - fy) + bottom * fy + (1 << 15)) >> 16;
+            }
+
+            if (destChannels == 1) {
+                out[x] = (uint8_t) ((bgr[2] * 77 + bgr[1] * 150 + bgr[0] * 29) >> 8);
+            } else {
+                uint8_t *pixel = out + x * destChannels;
+                pixel[0] = (uint8_t) bgr[2];
+                pixel[1] = (uint8_t) bgr[1];
+                pixel[2] = (uint8_t) bgr[0];
+                if (destChannels == 4) {
+                    pixel[3] = 255;
+                }
+            }
+        }
+    }
+}
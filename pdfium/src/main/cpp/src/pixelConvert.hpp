@@ -0,0 +1,52 @@
+#ifndef _PIXEL_CONVERT_HPP_
+#define _PIXEL_CONVERT_HPP_
+
+extern "C" {
+#include <stddef.h>
+#include <stdint.h>
+}
+
+/*
+ * Converts 24-bit pixels stored as R, G, B bytes (PDFium BGR rendered with FPDF_REVERSE_BYTE_ORDER)
+ * to RGB_565. Uses the widest kernel the CPU supports: NEON on ARM, AVX2 or SSSE3 on x86.
+ * With dither set, a 4x4 ordered (Bayer) pattern is added before truncation to hide banding.
+ * Strides are in bytes.
+ */
+void convertRgbTo565(const uint8_t *source, int sourceStride,
+                     uint16_t *dest, int destStride,
+                     int width, int height, bool dither);
+
+/* Plain C implementation, the reference all vector kernels must match bit for bit */
+void convertRgbTo565Scalar(const uint8_t *source, int sourceStride,
+                           uint16_t *dest, int destStride,
+                           int width, int height, bool dither);
+
+/*
+ * Convert with the named kernel ("scalar", "neon", "ssse3" or "avx2") instead of the selected one,
+ * so tests can compare every kernel the CPU runs with the scalar one. False if it can't run here
+ */
+bool convertRgbTo565WithKernel(const char *kernel,
+                               const uint8_t *source, int sourceStride,
+                               uint16_t *dest, int destStride,
+                               int width, int height, bool dither);
+
+/* Name of the kernel selected for this CPU */
+const char *getRgbTo565KernelName();
+
+/*
+ * Turns 8-bit gray rendered by PDFium into ALPHA_8 coverage (255 - gray) in place, so the bitmap
+ * drawn with a black paint over white shows the page. Stride in bytes.
+ */
+void convertGrayToAlpha(uint8_t *pixels, int stride, int width, int height);
+
+/*
+ * Bilinear scale of PDFium pixels, Gray, BGR or BGRx/BGRA by sourceChannels 1, 3 or 4, to gray,
+ * R, G, B or R, G, B, A bytes by destChannels 1, 3 or 4. Source alpha is ignored, dest alpha is
+ * opaque. Meant for thumbnails, shrinking by more than 2x skips source pixels. Strides in bytes.
+ */
+void scaleBilinear(const uint8_t *source, int sourceStride,
+                   int sourceWidth, int sourceHeight, int sourceChannels,
+                   uint8_t *dest, int destStride,
+                   int destWidth, int destHeight, int destChannels);
+
+#endif
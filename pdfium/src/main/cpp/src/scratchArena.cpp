@@ -0,0 +1,145 @@
+#include "scratchArena.hpp"
+#include "util.hpp"
+
+#include <atomic>
+
+static const size_t ALIGNMENT = 16;
+
+/* Chunks are rounded up to this size so small growth steps don't reallocate every time */
+static const size_t GRANULARITY = 64 * 1024;
+
+/* Trimming is considered once per this many outermost scopes */
+static const int TRIM_WINDOW = 64;
+
+/* Arenas smaller than this are never trimmed */
+static const size_t MIN_TRIM_CAPACITY = 256 * 1024;
+
+static std::atomic<int64_t> sAllocations(0);
+static std::atomic<int64_t> sAllocatedBytes(0);
+static std::atomic<int64_t> sGrowths(0);
+static std::atomic<int64_t> sTrims(0);
+static std::atomic<int64_t> sReservedBytes(0);
+static std::atomic<int64_t> sPeakReservedBytes(0);
+
+static size_t roundUp(size_t size, size_t to) {
+    return (size + to - 1) / to * to;
+}
+
+static void addReserved(int64_t delta) {
+    int64_t reserved = sReservedBytes.fetch_add(delta) + delta;
+    int64_t peak = sPeakReservedBytes.load();
+    while (reserved > peak && !sPeakReservedBytes.compare_exchange_weak(peak, reserved)) {}
+}
+
+ScratchArena &ScratchArena::current() {
+    static thread_local ScratchArena arena;
+    return arena;
+}
+
+ScratchArena::Stats ScratchArena::getStats() {
+    Stats stats;
+    stats.allocations = sAllocations.load();
+    stats.allocatedBytes = sAllocatedBytes.load();
+    stats.growths = sGrowths.load();
+    stats.trims = sTrims.load();
+    stats.reservedBytes = sReservedBytes.load();
+    stats.peakReservedBytes = sPeakReservedBytes.load();
+    return stats;
+}
+
+ScratchArena::~ScratchArena() {
+    for (unsigned char *chunk : retired) {
+        free(chunk);
+    }
+    if (data != NULL) {
+        free(data);
+        addReserved(-(int64_t) capacity);
+    }
+}
+
+ScratchArena::Scope::Scope() : arena(current()) {
+    arena.depth++;
+}
+
+ScratchArena::Scope::~Scope() {
+    arena.endScope();
+}
+
+void *ScratchArena::Scope::alloc(size_t size) {
+    return arena.alloc(size);
+}
+
+bool ScratchArena::reserve(size_t size) {
+    size_t newCapacity = roundUp(size, GRANULARITY);
+    auto *chunk = static_cast<unsigned char *>(malloc(newCapacity));
+    if (chunk == NULL) {
+        LOGE("Cannot reserve %zu bytes of scratch memory", newCapacity);
+        return false;
+    }
+    if (data != NULL) {
+        if (used > 0) {
+            // Earlier allocations of the open scope still point into it
+            retired.push_back(data);
+        } else {
+            free(data);
+        }
+        addReserved(-(int64_t) capacity);
+    }
+    data = chunk;
+    capacity = newCapacity;
+    used = 0;
+    addReserved((int64_t) newCapacity);
+    return true;
+}
+
+void *ScratchArena::alloc(size_t size) {
+    size = roundUp(size > 0 ? size : 1, ALIGNMENT);
+    if (used + size > capacity) {
+        // Grow geometrically, so a burst of larger renders settles after a couple of steps
+        size_t wanted = used + size > 2 * capacity ? used + size : 2 * capacity;
+        if (!reserve(wanted)) {
+            return NULL;
+        }
+        sGrowths++;
+    }
+    void *result = data + used;
+    used += size;
+    scopeBytes += size;
+    sAllocations++;
+    sAllocatedBytes += (int64_t) size;
+    return result;
+}
+
+void ScratchArena::endScope() {
+    if (--depth > 0) {
+        return;
+    }
+
+    for (unsigned char *chunk : retired) {
+        free(chunk);
+    }
+    retired.clear();
+    used = 0;
+
+    if (scopeBytes > windowPeak) {
+        windowPeak = scopeBytes;
+    }
+    scopeBytes = 0;
+
+    if (++windowScopes < TRIM_WINDOW) {
+        return;
+    }
+    // Shrink to what the last window needed once it's well below what's reserved
+    if (capacity > MIN_TRIM_CAPACITY && capacity > 2 * roundUp(windowPeak, GRANULARITY)) {
+        free(data);
+        addReserved(-(int64_t) capacity);
+        data = NULL;
+        capacity = 0;
+        if (windowPeak > 0) {
+            reserve(windowPeak);
+        }
+        sTrims++;
+    }
+    windowPeak = 0;
+    windowScopes = 0;
+}
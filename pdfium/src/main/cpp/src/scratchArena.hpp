@@ -0,0 +1,72 @@
+#ifndef _SCRATCH_ARENA_HPP_
+#define _SCRATCH_ARENA_HPP_
+
+extern "C" {
+#include <stddef.h>
+#include <stdint.h>
+}
+
+#include <vector>
+
+/*
+ * Per thread scratch memory for temporary native buffers, like the 24-bit render target of
+ * RGB_565 renders or UTF-16 text buffers. Memory is reused between calls instead of going through
+ * the allocator and faulting in fresh pages every time. Allocations are only valid inside a Scope,
+ * everything is released when the outermost Scope of the thread ends. Capacity follows the high
+ * water mark and is trimmed when recent calls needed much less.
+ */
+class ScratchArena {
+ public:
+  /* Must match ScratchArenaStats field order, totals of all threads */
+  struct Stats {
+      int64_t allocations = 0;
+      int64_t allocatedBytes = 0;
+      int64_t growths = 0;
+      int64_t trims = 0;
+      int64_t reservedBytes = 0;
+      int64_t peakReservedBytes = 0;
+  };
+
+  class Scope {
+   public:
+    Scope();
+    ~Scope();
+
+    /* 16 byte aligned, NULL if memory is exhausted */
+    void *alloc(size_t size);
+
+    template<class T>
+    T *alloc(size_t count) { return static_cast<T *>(alloc(count * sizeof(T))); }
+
+   private:
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+    ScratchArena &arena;
+  };
+
+  static Stats getStats();
+
+  ~ScratchArena();
+
+ private:
+  static ScratchArena &current();
+
+  void *alloc(size_t size);
+  void endScope();
+  bool reserve(size_t size);
+
+  unsigned char *data = NULL;
+  size_t capacity = 0;
+  size_t used = 0;
+  /* Chunks outgrown inside an open scope, freed once it ends */
+  std::vector<unsigned char *> retired;
+  int depth = 0;
+
+  /* Bytes used by the current outermost scope, including retired chunks */
+  size_t scopeBytes = 0;
+  size_t windowPeak = 0;
+  int windowScopes = 0;
+};
+
+#endif
@@ -0,0 +1,329 @@
+#include "tileCache.hpp"
+#include "util.hpp"
+
+extern "C" {
+#include <string.h>
+}
+
+#include <android/bitmap.h>
+#include <algorithm>
+
+using namespace android;
+
+/* First byte of every encoded row */
+static const unsigned char ROW_CODED = 0;
+static const unsigned char ROW_REPEAT = 1;
+
+/* Token kinds, the token is (pixel count << 1) | kind */
+static const uint32_t TOKEN_LITERAL = 0;
+static const uint32_t TOKEN_RUN = 1;
+
+/* Shorter runs of equal pixels are cheaper as part of a literal */
+static const int MIN_RUN = 3;
+
+/* A single tile may take 1/MAX_TILE_BUDGET_SHARE of the budget at most */
+static const size_t MAX_TILE_BUDGET_SHARE = 4;
+
+static void putVarint(std::vector<unsigned char> &out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back((unsigned char) (value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((unsigned char) value);
+}
+
+static bool getVarint(const unsigned char *in, size_t size, size_t *position, uint32_t *value) {
+    uint32_t result = 0;
+    for (int shift = 0; shift < 32 && *position < size; shift += 7) {
+        unsigned char byte = in[(*position)++];
+        result |= (uint32_t) (byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+template<class Pixel>
+static void putPixels(std::vector<unsigned char> &out, const Pixel *pixels, int count) {
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(pixels);
+    out.insert(out.end(), bytes, bytes + (size_t) count * sizeof(Pixel));
+}
+
+template<class Pixel>
+static void encodeRow(const Pixel *row, const Pixel *previousRow, int width,
+                      std::vector<unsigned char> &out) {
+    if (previousRow != NULL && memcmp(row, previousRow, (size_t) width * sizeof(Pixel)) == 0) {
+        out.push_back(ROW_REPEAT);
+        return;
+    }
+
+    out.push_back(ROW_CODED);
+    int literalStart = 0;
+    int x = 0;
+    while (x < width) {
+        int run = 1;
+        while (x + run < width && row[x + run] == row[x]) {
+            run++;
+        }
+        if (run < MIN_RUN) {
+            x += run;
+            continue;
+        }
+        if (literalStart < x) {
+            putVarint(out, ((uint32_t) (x - literalStart) << 1) | TOKEN_LITERAL);
+            putPixels(out, row + literalStart, x - literalStart);
+        }
+        putVarint(out, ((uint32_t) run << 1) | TOKEN_RUN);
+        putPixels(out, row + x, 1);
+        x += run;
+        literalStart = x;
+    }
+    if (literalStart < width) {
+        putVarint(out, ((uint32_t) (width - literalStart) << 1) | TOKEN_LITERAL);
+        putPixels(out, row + literalStart, width - literalStart);
+    }
+}
+
+template<class Pixel>
+static void encodeTile(const unsigned char *pixels, uint32_t stride, int width, int height,
+                       std::vector<unsigned char> &out) {
+    const Pixel *previousRow = NULL;
+    for (int y = 0; y < height; y++) {
+        const Pixel *row = reinterpret_cast<const Pixel *>(pixels + (size_t) y * stride);
+        encodeRow(row, previousRow, width, out);
+        previousRow = row;
+    }
+}
+
+template<class Pixel>
+static bool decodeTile(const unsigned char *in, size_t size, unsigned char *pixels,
+                       uint32_t stride, int width, int height) {
+    size_t position = 0;
+    for (int y = 0; y < height; y++) {
+        Pixel *row = reinterpret_cast<Pixel *>(pixels + (size_t) y * stride);
+        if (position >= size) {
+            return false;
+        }
+        if (in[position++] == ROW_REPEAT) {
+            if (y == 0) {
+                return false;
+            }
+            memcpy(row, pixels + (size_t) (y - 1) * stride, (size_t) width * sizeof(Pixel));
+            continue;
+        }
+
+        int x = 0;
+        while (x < width) {
+            uint32_t token;
+            if (!getVarint(in, size, &position, &token)) {
+                return false;
+            }
+            int count = (int) (token >> 1);
+            if (count == 0 || count > width - x) {
+                return false;
+            }
+            if ((token & 1) == TOKEN_RUN) {
+                if (size - position < sizeof(Pixel)) {
+                    return false;
+                }
+                Pixel pixel;
+                memcpy(&pixel, in + position, sizeof(Pixel));
+                position += sizeof(Pixel);
+                std::fill(row + x, row + x + count, pixel);
+            } else {
+                size_t bytes = (size_t) count * sizeof(Pixel);
+                if (size - position < bytes) {
+                    return false;
+                }
+                memcpy(row + x, in + position, bytes);
+                position += bytes;
+            }
+            x += count;
+        }
+    }
+    return position == size;
+}
+
+static void encode(int bpp, const void *pixels, uint32_t stride, uint32_t width, uint32_t height,
+                   std::vector<unsigned char> &out) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(pixels);
+    out.reserve(out.size() + (size_t) width * height * bpp / 8);
+    if (bpp == 4) {
+        encodeTile<uint32_t>(bytes, stride, (int) width, (int) height, out);
+    } else if (bpp == 2) {
+        encodeTile<uint16_t>(bytes, stride, (int) width, (int) height, out);
+    } else {
+        encodeTile<uint8_t>(bytes, stride, (int) width, (int) height, out);
+    }
+}
+
+static bool decode(int bpp, const unsigned char *data, size_t size, void *pixels, uint32_t stride,
+                   uint32_t width, uint32_t height) {
+    unsigned char *bytes = static_cast<unsigned char *>(pixels);
+    if (bpp == 4) {
+        return decodeTile<uint32_t>(data, size, bytes, stride, (int) width, (int) height);
+    } else if (bpp == 2) {
+        return decodeTile<uint16_t>(data, size, bytes, stride, (int) width, (int) height);
+    } else {
+        return decodeTile<uint8_t>(data, size, bytes, stride, (int) width, (int) height);
+    }
+}
+
+/* FNV-1a, catches tiles torn by a crash while they were written */
+static uint32_t checksum(const unsigned char *data, size_t size) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+bool TileCache::compress(int32_t format, uint32_t width, uint32_t height,
+                         const void *pixels, uint32_t stride, std::vector<unsigned char> &out) {
+    int bpp = bytesPerPixel(format);
+    if (bpp == 0 || width == 0 || height == 0) {
+        return false;
+    }
+    encode(bpp, pixels, stride, width, height, out);
+    uint32_t sum = checksum(out.data(), out.size());
+    for (int i = 0; i < 4; i++) {
+        out.push_back((unsigned char) (sum >> (i * 8)));
+    }
+    return true;
+}
+
+bool TileCache::decompress(int32_t format, uint32_t width, uint32_t height,
+                           const unsigned char *data, size_t size, void *pixels, uint32_t stride) {
+    int bpp = bytesPerPixel(format);
+    if (bpp == 0 || size < 4) {
+        return false;
+    }
+    size -= 4;
+    uint32_t sum = 0;
+    for (int i = 0; i < 4; i++) {
+        sum |= (uint32_t) data[size + i] << (i * 8);
+    }
+    return sum == checksum(data, size) && decode(bpp, data, size, pixels, stride, width, height);
+}
+
+bool TileCache::Key::operator==(const Key &other) const {
+    return page == other.page
+        && left == other.left && top == other.top
+        && right == other.right && bottom == other.bottom
+        && width == other.width && height == other.height
+        && format == other.format
+        && hasColorScheme == other.hasColorScheme
+        && memcmp(colors, other.colors, sizeof(colors)) == 0;
+}
+
+size_t TileCache::KeyHash::operator()(const Key &key) const {
+    size_t hash = (size_t) key.page;
+    uint32_t fields[] = {key.left, key.top, key.right, key.bottom, key.width, key.height,
+                         (uint32_t) key.format};
+    for (uint32_t field : fields) {
+        hash = hash * 31 + field;
+    }
+    for (uint32_t color : key.colors) {
+        hash = hash * 31 + color;
+    }
+    return hash;
+}
+
+TileCache::TileCache(size_t budget) : budget(budget) {
+}
+
+int TileCache::bytesPerPixel(int32_t format) {
+    switch (format) {
+        case ANDROID_BITMAP_FORMAT_RGBA_8888:
+            return 4;
+        case ANDROID_BITMAP_FORMAT_RGB_565:
+            return 2;
+        case ANDROID_BITMAP_FORMAT_A_8:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+bool TileCache::put(const Key &key, const void *pixels, uint32_t stride) {
+    int bpp = bytesPerPixel(key.format);
+    if (bpp == 0 || key.width == 0 || key.height == 0) {
+        return false;
+    }
+
+    // Compress without holding the lock, other threads keep taking tiles
+    std::vector<unsigned char> data;
+    encode(bpp, pixels, stride, key.width, key.height, data);
+    if (data.size() > budget / MAX_TILE_BUDGET_SHARE) {
+        return false;
+    }
+    data.shrink_to_fit();
+
+    Mutex::Autolock autolock(lock);
+    auto existing = tiles.find(key);
+    if (existing != tiles.end()) {
+        remove(existing);
+    }
+
+    stats.stores++;
+    stats.tiles++;
+    stats.compressedBytes += (int64_t) data.size();
+    stats.rawBytes += (int64_t) key.width * key.height * bpp;
+    lru.push_front(Tile{key, std::move(data)});
+    tiles[key] = lru.begin();
+
+    while ((size_t) stats.compressedBytes > budget) {
+        remove(tiles.find(lru.back().key));
+        stats.evictions++;
+    }
+    return true;
+}
+
+bool TileCache::take(const Key &key, void *pixels, uint32_t stride) {
+    int bpp = bytesPerPixel(key.format);
+    std::vector<unsigned char> data;
+    {
+        Mutex::Autolock autolock(lock);
+        auto entry = tiles.find(key);
+        if (entry == tiles.end() || bpp == 0) {
+            stats.misses++;
+            return false;
+        }
+        stats.hits++;
+        data = remove(entry);
+    }
+
+    bool decoded = decode(bpp, data.data(), data.size(), pixels, stride, key.width, key.height);
+    if (!decoded) {
+        LOGE("Cached tile of page %d is corrupted", key.page);
+    }
+    return decoded;
+}
+
+std::vector<unsigned char>
+TileCache::remove(std::unordered_map<Key, TileList::iterator, KeyHash>::iterator entry) {
+    Tile &tile = *entry->second;
+    stats.tiles--;
+    stats.compressedBytes -= (int64_t) tile.data.size();
+    stats.rawBytes -= (int64_t) tile.key.width * tile.key.height * bytesPerPixel(tile.key.format);
+    std::vector<unsigned char> data = std::move(tile.data);
+    lru.erase(entry->second);
+    tiles.erase(entry);
+    return data;
+}
+
+void TileCache::clear() {
+    Mutex::Autolock autolock(lock);
+    lru.clear();
+    tiles.clear();
+    stats.tiles = 0;
+    stats.compressedBytes = 0;
+    stats.rawBytes = 0;
+}
+
+TileCache::Stats TileCache::getStats() {
+    Mutex::Autolock autolock(lock);
+    return stats;
+}
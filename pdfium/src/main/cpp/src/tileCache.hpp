@@ -0,0 +1,97 @@
+#ifndef _TILE_CACHE_HPP_
+#define _TILE_CACHE_HPP_
+
+extern "C" {
+#include <stddef.h>
+#include <stdint.h>
+}
+
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include "utils/Mutex.h"
+
+/*
+ * Rendered tiles evicted from the bitmap cache, kept compressed in native memory so they don't have
+ * to be rendered again. Every row is run length encoded and rows equal to the previous one take a
+ * single byte, so tiles of mostly white pages shrink many times. Least recently used tiles are
+ * evicted once the compressed bytes exceed the budget.
+ */
+class TileCache {
+ public:
+  /* Must match TileCacheStats field order */
+  struct Stats {
+      int64_t hits = 0;
+      int64_t misses = 0;
+      int64_t stores = 0;
+      int64_t evictions = 0;
+      int64_t tiles = 0;
+      int64_t compressedBytes = 0;
+      int64_t rawBytes = 0;
+  };
+
+  /*
+   * Part of the page a tile shows and the colors it's rendered in, bounds are float bits so equal
+   * floats match exactly
+   */
+  struct Key {
+      int32_t page;
+      uint32_t left, top, right, bottom;
+      uint32_t width, height;
+      int32_t format;
+      /* Colors of PdfiumCore ColorScheme, all 0 without a scheme */
+      bool hasColorScheme;
+      uint32_t colors[5];
+
+      bool operator==(const Key &other) const;
+  };
+
+  explicit TileCache(size_t budget);
+
+  /* Compress the tile and keep it, replacing a tile with the same key. False if it doesn't fit */
+  bool put(const Key &key, const void *pixels, uint32_t stride);
+
+  /* Decompress the tile and drop it from the cache, false if it's not cached */
+  bool take(const Key &key, void *pixels, uint32_t stride);
+
+  void clear();
+  Stats getStats();
+
+  /*
+   * Compress pixels the way cached tiles are, followed by a checksum, for tiles stored elsewhere.
+   * Appends to out, false if the format isn't supported
+   */
+  static bool compress(int32_t format, uint32_t width, uint32_t height,
+                       const void *pixels, uint32_t stride, std::vector<unsigned char> &out);
+
+  /* Decompress data of compress(), false if it's corrupted or of other size */
+  static bool decompress(int32_t format, uint32_t width, uint32_t height,
+                         const unsigned char *data, size_t size, void *pixels, uint32_t stride);
+
+  /* Bytes per pixel of ANDROID_BITMAP_FORMAT_* formats tiles can have, 0 for others */
+  static int bytesPerPixel(int32_t format);
+
+ private:
+  struct KeyHash {
+      size_t operator()(const Key &key) const;
+  };
+  struct Tile {
+      Key key;
+      std::vector<unsigned char> data;
+  };
+  typedef std::list<Tile> TileList;
+
+  /* Returns the compressed data of the removed tile */
+  std::vector<unsigned char> remove(std::unordered_map<Key, TileList::iterator, KeyHash>::iterator entry);
+
+  size_t budget;
+
+  /* Most recently used tile first */
+  TileList lru;
+  std::unordered_map<Key, TileList::iterator, KeyHash> tiles;
+
+  Stats stats;
+  android::Mutex lock;
+};
+
+#endif
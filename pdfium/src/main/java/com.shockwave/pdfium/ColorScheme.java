@@ -0,0 +1,83 @@
+package com.shockwave.pdfium;
+
+/**
+ * Colors PDFium draws text and paths in while rendering, instead of their own, and the page
+ * background. Images keep their colors. All colors are ARGB.
+ */
+public class ColorScheme {
+
+    /** Light gray on black */
+    public static final ColorScheme NIGHT = new ColorScheme(
+        0xFF000000, 0xFF303030, 0xFFE0E0E0, 0xFFE0E0E0, 0xFFE0E0E0);
+
+    /** Dark brown on paper */
+    public static final ColorScheme SEPIA = new ColorScheme(
+        0xFFF4ECD8, 0xFFD9C8A9, 0xFF5B4636, 0xFF5B4636, 0xFF5B4636);
+
+    /** Black on white, also for text and lines drawn in light colors */
+    public static final ColorScheme HIGH_CONTRAST = new ColorScheme(
+        0xFFFFFFFF, 0xFFC0C0C0, 0xFF000000, 0xFF000000, 0xFF000000);
+
+    private final int background;
+    private final int pathFill;
+    private final int pathStroke;
+    private final int textFill;
+    private final int textStroke;
+
+    public ColorScheme(int background, int pathFill, int pathStroke, int textFill, int textStroke) {
+        this.background = background;
+        this.pathFill = pathFill;
+        this.pathStroke = pathStroke;
+        this.textFill = textFill;
+        this.textStroke = textStroke;
+    }
+
+    public int getBackground() {
+        return background;
+    }
+
+    public int getPathFill() {
+        return pathFill;
+    }
+
+    public int getPathStroke() {
+        return pathStroke;
+    }
+
+    public int getTextFill() {
+        return textFill;
+    }
+
+    public int getTextStroke() {
+        return textStroke;
+    }
+
+    /** Layout native code reads the scheme from */
+    int[] toArray() {
+        return new int[]{background, pathFill, pathStroke, textFill, textStroke};
+    }
+
+    @Override
+    public boolean equals(Object obj) {
+        if (!(obj instanceof ColorScheme)) {
+            return false;
+        }
+
+        ColorScheme scheme = (ColorScheme) obj;
+        return scheme.background == background
+            && scheme.pathFill == pathFill
+            && scheme.pathStroke == pathStroke
+            && scheme.textFill == textFill
+            && scheme.textStroke == textStroke;
+    }
+
+    @Override
+    public int hashCode() {
+        int result = background;
+        result = 31 * result + pathFill;
+        result = 31 * result + pathStroke;
+        result = 31 * result + textFill;
+        result = 31 * result + textStroke;
+        return result;
+    }
+}
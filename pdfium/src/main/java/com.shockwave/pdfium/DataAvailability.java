@@ -0,0 +1,22 @@
+package com.shockwave.pdfium;
+
+/**
+ * Source of availability information for a document that is still being downloaded.
+ *
+ * @see PdfiumCore#newProgressiveDocument(android.os.ParcelFileDescriptor, long, DataAvailability)
+ */
+public interface DataAvailability {
+
+    /**
+     * @return number of bytes from the beginning of the file that are already written
+     */
+    long getAvailableLength();
+
+    /**
+     * Called with byte ranges PDFium needs next, so downloader can prioritize them.
+     * Ranges may overlap and may be partially available already.
+     *
+     * @param ranges pairs of offset and size
+     */
+    void onDataRequested(long[] ranges);
+}
@@ -0,0 +1,495 @@
+package com.shockwave.pdfium;
+
+import android.graphics.RectF;
+import android.util.Log;
+
+import java.io.ByteArrayOutputStream;
+import java.io.DataOutputStream;
+import java.io.File;
+import java.io.FileOutputStream;
+import java.io.IOException;
+import java.io.InterruptedIOException;
+import java.io.RandomAccessFile;
+import java.nio.BufferUnderflowException;
+import java.nio.ByteBuffer;
+import java.nio.channels.FileChannel;
+import java.nio.charset.Charset;
+import java.security.MessageDigest;
+import java.security.NoSuchAlgorithmException;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.Collections;
+import java.util.Comparator;
+import java.util.HashMap;
+import java.util.List;
+import java.util.Map;
+
+/**
+ * Persistent sidecar index of document structure: page geometry, page labels, outline and page links.
+ * Index file is memory mapped and read on demand, so reopening an indexed document doesn't walk it.<br>
+ * Index is keyed by file identifiers from document trailer, file size and modification time, see
+ * {@link #createKey(PdfiumCore, PdfDocument, long)}.
+ */
+public class DocumentIndex {
+
+    private static final String TAG = DocumentIndex.class.getName();
+
+    private static final int MAGIC = 0x50444958; // "PDIX"
+
+    private static final int VERSION = 1;
+
+    private static final int NONE = -1;
+
+    /** Bytes taken by every link record: bounds, destination page and uri */
+    private static final int LINK_SIZE = 4 * 4 + 4 + 4;
+
+    /**
+     * Pages loaded per native call while collecting rotation and crop boxes. Every call holds the lock
+     * of {@link PdfiumCore}, so one page at a time keeps rendering responsive while indexing
+     */
+    private static final int GEOMETRY_BATCH = 1;
+
+    /** Temporary files of writes that never finished are deleted once they're this old */
+    private static final long STALE_TEMP_FILE_MILLIS = 24 * 60 * 60 * 1000;
+
+    private static final Charset UTF_8 = Charset.forName("UTF-8");
+
+    private final ByteBuffer buffer;
+
+    private final int pageCount;
+
+    private final int geometryOffset;
+
+    private final int labelsOffset;
+
+    private final int outlineOffset;
+
+    private final int linkTableOffset;
+
+    private final int linksOffset;
+
+    private final int stringsOffset;
+
+    private DocumentIndex(ByteBuffer buffer) {
+        this.buffer = buffer;
+        pageCount = buffer.getInt();
+        geometryOffset = buffer.getInt();
+        labelsOffset = buffer.getInt();
+        outlineOffset = buffer.getInt();
+        linkTableOffset = buffer.getInt();
+        linksOffset = buffer.getInt();
+        stringsOffset = buffer.getInt();
+        validate(buffer.position());
+    }
+
+    /**
+     * Check every section lies within the file and has the size its content needs, so a truncated or
+     * corrupted index is rejected when opened instead of failing when read
+     *
+     * @throws BufferUnderflowException if the index isn't valid
+     */
+    private void validate(int headerSize) {
+        int limit = buffer.limit();
+        if (pageCount < 0 || pageCount > limit
+                || geometryOffset != headerSize
+                || labelsOffset - geometryOffset != (long) pageCount * PdfiumCore.PAGE_GEOMETRY_STRIDE * 4
+                || outlineOffset - labelsOffset != (long) pageCount * 4
+                || linkTableOffset < outlineOffset
+                || linksOffset - linkTableOffset != ((long) pageCount + 1) * 4
+                || stringsOffset < linksOffset || stringsOffset > limit) {
+            throw new BufferUnderflowException();
+        }
+
+        int stringsLength = limit - stringsOffset;
+        ByteBuffer strings = buffer.duplicate();
+        strings.position(stringsOffset);
+        while (strings.hasRemaining()) {
+            int length = strings.getInt();
+            if (length < 0 || length > strings.remaining()) {
+                throw new BufferUnderflowException();
+            }
+            strings.position(strings.position() + length);
+        }
+
+        for (int i = 0; i < pageCount; i++) {
+            checkStringRef(buffer.getInt(labelsOffset + i * 4), stringsLength);
+        }
+
+        ByteBuffer outline = buffer.duplicate();
+        outline.position(outlineOffset).limit(linkTableOffset);
+        validateOutline(outline, outline.getInt(), stringsLength);
+        if (outline.hasRemaining()) {
+            throw new BufferUnderflowException();
+        }
+
+        int previous = 0;
+        for (int i = 0; i <= pageCount; i++) {
+            int linkIndex = buffer.getInt(linkTableOffset + i * 4);
+            if (linkIndex < previous) {
+                throw new BufferUnderflowException();
+            }
+            previous = linkIndex;
+        }
+        if ((long) previous * LINK_SIZE != stringsOffset - linksOffset) {
+            throw new BufferUnderflowException();
+        }
+        for (int i = 0; i < previous; i++) {
+            checkStringRef(buffer.getInt(linksOffset + i * LINK_SIZE + 20), stringsLength);
+        }
+    }
+
+    private static void validateOutline(ByteBuffer view, int count, int stringsLength) {
+        if (count < 0 || count > view.remaining()) {
+            throw new BufferUnderflowException();
+        }
+        for (int i = 0; i < count; i++) {
+            checkStringRef(view.getInt(), stringsLength);
+            view.getLong();
+            validateOutline(view, view.getInt(), stringsLength);
+        }
+    }
+
+    private static void checkStringRef(int ref, int stringsLength) {
+        if (ref != NONE && (ref < 0 || ref + 4 > stringsLength)) {
+            throw new BufferUnderflowException();
+        }
+    }
+
+    /**
+     * Create key identifying document contents
+     *
+     * @param lastModified modification time of document file, 0 if unknown
+     * @return key or null if document can't be identified reliably
+     */
+    public static byte[] createKey(PdfiumCore core, PdfDocument doc, long lastModified) {
+        byte[] permanentId = core.getFileIdentifier(doc, PdfiumCore.FILE_IDENTIFIER_PERMANENT);
+        byte[] changingId = core.getFileIdentifier(doc, PdfiumCore.FILE_IDENTIFIER_CHANGING);
+        if (permanentId == null && lastModified == 0) {
+            return null;
+        }
+
+        ByteArrayOutputStream key = new ByteArrayOutputStream();
+        DataOutputStream out = new DataOutputStream(key);
+        try {
+            writeBytes(out, permanentId);
+            writeBytes(out, changingId);
+            out.writeLong(core.getDocumentFileSize(doc));
+            out.writeLong(lastModified);
+        } catch (IOException e) {
+            throw new IllegalStateException(e);
+        }
+        return key.toByteArray();
+    }
+
+    /**
+     * File name of index for given key
+     */
+    public static String getFileName(byte[] key) {
+        try {
+            byte[] digest = MessageDigest.getInstance("SHA-1").digest(key);
+            StringBuilder name = new StringBuilder(digest.length * 2 + 4);
+            for (byte b : digest) {
+                name.append(String.format("%02x", b));
+            }
+            return name.append(".idx").toString();
+        } catch (NoSuchAlgorithmException e) {
+            throw new IllegalStateException(e);
+        }
+    }
+
+    /**
+     * Map index file
+     *
+     * @return index or null if file is missing, corrupted or built for other document
+     */
+    public static DocumentIndex open(File file, byte[] key) {
+        if (!file.exists()) {
+            return null;
+        }
+        try {
+            ByteBuffer buffer;
+            RandomAccessFile raf = new RandomAccessFile(file, "r");
+            try {
+                FileChannel channel = raf.getChannel();
+                // Mapping stays valid after the channel is closed
+                buffer = channel.map(FileChannel.MapMode.READ_ONLY, 0, channel.size());
+            } finally {
+                raf.close();
+            }
+
+            if (buffer.getInt() != MAGIC || buffer.getInt() != VERSION) {
+                return null;
+            }
+            byte[] indexKey = new byte[buffer.getInt()];
+            buffer.get(indexKey);
+            if (!Arrays.equals(key, indexKey)) {
+                return null;
+            }
+            DocumentIndex index = new DocumentIndex(buffer);
+            // Recently opened indexes are deleted last, see trim()
+            file.setLastModified(System.currentTimeMillis());
+            return index;
+        } catch (IOException | BufferUnderflowException | IndexOutOfBoundsException
+                | IllegalArgumentException | NegativeArraySizeException e) {
+            Log.e(TAG, "Cannot open document index " + file, e);
+            return null;
+        }
+    }
+
+    /**
+     * Walk the whole document and write its index. Every page is loaded, so this should be called from
+     * a background thread, which can be interrupted to stop writing.
+     */
+    public static void write(File file, byte[] key, PdfiumCore core, PdfDocument doc) throws IOException {
+        int pageCount = core.getPageCount(doc);
+        Map<String, Integer> stringRefs = new HashMap<>();
+        ByteArrayOutputStream strings = new ByteArrayOutputStream();
+        DataOutputStream stringsOut = new DataOutputStream(strings);
+
+        ByteArrayOutputStream body = new ByteArrayOutputStream();
+        DataOutputStream out = new DataOutputStream(body);
+        int headerSize = 4 * 3 + key.length + 4 * 7;
+
+        int geometryOffset = headerSize + out.size();
+        for (int from = 0; from < pageCount; from += GEOMETRY_BATCH) {
+            checkInterrupted();
+            int[] pages = new int[Math.min(GEOMETRY_BATCH, pageCount - from)];
+            for (int i = 0; i < pages.length; i++) {
+                pages[i] = from + i;
+            }
+            for (float value : core.getPagesGeometry(doc, pages, true)) {
+                out.writeFloat(value);
+            }
+        }
+
+        int labelsOffset = headerSize + out.size();
+        for (int i = 0; i < pageCount; i++) {
+            out.writeInt(stringRef(stringsOut, stringRefs, core.getPageLabel(doc, i)));
+        }
+
+        int outlineOffset = headerSize + out.size();
+        List<PdfDocument.Bookmark> outline = core.getTableOfContents(doc);
+        out.writeInt(outline.size());
+        writeOutline(out, stringsOut, stringRefs, outline);
+
+        List<List<PdfDocument.Link>> pageLinks = new ArrayList<>(pageCount);
+        int linkTableOffset = headerSize + out.size();
+        int linkCount = 0;
+        for (int i = 0; i < pageCount; i++) {
+            checkInterrupted();
+            List<PdfDocument.Link> links;
+            try {
+                links = core.loadPageLinks(doc, i);
+            } catch (IllegalStateException e) {
+                links = new ArrayList<>();
+            }
+            pageLinks.add(links);
+            out.writeInt(linkCount);
+            linkCount += links.size();
+        }
+        out.writeInt(linkCount);
+
+        int linksOffset = headerSize + out.size();
+        for (List<PdfDocument.Link> links : pageLinks) {
+            for (PdfDocument.Link link : links) {
+                RectF bounds = link.getBounds();
+                out.writeFloat(bounds.left);
+                out.writeFloat(bounds.top);
+                out.writeFloat(bounds.right);
+                out.writeFloat(bounds.bottom);
+                out.writeInt(link.getDestPageIdx() != null ? link.getDestPageIdx() : NONE);
+                out.writeInt(stringRef(stringsOut, stringRefs, link.getUri()));
+            }
+        }
+
+        int stringsOffset = headerSize + out.size();
+
+        File parent = file.getParentFile();
+        if (parent != null && !parent.exists() && !parent.mkdirs()) {
+            throw new IOException("Cannot create directory " + parent);
+        }
+        // Write to temporary file first, so readers never see a partial index
+        File tempFile = new File(file.getPath() + ".tmp");
+        DataOutputStream fileOut = new DataOutputStream(new FileOutputStream(tempFile));
+        try {
+            fileOut.writeInt(MAGIC);
+            fileOut.writeInt(VERSION);
+            fileOut.writeInt(key.length);
+            fileOut.write(key);
+            fileOut.writeInt(pageCount);
+            fileOut.writeInt(geometryOffset);
+            fileOut.writeInt(labelsOffset);
+            fileOut.writeInt(outlineOffset);
+            fileOut.writeInt(linkTableOffset);
+            fileOut.writeInt(linksOffset);
+            fileOut.writeInt(stringsOffset);
+            body.writeTo(fileOut);
+            strings.writeTo(fileOut);
+        } finally {
+            fileOut.close();
+        }
+        if (!tempFile.renameTo(file)) {
+            tempFile.delete();
+            throw new IOException("Cannot write document index " + file);
+        }
+    }
+
+    /**
+     * Delete least recently opened indexes in the directory until they take at most maxBytes, along
+     * with temporary files of writes that never finished
+     */
+    public static void trim(File dir, long maxBytes) {
+        File[] files = dir.listFiles();
+        if (files == null) {
+            return;
+        }
+        long now = System.currentTimeMillis();
+        List<File> indexes = new ArrayList<>();
+        final Map<File, Long> lastModified = new HashMap<>();
+        long total = 0;
+        for (File file : files) {
+            String name = file.getName();
+            if (name.endsWith(".tmp")) {
+                if (now - file.lastModified() > STALE_TEMP_FILE_MILLIS) {
+                    file.delete();
+                }
+            } else if (name.endsWith(".idx")) {
+                indexes.add(file);
+                // Read once, sorting must not see it change
+                lastModified.put(file, file.lastModified());
+                total += file.length();
+            }
+        }
+        if (total <= maxBytes) {
+            return;
+        }
+
+        Collections.sort(indexes, new Comparator<File>() {
+            @Override
+            public int compare(File a, File b) {
+                return lastModified.get(a).compareTo(lastModified.get(b));
+            }
+        });
+        for (File file : indexes) {
+            if (total <= maxBytes) {
+                break;
+            }
+            long length = file.length();
+            if (file.delete()) {
+                total -= length;
+            }
+        }
+    }
+
+    public int getPageCount() {
+        return pageCount;
+    }
+
+    /**
+     * Get geometry of all pages, laid out as {@link PdfiumCore#getPagesGeometry(PdfDocument, int[], boolean)}
+     */
+    public float[] getPagesGeometry() {
+        float[] geometry = new float[pageCount * PdfiumCore.PAGE_GEOMETRY_STRIDE];
+        ByteBuffer view = buffer.duplicate();
+        view.position(geometryOffset);
+        view.asFloatBuffer().get(geometry);
+        return geometry;
+    }
+
+    /**
+     * Get label of page, null if page has no label
+     */
+    public String getPageLabel(int pageIndex) {
+        if (pageIndex < 0 || pageIndex >= pageCount) {
+            return null;
+        }
+        return readString(buffer.getInt(labelsOffset + pageIndex * 4));
+    }
+
+    public List<PdfDocument.Bookmark> getTableOfContents() {
+        List<PdfDocument.Bookmark> topLevel = new ArrayList<>();
+        ByteBuffer view = buffer.duplicate();
+        view.position(outlineOffset);
+        readOutline(view, topLevel, view.getInt());
+        return topLevel;
+    }
+
+    public List<PdfDocument.Link> getPageLinks(int pageIndex) {
+        List<PdfDocument.Link> links = new ArrayList<>();
+        if (pageIndex < 0 || pageIndex >= pageCount) {
+            return links;
+        }
+        int from = buffer.getInt(linkTableOffset + pageIndex * 4);
+        int to = buffer.getInt(linkTableOffset + (pageIndex + 1) * 4);
+        for (int i = from; i < to; i++) {
+            int offset = linksOffset + i * LINK_SIZE;
+            RectF bounds = new RectF(buffer.getFloat(offset), buffer.getFloat(offset + 4),
+                    buffer.getFloat(offset + 8), buffer.getFloat(offset + 12));
+            int destPage = buffer.getInt(offset + 16);
+            String uri = readString(buffer.getInt(offset + 20));
+            links.add(new PdfDocument.Link(bounds, destPage != NONE ? destPage : null, uri));
+        }
+        return links;
+    }
+
+    private void readOutline(ByteBuffer view, List<PdfDocument.Bookmark> tree, int count) {
+        for (int i = 0; i < count; i++) {
+            PdfDocument.Bookmark bookmark = new PdfDocument.Bookmark();
+            bookmark.title = readString(view.getInt());
+            bookmark.pageIdx = view.getLong();
+            tree.add(bookmark);
+            readOutline(view, bookmark.getChildren(), view.getInt());
+        }
+    }
+
+    private String readString(int ref) {
+        if (ref == NONE) {
+            return null;
+        }
+        ByteBuffer view = buffer.duplicate();
+        view.position(stringsOffset + ref);
+        byte[] bytes = new byte[view.getInt()];
+        view.get(bytes);
+        return new String(bytes, UTF_8);
+    }
+
+    private static void writeOutline(DataOutputStream out, DataOutputStream stringsOut,
+                                     Map<String, Integer> stringRefs, List<PdfDocument.Bookmark> tree)
+            throws IOException {
+        for (PdfDocument.Bookmark bookmark : tree) {
+            out.writeInt(stringRef(stringsOut, stringRefs, bookmark.getTitle()));
+            out.writeLong(bookmark.getPageIdx());
+            out.writeInt(bookmark.getChildren().size());
+            writeOutline(out, stringsOut, stringRefs, bookmark.getChildren());
+        }
+    }
+
+    private static int stringRef(DataOutputStream stringsOut, Map<String, Integer> stringRefs, String value)
+            throws IOException {
+        if (value == null) {
+            return NONE;
+        }
+        Integer ref = stringRefs.get(value);
+        if (ref == null) {
+            ref = stringsOut.size();
+            writeBytes(stringsOut, value.getBytes(UTF_8));
+            stringRefs.put(value, ref);
+        }
+        return ref;
+    }
+
+    private static void writeBytes(DataOutputStream out, byte[] bytes) throws IOException {
+        if (bytes == null) {
+            out.writeInt(0);
+            return;
+        }
+        out.writeInt(bytes.length);
+        out.write(bytes);
+    }
+
+    private static void checkInterrupted() throws InterruptedIOException {
+        if (Thread.interrupted()) {
+            throw new InterruptedIOException("Document indexing interrupted");
+        }
+    }
+}
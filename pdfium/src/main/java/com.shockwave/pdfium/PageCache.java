@@ -0,0 +1,119 @@
+package com.shockwave.pdfium;
+
+import android.util.SparseBooleanArray;
+
+import java.util.ArrayList;
+import java.util.Collections;
+import java.util.Iterator;
+import java.util.LinkedHashMap;
+import java.util.List;
+
+/**
+ * Native handles of opened pages of a document. Loaded pages keep their parsed content and decoded
+ * images, so least recently used pages over the budget are closed, unless pinned by a render in
+ * progress, and loaded again the next time they are used.<br>
+ * Guarded by the lock of {@link PdfiumCore} serializing native calls.
+ */
+class PageCache {
+
+    private static class Page {
+        final long pagePtr;
+        final long bytes;
+        int pins;
+
+        Page(long pagePtr, long bytes) {
+            this.pagePtr = pagePtr;
+            this.bytes = bytes;
+        }
+    }
+
+    /** Loaded pages, least recently used first */
+    private final LinkedHashMap<Integer, Page> pages = new LinkedHashMap<>(16, 0.75f, true);
+
+    /** Pages opened by the caller, loaded again on access after being closed */
+    private final SparseBooleanArray openedPages = new SparseBooleanArray();
+
+    private int maxPages = PdfiumCore.DEFAULT_MAX_LOADED_PAGES;
+    private long maxBytes = PdfiumCore.DEFAULT_MAX_LOADED_PAGE_BYTES;
+    private long usedBytes;
+
+    /** Handle of loaded page, null if it's not loaded */
+    Long get(int pageIndex) {
+        Page page = pages.get(pageIndex);
+        return page != null ? page.pagePtr : null;
+    }
+
+    /** True if the page was opened, it may have to be loaded again */
+    boolean isOpened(int pageIndex) {
+        return openedPages.get(pageIndex);
+    }
+
+    /** Add a loaded page as the most recently used one */
+    void put(int pageIndex, long pagePtr, long bytes) {
+        pages.put(pageIndex, new Page(pagePtr, bytes));
+        openedPages.put(pageIndex, true);
+        usedBytes += bytes;
+    }
+
+    /** Keep the loaded page while its handle is used without holding the lock */
+    void pin(int pageIndex) {
+        Page page = pages.get(pageIndex);
+        if (page != null) {
+            page.pins++;
+        }
+    }
+
+    void unpin(int pageIndex) {
+        Page page = pages.get(pageIndex);
+        if (page != null && page.pins > 0) {
+            page.pins--;
+        }
+    }
+
+    void setBudget(int maxPages, long maxBytes) {
+        this.maxPages = maxPages;
+        this.maxBytes = maxBytes;
+    }
+
+    /**
+     * Remove least recently used pages over the budget, the most recently used page is always kept
+     *
+     * @return handles of removed pages, caller closes them
+     */
+    List<Long> trim() {
+        if (pages.size() <= maxPages && usedBytes <= maxBytes) {
+            return Collections.emptyList();
+        }
+
+        List<Long> removed = new ArrayList<>();
+        int remaining = pages.size();
+        Iterator<Page> iterator = pages.values().iterator();
+        while ((pages.size() > maxPages || usedBytes > maxBytes) && remaining > 1) {
+            Page page = iterator.next();
+            remaining--;
+            if (page.pins > 0) {
+                continue;
+            }
+            iterator.remove();
+            usedBytes -= page.bytes;
+            removed.add(page.pagePtr);
+        }
+        return removed;
+    }
+
+    /**
+     * Forget all pages
+     *
+     * @return handles of loaded pages, caller closes them
+     */
+    List<Long> clear() {
+        List<Long> removed = new ArrayList<>(pages.size());
+        for (Page page : pages.values()) {
+            removed.add(page.pagePtr);
+        }
+        pages.clear();
+        openedPages.clear();
+        usedBytes = 0;
+        return removed;
+    }
+}
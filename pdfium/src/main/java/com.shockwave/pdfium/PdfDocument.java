@@ -3,10 +3,9 @@ package com.shockwave.pdfium;
 import android.graphics.RectF;
 import android.os.ParcelFileDescriptor;
 
-import android.util.ArrayMap;
 import java.util.ArrayList;
 import java.util.List;
-import java.util.Map;
+import java.util.concurrent.locks.ReentrantLock;
 
 public class PdfDocument {
 
@@ -100,15 +99,98 @@ public class PdfDocument {
         }
     }
 
+    public static class BlockCacheStats {
+        long hits;
+        long misses;
+        long readAheadBlocks;
+        long bytesRead;
+        long evictions;
+        long cachedBytes;
+
+        public long getHits() {
+            return hits;
+        }
+
+        public long getMisses() {
+            return misses;
+        }
+
+        /** Blocks read speculatively after a sequential run of misses */
+        public long getReadAheadBlocks() {
+            return readAheadBlocks;
+        }
+
+        /** Bytes read from file descriptor */
+        public long getBytesRead() {
+            return bytesRead;
+        }
+
+        public long getEvictions() {
+            return evictions;
+        }
+
+        public long getCachedBytes() {
+            return cachedBytes;
+        }
+    }
+
+    /** Estimate of how costly a page is to render */
+    public static class PageComplexity {
+        long objectCount;
+        long imageCount;
+        boolean transparency;
+        boolean color;
+        long annotationCount;
+
+        /** Page objects, objects of form XObjects counted one by one */
+        public long getObjectCount() {
+            return objectCount;
+        }
+
+        public long getImageCount() {
+            return imageCount;
+        }
+
+        /** Whether page needs blending, which makes every object behind transparent ones costlier */
+        public boolean hasTransparency() {
+            return transparency;
+        }
+
+        /**
+         * Whether anything on the page may be in color. False only if all objects are in shades of
+         * gray, annotations not included
+         */
+        public boolean hasColor() {
+            return color;
+        }
+
+        public long getAnnotationCount() {
+            return annotationCount;
+        }
+    }
+
     /*package*/ PdfDocument() {
     }
 
     /*package*/ long mNativeDocPtr;
     /*package*/ ParcelFileDescriptor parcelFileDescriptor;
+    /*package*/ DataAvailability dataAvailability;
 
-    /*package*/ final Map<Integer, Long> mNativePagesPtr = new ArrayMap<>();
+    /*package*/ final PageCache pageCache = new PageCache();
 
+    /**
+     * Held for the whole render of a page, sliced renders keep their progress in the page and
+     * release the native lock between slices
+     */
+    /*package*/ final ReentrantLock renderLock = new ReentrantLock();
+
+    /** True if page was opened, it's loaded again when used after being closed to stay in budget */
     public boolean hasPage(int index) {
-        return mNativePagesPtr.containsKey(index);
+        return pageCache.isOpened(index);
+    }
+
+    /** True if document was opened from a partially downloaded file */
+    public boolean isProgressive() {
+        return dataAvailability != null;
     }
 }
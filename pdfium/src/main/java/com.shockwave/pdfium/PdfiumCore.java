@@ -4,6 +4,7 @@ import android.content.Context;
 import android.graphics.Bitmap;
 import android.graphics.Point;
 import android.graphics.RectF;
+import android.os.CancellationSignal;
 import android.os.ParcelFileDescriptor;
 import android.util.Log;
 import android.view.Surface;
@@ -11,8 +12,12 @@ import com.shockwave.pdfium.util.Size;
 import java.io.FileDescriptor;
 import java.io.IOException;
 import java.lang.reflect.Field;
+import java.nio.ByteBuffer;
 import java.util.ArrayList;
+import java.util.HashSet;
 import java.util.List;
+import java.util.Set;
+import java.util.concurrent.locks.ReentrantLock;
 
 public class PdfiumCore {
 
@@ -22,6 +27,122 @@ public class PdfiumCore {
 
     private static final String FD_FIELD_NAME = "descriptor";
 
+    /** Read file blocks on demand with pread (default, works with any file descriptor) */
+    public static final int OPEN_MODE_PREAD = 0;
+
+    /**
+     * Map the whole file into memory and serve reads from the mapping, hinting random access.
+     * Falls back to {@link #OPEN_MODE_PREAD} if the descriptor can't be mapped.<br>
+     * Only for files nothing else writes while the document is open: reading a mapped page of a
+     * file truncated or rewritten in place raises SIGBUS and kills the process, where pread would
+     * only fail the read
+     */
+    public static final int OPEN_MODE_MMAP = 1;
+
+    /** Same as {@link #OPEN_MODE_MMAP}, but hints the kernel that the file will be read sequentially */
+    public static final int OPEN_MODE_MMAP_SEQUENTIAL = 2;
+
+    /**
+     * Read file blocks with pread through a per-document block cache with adaptive read-ahead.
+     * Meant for slow descriptors, like content providers backed by FUSE or network storage.
+     *
+     * @see #setBlockCacheConfig(int, long)
+     */
+    public static final int OPEN_MODE_CACHED = 3;
+
+    public static final int DEFAULT_CACHE_BLOCK_SIZE = 64 * 1024;
+
+    public static final long DEFAULT_CACHE_BUDGET = 4 * 1024 * 1024;
+
+    /** Pages of a document kept loaded, least recently used ones are closed and loaded again when used */
+    public static final int DEFAULT_MAX_LOADED_PAGES = 32;
+
+    /** Estimated memory loaded pages of a document may take, decoded images included */
+    public static final long DEFAULT_MAX_LOADED_PAGE_BYTES = 64 * 1024 * 1024;
+
+    /** Linearization can't be determined yet, less than 1 KB of the file is available */
+    public static final int LINEARIZATION_UNKNOWN = -1;
+
+    public static final int NOT_LINEARIZED = 0;
+
+    public static final int LINEARIZED = 1;
+
+    /**
+     * Layout of {@link #getPagesGeometry(PdfDocument, int[], boolean)} result, every page takes
+     * {@link #PAGE_GEOMETRY_STRIDE} floats. Sizes and boxes are in points, rotation in degrees
+     */
+    public static final int PAGE_GEOMETRY_WIDTH = 0;
+
+    public static final int PAGE_GEOMETRY_HEIGHT = 1;
+
+    public static final int PAGE_GEOMETRY_ROTATION = 2;
+
+    public static final int PAGE_GEOMETRY_CROP_LEFT = 3;
+
+    public static final int PAGE_GEOMETRY_CROP_BOTTOM = 4;
+
+    public static final int PAGE_GEOMETRY_CROP_RIGHT = 5;
+
+    public static final int PAGE_GEOMETRY_CROP_TOP = 6;
+
+    public static final int PAGE_GEOMETRY_STRIDE = 7;
+
+    /** Render annotations and form fields */
+    public static final int RENDER_FLAG_ANNOT = 0x01;
+
+    /** Don't keep decoded images in memory after the render */
+    public static final int RENDER_FLAG_LIMITED_IMAGE_CACHE = 0x200;
+
+    /** Render text without anti-aliasing */
+    public static final int RENDER_FLAG_NO_SMOOTH_TEXT = 0x1000;
+
+    /** Scale images without smoothing */
+    public static final int RENDER_FLAG_NO_SMOOTH_IMAGE = 0x2000;
+
+    /** Render paths without anti-aliasing */
+    public static final int RENDER_FLAG_NO_SMOOTH_PATH = 0x4000;
+
+    /**
+     * Draw outlines of filled paths in the stroke color of the {@link ColorScheme}, so shapes filled
+     * with a single color stay apart. Only used with a color scheme
+     */
+    public static final int RENDER_FLAG_CONVERT_FILL_TO_STROKE = 0x20;
+
+    /** Several times faster render in lower quality, for content that is moving anyway */
+    public static final int RENDER_FLAGS_DRAFT = RENDER_FLAG_NO_SMOOTH_TEXT | RENDER_FLAG_NO_SMOOTH_IMAGE
+        | RENDER_FLAG_NO_SMOOTH_PATH | RENDER_FLAG_LIMITED_IMAGE_CACHE;
+
+    /** Default time a sliced render may hold the native lock before letting other calls in */
+    public static final int DEFAULT_RENDER_SLICE_MILLIS = 10;
+
+    /** Thumbnail could not be drawn, or the render was cancelled */
+    public static final int THUMBNAIL_FAILED = 0;
+
+    /** Thumbnail image embedded in the page was scaled to the bitmap */
+    public static final int THUMBNAIL_EMBEDDED = 1;
+
+    /** Page was rendered at the bitmap size */
+    public static final int THUMBNAIL_RENDERED = 2;
+
+    /** Embedded thumbnails smaller than this fraction of the bitmap size are too blurry */
+    public static final float DEFAULT_MIN_EMBEDDED_THUMBNAIL_SCALE = 0.5f;
+
+    /** Minimum embedded thumbnail scale that always renders the page, without decoding the embedded image */
+    public static final float NO_EMBEDDED_THUMBNAIL = Float.POSITIVE_INFINITY;
+
+    /* Must match FPDF_RENDER_* of fpdf_progressive.h */
+    private static final int RENDER_TO_BE_CONTINUED = 1;
+    private static final int RENDER_DONE = 2;
+
+    /* Batched fragments are rendered one by one when an atlas would be this many times larger */
+    private static final int MAX_ATLAS_OVERDRAW = 2;
+
+    /** Identifier assigned when the file was created, see section 14.4 of ISO 32000-1 */
+    public static final int FILE_IDENTIFIER_PERMANENT = 0;
+
+    /** Identifier updated every time the file is saved */
+    public static final int FILE_IDENTIFIER_CHANGING = 1;
+
     static {
         try {
             System.loadLibrary("pdfium");
@@ -31,12 +152,54 @@ public class PdfiumCore {
         }
     }
 
-    private native long nativeOpenDocument(int fd, String password);
+    private native long nativeOpenDocument(int fd, String password, int openMode, int cacheBlockSize, long cacheBudget);
 
     private native long nativeOpenMemDocument(byte[] data, String password);
 
+    private native long nativeOpenDirectBufferDocument(ByteBuffer buffer, int offset, int length, String password);
+
     private native void nativeCloseDocument(long docPtr);
 
+    private native long[] nativeGetBlockCacheStats(long docPtr);
+
+    private native long[] nativeGetScratchArenaStats();
+
+    private native void nativeTrimMemory();
+
+    private native long nativeOpenTileCache(long budget);
+
+    private native void nativeCloseTileCache(long cachePtr);
+
+    private native void nativeClearTileCache(long cachePtr);
+
+    private native boolean nativePutTile(long cachePtr, int pageIndex,
+                                         float left, float top, float right, float bottom,
+                                         int[] colorScheme, Bitmap bitmap);
+
+    private native boolean nativeTakeTile(long cachePtr, int pageIndex,
+                                          float left, float top, float right, float bottom,
+                                          int[] colorScheme, Bitmap bitmap);
+
+    private native long[] nativeGetTileCacheStats(long cachePtr);
+
+    private native byte[] nativeCompressTile(Bitmap bitmap);
+
+    private native boolean nativeDecompressTile(ByteBuffer data, int offset, int length, Bitmap bitmap);
+
+    private native long nativeOpenProgressiveDocument(int fd, long fileLength);
+
+    private native void nativeAddAvailableRange(long docPtr, long offset, long size);
+
+    private native long[] nativeTakeRequestedRanges(long docPtr);
+
+    private native boolean nativeIsDocumentAvailable(long docPtr, String password);
+
+    private native boolean nativeIsPageAvailable(long docPtr, int pageIndex);
+
+    private native int nativeGetFirstAvailablePage(long docPtr);
+
+    private native int nativeIsLinearized(long docPtr);
+
     private native int nativeGetPageCount(long docPtr);
 
     private native long nativeLoadPage(long docPtr, int pageIndex);
@@ -55,22 +218,53 @@ public class PdfiumCore {
 
     private native int nativeGetPageHeightPoint(long pagePtr);
 
+    private native long[] nativeGetPageComplexity(long pagePtr);
+
+    private native long nativeEstimatePageBytes(long pagePtr);
+
     //private native long nativeGetNativeWindow(Surface surface);
     //private native void nativeRenderPage(long pagePtr, long nativeWindowPtr);
     private native void nativeRenderPage(
         long pagePtr, Surface surface, int dpi,
         int startX, int startY,
         int drawSizeHor, int drawSizeVer,
-        boolean renderAnnot);
+        int renderFlags);
 
     private native void nativeRenderPageBitmap(
         long pagePtr, Bitmap bitmap, int dpi,
         int startX, int startY,
         int drawSizeHor, int drawSizeVer,
-        boolean renderAnnot);
+        int renderFlags);
+
+    private native long nativeOpenRender(
+        long pagePtr,
+        int startX, int startY,
+        int drawSizeHor, int drawSizeVer,
+        int renderFlags, int[] colorScheme);
+
+    private native long nativeOpenAtlasRender(
+        long pagePtr, int[] tiles,
+        int drawSizeHor, int drawSizeVer,
+        int renderFlags, int[] colorScheme, Bitmap formatBitmap);
+
+    private native int nativeContinueRender(long renderPtr, Bitmap bitmap, int budgetMillis);
+
+    private native boolean nativeCopyAtlasTiles(long renderPtr, Bitmap[] bitmaps, int[] tiles);
+
+    private native void nativeCloseRender(long renderPtr);
+
+    private native boolean nativeRenderEmbeddedThumbnail(long pagePtr, Bitmap bitmap, float minScale);
+
+    private native void nativeSetRgb565Dithering(boolean dithering);
 
     private native String nativeGetDocumentMetaText(long docPtr, String tag);
 
+    private native byte[] nativeGetFileIdentifier(long docPtr, int idType);
+
+    private native long nativeGetFileSize(long docPtr);
+
+    private native String nativeGetPageLabel(long docPtr, int pageIndex);
+
     private native Long nativeGetFirstChildBookmark(long docPtr, Long bookmarkPtr);
 
     private native Long nativeGetSiblingBookmark(long docPtr, long bookmarkPtr);
@@ -81,6 +275,8 @@ public class PdfiumCore {
 
     private native Size nativeGetPageSizeByIndex(long docPtr, int pageIndex, int dpi);
 
+    private native float[] nativeGetPagesGeometry(long docPtr, int[] pageIndices, boolean includePageBoxes);
+
     private native long[] nativeGetPageLinks(long pagePtr);
 
     private native Integer nativeGetDestPageIndex(long docPtr, long linkPtr);
@@ -115,13 +311,20 @@ public class PdfiumCore {
 
     private native RectF nativeTextGetRect(long textPagePtr, int rect_index);
 
-    /* synchronize native methods */
-    private static final Object lock = new Object();
+    /**
+     * PDFium keeps process wide state, so native calls are serialized for all documents. Lock is fair,
+     * so callers working on different documents take turns instead of one of them barging repeatedly
+     */
+    private static final ReentrantLock lock = new ReentrantLock(true);
 
     private static Field mFdField = null;
 
     private int mCurrentDpi;
 
+    private int mCacheBlockSize = DEFAULT_CACHE_BLOCK_SIZE;
+
+    private long mCacheBudget = DEFAULT_CACHE_BUDGET;
+
     public static int getNumFd(ParcelFileDescriptor fdObj) {
         try {
             if (mFdField == null) {
@@ -157,15 +360,318 @@ public class PdfiumCore {
      * Create new document from file with password
      */
     public PdfDocument newDocument(ParcelFileDescriptor fd, String password) throws IOException {
+        return newDocument(fd, password, OPEN_MODE_PREAD);
+    }
+
+    /**
+     * Create new document from file with password, choosing how file data is read.
+     * File descriptor must stay unchanged while document is open when using mmap modes.
+     *
+     * @param openMode one of {@link #OPEN_MODE_PREAD}, {@link #OPEN_MODE_MMAP}, {@link #OPEN_MODE_MMAP_SEQUENTIAL},
+     *                 {@link #OPEN_MODE_CACHED}
+     */
+    public PdfDocument newDocument(ParcelFileDescriptor fd, String password, int openMode) throws IOException {
         PdfDocument document = new PdfDocument();
         document.parcelFileDescriptor = fd;
-        synchronized (lock) {
-            document.mNativeDocPtr = nativeOpenDocument(getNumFd(fd), password);
+        lock.lock();
+        try {
+            document.mNativeDocPtr = nativeOpenDocument(getNumFd(fd), password, openMode,
+                mCacheBlockSize, mCacheBudget);
+        } finally {
+            lock.unlock();
+        }
+
+        return document;
+    }
+
+    /**
+     * Configure block cache used by documents opened afterwards with {@link #OPEN_MODE_CACHED}
+     *
+     * @param blockSize size of a single cached block in bytes
+     * @param budget    maximum number of cached bytes per document
+     */
+    public void setBlockCacheConfig(int blockSize, long budget) {
+        if (blockSize <= 0 || budget < blockSize) {
+            throw new IllegalArgumentException("Block size must be positive and not bigger than budget");
+        }
+        mCacheBlockSize = blockSize;
+        mCacheBudget = budget;
+    }
+
+    /**
+     * Get block cache counters for document opened with {@link #OPEN_MODE_CACHED}
+     *
+     * @return counters or null if document doesn't use block cache
+     */
+    public PdfDocument.BlockCacheStats getBlockCacheStats(PdfDocument doc) {
+        long[] values;
+        lock.lock();
+        try {
+            values = nativeGetBlockCacheStats(doc.mNativeDocPtr);
+        } finally {
+            lock.unlock();
+        }
+        if (values == null) {
+            return null;
         }
+        PdfDocument.BlockCacheStats stats = new PdfDocument.BlockCacheStats();
+        stats.hits = values[0];
+        stats.misses = values[1];
+        stats.readAheadBlocks = values[2];
+        stats.bytesRead = values[3];
+        stats.evictions = values[4];
+        stats.cachedBytes = values[5];
+        return stats;
+    }
+
+    /**
+     * Get usage of scratch memory native code uses for temporary buffers
+     */
+    public ScratchArenaStats getScratchArenaStats() {
+        long[] values = nativeGetScratchArenaStats();
+        ScratchArenaStats stats = new ScratchArenaStats();
+        stats.allocations = values[0];
+        stats.allocatedBytes = values[1];
+        stats.growths = values[2];
+        stats.trims = values[3];
+        stats.reservedBytes = values[4];
+        stats.peakReservedBytes = values[5];
+        return stats;
+    }
+
+    /**
+     * Create a cache keeping rendered tiles compressed in native memory, off the Java heap. Rows are
+     * run length encoded and repeated rows take a byte, so tiles of mostly white pages take a small
+     * fraction of their bitmap. Least recently used tiles are dropped once compressed tiles exceed
+     * the budget.<br> Doesn't depend on any document, close it with {@link #closeTileCache(TileCache)}.
+     *
+     * @param budget bytes compressed tiles may take
+     */
+    public TileCache newTileCache(long budget) {
+        if (budget <= 0) {
+            throw new IllegalArgumentException("Tile cache budget must be positive");
+        }
+        TileCache cache = new TileCache();
+        cache.mNativePtr = nativeOpenTileCache(budget);
+        return cache;
+    }
+
+    /**
+     * Compress the tile and keep it, replacing the tile of the same page, bounds, colors and bitmap
+     * size and configuration. Bitmap must be ARGB_8888, RGB_565 or ALPHA_8.
+     *
+     * @param bounds      part of the page the tile shows, identifies the tile with the colors and
+     *                    bitmap size and configuration
+     * @param colorScheme colors the tile was rendered in, null for the page colors
+     * @return false if the tile couldn't be stored
+     */
+    public boolean putTile(TileCache cache, int pageIndex, RectF bounds, ColorScheme colorScheme, Bitmap bitmap) {
+        synchronized (cache) {
+            if (cache.mNativePtr == 0) {
+                return false;
+            }
+            return nativePutTile(cache.mNativePtr, pageIndex,
+                bounds.left, bounds.top, bounds.right, bounds.bottom,
+                colorScheme != null ? colorScheme.toArray() : null, bitmap);
+        }
+    }
+
+    /**
+     * Decompress the tile into the bitmap and drop it from the cache. Bitmap must have the size and
+     * configuration the tile was stored with
+     *
+     * @return false if the tile isn't cached
+     * @see #putTile(TileCache, int, RectF, ColorScheme, Bitmap)
+     */
+    public boolean takeTile(TileCache cache, int pageIndex, RectF bounds, ColorScheme colorScheme, Bitmap bitmap) {
+        synchronized (cache) {
+            if (cache.mNativePtr == 0) {
+                return false;
+            }
+            return nativeTakeTile(cache.mNativePtr, pageIndex,
+                bounds.left, bounds.top, bounds.right, bounds.bottom,
+                colorScheme != null ? colorScheme.toArray() : null, bitmap);
+        }
+    }
+
+    /**
+     * Drop all tiles, e.g. when pages are rendered differently from now on
+     */
+    public void clearTileCache(TileCache cache) {
+        synchronized (cache) {
+            if (cache.mNativePtr != 0) {
+                nativeClearTileCache(cache.mNativePtr);
+            }
+        }
+    }
+
+    /**
+     * Get hit rate, compression ratio and memory of the tile cache
+     */
+    public TileCacheStats getTileCacheStats(TileCache cache) {
+        TileCacheStats stats = new TileCacheStats();
+        long[] values;
+        synchronized (cache) {
+            if (cache.mNativePtr == 0) {
+                return stats;
+            }
+            values = nativeGetTileCacheStats(cache.mNativePtr);
+        }
+        stats.hits = values[0];
+        stats.misses = values[1];
+        stats.stores = values[2];
+        stats.evictions = values[3];
+        stats.tiles = values[4];
+        stats.compressedBytes = values[5];
+        stats.rawBytes = values[6];
+        return stats;
+    }
+
+    /**
+     * Release native memory of the tile cache, it can't be used afterwards
+     */
+    public void closeTileCache(TileCache cache) {
+        synchronized (cache) {
+            if (cache.mNativePtr != 0) {
+                nativeCloseTileCache(cache.mNativePtr);
+                cache.mNativePtr = 0;
+            }
+        }
+    }
+
+    /**
+     * Compress the tile the way tile caches do, followed by a checksum, to store it elsewhere, e.g.
+     * on disk. Bitmap must be ARGB_8888, RGB_565 or ALPHA_8. Doesn't depend on any document.
+     *
+     * @return compressed tile, null if it couldn't be compressed
+     * @see #decompressTile(ByteBuffer, Bitmap)
+     */
+    public byte[] compressTile(Bitmap bitmap) {
+        return nativeCompressTile(bitmap);
+    }
+
+    /**
+     * Decompress a tile of {@link #compressTile(Bitmap)} into the bitmap, which must have the size and
+     * configuration the tile was compressed from
+     *
+     * @param data direct buffer, e.g. a mapped file, holding the tile from its position to its limit
+     * @return false if the data is corrupted, e.g. by a write that didn't complete
+     */
+    public boolean decompressTile(ByteBuffer data, Bitmap bitmap) {
+        if (!data.isDirect()) {
+            throw new IllegalArgumentException("Tile data must be in a direct buffer");
+        }
+        return nativeDecompressTile(data, data.position(), data.remaining(), bitmap);
+    }
 
+    /**
+     * Create new document from file that is still being written, e.g. by a downloader.<br>
+     * Returned document can't be used until {@link #isDocumentAvailable(PdfDocument, String)} returns true.
+     * Pages should be checked with {@link #isPageAvailable(PdfDocument, int)} before opening. For linearized
+     * files, first page becomes available long before download finishes.
+     *
+     * @param fileLength   final length of the file
+     * @param availability tells which part of the file is already written and receives download hints
+     */
+    public PdfDocument newProgressiveDocument(
+        ParcelFileDescriptor fd, long fileLength, DataAvailability availability) throws IOException {
+        PdfDocument document = new PdfDocument();
+        document.parcelFileDescriptor = fd;
+        document.dataAvailability = availability;
+        lock.lock();
+        try {
+            document.mNativeDocPtr = nativeOpenProgressiveDocument(getNumFd(fd), fileLength);
+        } finally {
+            lock.unlock();
+        }
         return document;
     }
 
+    /**
+     * Report byte range of progressive document as available, for downloaders that fetch ranges out of order
+     */
+    public void addAvailableRange(PdfDocument doc, long offset, long size) {
+        nativeAddAvailableRange(doc.mNativeDocPtr, offset, size);
+    }
+
+    /**
+     * Check if progressive document has enough data to be loaded and load it if so.
+     * Always true for documents opened completely.
+     *
+     * @throws IOException if document is corrupted or password is incorrect
+     */
+    public boolean isDocumentAvailable(PdfDocument doc, String password) throws IOException {
+        syncAvailability(doc);
+        boolean available;
+        lock.lock();
+        try {
+            available = nativeIsDocumentAvailable(doc.mNativeDocPtr, password);
+        } finally {
+            lock.unlock();
+        }
+        dispatchRequestedRanges(doc);
+        return available;
+    }
+
+    /**
+     * Check if page of progressive document can be opened. Always true for documents opened completely.
+     */
+    public boolean isPageAvailable(PdfDocument doc, int pageIndex) {
+        if (doc.dataAvailability == null) {
+            return true;
+        }
+        syncAvailability(doc);
+        boolean available;
+        lock.lock();
+        try {
+            available = nativeIsPageAvailable(doc.mNativeDocPtr, pageIndex);
+        } finally {
+            lock.unlock();
+        }
+        dispatchRequestedRanges(doc);
+        return available;
+    }
+
+    /**
+     * Get index of first page available in linearized document, usually 0
+     */
+    public int getFirstAvailablePage(PdfDocument doc) {
+        lock.lock();
+        try {
+            return nativeGetFirstAvailablePage(doc.mNativeDocPtr);
+        } finally {
+            lock.unlock();
+        }
+    }
+
+    /**
+     * @return one of {@link #LINEARIZED}, {@link #NOT_LINEARIZED}, {@link #LINEARIZATION_UNKNOWN}
+     */
+    public int isLinearized(PdfDocument doc) {
+        lock.lock();
+        try {
+            return nativeIsLinearized(doc.mNativeDocPtr);
+        } finally {
+            lock.unlock();
+        }
+    }
+
+    private void syncAvailability(PdfDocument doc) {
+        if (doc.dataAvailability != null) {
+            nativeAddAvailableRange(doc.mNativeDocPtr, 0, doc.dataAvailability.getAvailableLength());
+        }
+    }
+
+    private void dispatchRequestedRanges(PdfDocument doc) {
+        if (doc.dataAvailability == null) {
+            return;
+        }
+        long[] ranges = nativeTakeRequestedRanges(doc.mNativeDocPtr);
+        if (ranges != null && ranges.length > 0) {
+            doc.dataAvailability.onDataRequested(ranges);
+        }
+    }
+
     /**
      * Create new document from bytearray
      */
@@ -178,8 +684,37 @@ public class PdfiumCore {
      */
     public PdfDocument newDocument(byte[] data, String password) throws IOException {
         PdfDocument document = new PdfDocument();
-        synchronized (lock) {
+        lock.lock();
+        try {
             document.mNativeDocPtr = nativeOpenMemDocument(data, password);
+        } finally {
+            lock.unlock();
+        }
+        return document;
+    }
+
+    /**
+     * Create new document from direct {@link ByteBuffer}
+     */
+    public PdfDocument newDocument(ByteBuffer data) throws IOException {
+        return newDocument(data, null);
+    }
+
+    /**
+     * Create new document from direct {@link ByteBuffer} with password.<br>
+     * Bytes between buffer position and limit are read in place, without copying. The buffer is kept alive
+     * until document is closed and must not be modified in the meantime.
+     */
+    public PdfDocument newDocument(ByteBuffer data, String password) throws IOException {
+        if (!data.isDirect()) {
+            throw new IllegalArgumentException("ByteBuffer must be direct");
+        }
+        PdfDocument document = new PdfDocument();
+        lock.lock();
+        try {
+            document.mNativeDocPtr = nativeOpenDirectBufferDocument(data, data.position(), data.remaining(), password);
+        } finally {
+            lock.unlock();
         }
         return document;
     }
@@ -188,53 +723,147 @@ public class PdfiumCore {
      * Get total numer of pages in document
      */
     public int getPageCount(PdfDocument doc) {
-        synchronized (lock) {
+        lock.lock();
+        try {
             return nativeGetPageCount(doc.mNativeDocPtr);
+        } finally {
+            lock.unlock();
         }
     }
 
     /**
-     * Open page and store native pointer in {@link PdfDocument}
+     * Open page and store native pointer in {@link PdfDocument}. Least recently used pages over the
+     * budget of the document are closed and loaded again when used, so the returned pointer is only
+     * valid until the next call.
+     *
+     * @see #setPageCacheBudget(PdfDocument, int, long)
      */
     public long openPage(PdfDocument doc, int pageIndex) {
-        long pagePtr;
-        synchronized (lock) {
-            pagePtr = nativeLoadPage(doc.mNativeDocPtr, pageIndex);
-            doc.mNativePagesPtr.put(pageIndex, pagePtr);
+        lock.lock();
+        try {
+            Long loadedPtr = doc.pageCache.get(pageIndex);
+            if (loadedPtr != null) {
+                return loadedPtr;
+            }
+            long pagePtr = nativeLoadPage(doc.mNativeDocPtr, pageIndex);
+            cachePage(doc, pageIndex, pagePtr);
             return pagePtr;
+        } finally {
+            lock.unlock();
         }
     }
 
     /**
-     * Open range of pages and store native pointers in {@link PdfDocument}
+     * Open range of pages and store native pointers in {@link PdfDocument}, see
+     * {@link #openPage(PdfDocument, int)}. The whole range is added to the page cache before it is
+     * trimmed once, so loading never closes a page of the range. Pages of a range larger than the
+     * budget are closed by that trim, least recently used first, and returned as 0; they are loaded
+     * again when used like any other page closed to stay in budget.
      */
     public long[] openPage(PdfDocument doc, int fromIndex, int toIndex) {
         long[] pagesPtr;
-        synchronized (lock) {
+        lock.lock();
+        try {
             pagesPtr = nativeLoadPages(doc.mNativeDocPtr, fromIndex, toIndex);
             int pageIndex = fromIndex;
-            for (long page : pagesPtr) {
-                if (pageIndex > toIndex) {
-                    break;
+            for (int i = 0; i < pagesPtr.length && pageIndex <= toIndex; i++, pageIndex++) {
+                Long loadedPtr = doc.pageCache.get(pageIndex);
+                if (loadedPtr != null) {
+                    nativeClosePage(pagesPtr[i]);
+                    pagesPtr[i] = loadedPtr;
+                } else {
+                    doc.pageCache.put(pageIndex, pagesPtr[i], nativeEstimatePageBytes(pagesPtr[i]));
                 }
-                doc.mNativePagesPtr.put(pageIndex, page);
-                pageIndex++;
             }
 
+            Set<Long> closed = new HashSet<>();
+            for (long pagePtr : doc.pageCache.trim()) {
+                nativeClosePage(pagePtr);
+                closed.add(pagePtr);
+            }
+            for (int i = 0; i < pagesPtr.length; i++) {
+                if (closed.contains(pagesPtr[i])) {
+                    pagesPtr[i] = 0;
+                }
+            }
             return pagesPtr;
+        } finally {
+            lock.unlock();
         }
     }
 
+    /**
+     * Limit pages of the document kept loaded. Loaded pages hold their parsed content and decoded
+     * images, least recently used ones over the budget are closed, except those being rendered, and
+     * loaded again when used.
+     *
+     * @param maxPages maximum number of loaded pages
+     * @param maxBytes estimated memory loaded pages may take
+     */
+    public void setPageCacheBudget(PdfDocument doc, int maxPages, long maxBytes) {
+        if (maxPages <= 0 || maxBytes <= 0) {
+            throw new IllegalArgumentException("Page cache budget must be positive");
+        }
+        lock.lock();
+        try {
+            doc.pageCache.setBudget(maxPages, maxBytes);
+            trimPages(doc);
+        } finally {
+            lock.unlock();
+        }
+    }
+
+    /* Page cache helpers, lock must be held */
+
+    private void cachePage(PdfDocument doc, int pageIndex, long pagePtr) {
+        doc.pageCache.put(pageIndex, pagePtr, nativeEstimatePageBytes(pagePtr));
+        trimPages(doc);
+    }
+
+    private void trimPages(PdfDocument doc) {
+        for (long pagePtr : doc.pageCache.trim()) {
+            nativeClosePage(pagePtr);
+        }
+    }
+
+    /**
+     * Pointer of opened page, loaded again if it was closed to stay in budget
+     *
+     * @return null if page was not opened or can't be loaded
+     */
+    private Long getPage(PdfDocument doc, int pageIndex) {
+        Long pagePtr = doc.pageCache.get(pageIndex);
+        if (pagePtr != null || !doc.pageCache.isOpened(pageIndex)) {
+            return pagePtr;
+        }
+        try {
+            pagePtr = nativeLoadPage(doc.mNativeDocPtr, pageIndex);
+        } catch (IllegalStateException e) {
+            Log.e(TAG, "Cannot load page " + pageIndex + " again", e);
+            return null;
+        }
+        cachePage(doc, pageIndex, pagePtr);
+        return pagePtr;
+    }
+
+    private void unpinPage(PdfDocument doc, int pageIndex) {
+        doc.pageCache.unpin(pageIndex);
+        trimPages(doc);
+    }
+
     /**
      * Get page width in pixels. <br> This method requires page to be opened.
      */
     public int getPageWidth(PdfDocument doc, int index) {
-        synchronized (lock) {
+        lock.lock();
+        try {
             Long pagePtr;
-            if ((pagePtr = doc.mNativePagesPtr.get(index)) != null) {
+            if ((pagePtr = getPage(doc, index)) != null) {
                 return nativeGetPageWidthPixel(pagePtr, mCurrentDpi);
             }
             return 0;
+        } finally {
+            lock.unlock();
         }
     }
 
@@ -242,12 +871,15 @@ public class PdfiumCore {
      * Get page height in pixels. <br> This method requires page to be opened.
      */
     public int getPageHeight(PdfDocument doc, int index) {
-        synchronized (lock) {
+        lock.lock();
+        try {
             Long pagePtr;
-            if ((pagePtr = doc.mNativePagesPtr.get(index)) != null) {
+            if ((pagePtr = getPage(doc, index)) != null) {
                 return nativeGetPageHeightPixel(pagePtr, mCurrentDpi);
             }
             return 0;
+        } finally {
+            lock.unlock();
         }
     }
 
@@ -255,12 +887,15 @@ public class PdfiumCore {
      * Get page width in PostScript points (1/72th of an inch).<br> This method requires page to be opened.
      */
     public int getPageWidthPoint(PdfDocument doc, int index) {
-        synchronized (lock) {
+        lock.lock();
+        try {
             Long pagePtr;
-            if ((pagePtr = doc.mNativePagesPtr.get(index)) != null) {
+            if ((pagePtr = getPage(doc, index)) != null) {
                 return nativeGetPageWidthPoint(pagePtr);
             }
             return 0;
+        } finally {
+            lock.unlock();
         }
     }
 
@@ -268,12 +903,15 @@ public class PdfiumCore {
      * Get page height in PostScript points (1/72th of an inch).<br> This method requires page to be opened.
      */
     public int getPageHeightPoint(PdfDocument doc, int index) {
-        synchronized (lock) {
+        lock.lock();
+        try {
             Long pagePtr;
-            if ((pagePtr = doc.mNativePagesPtr.get(index)) != null) {
+            if ((pagePtr = getPage(doc, index)) != null) {
                 return nativeGetPageHeightPoint(pagePtr);
             }
             return 0;
+        } finally {
+            lock.unlock();
         }
     }
 
@@ -281,11 +919,83 @@ public class PdfiumCore {
      * Get size of page in pixels.<br> This method does not require given page to be opened.
      */
     public Size getPageSize(PdfDocument doc, int index) {
-        synchronized (lock) {
+        lock.lock();
+        try {
             return nativeGetPageSizeByIndex(doc.mNativeDocPtr, index, mCurrentDpi);
+        } finally {
+            lock.unlock();
+        }
+    }
+
+    /**
+     * Get sizes of pages in pixels with a single native call.<br> This method does not require pages to be
+     * opened.
+     *
+     * @param pageIndices pages to query, or null for all pages of the document
+     */
+    public Size[] getPageSizes(PdfDocument doc, int[] pageIndices) {
+        return getPageSizes(getPagesGeometry(doc, pageIndices, false));
+    }
+
+    /**
+     * Convert page sizes from {@link #getPagesGeometry(PdfDocument, int[], boolean)} result to pixels
+     */
+    public Size[] getPageSizes(float[] geometry) {
+        Size[] sizes = new Size[geometry.length / PAGE_GEOMETRY_STRIDE];
+        for (int i = 0; i < sizes.length; i++) {
+            int offset = i * PAGE_GEOMETRY_STRIDE;
+            sizes[i] = new Size((int) (geometry[offset + PAGE_GEOMETRY_WIDTH] * mCurrentDpi / 72),
+                    (int) (geometry[offset + PAGE_GEOMETRY_HEIGHT] * mCurrentDpi / 72));
+        }
+        return sizes;
+    }
+
+    /**
+     * Get geometry of pages in points, laid out as described by {@code PAGE_GEOMETRY_*} constants.
+     * Width and height take page rotation into account and are 0 for pages that can't be read.<br>
+     * Rotation and crop box require loading every page, so they are only filled when
+     * {@code includePageBoxes} is set and are NaN otherwise.
+     *
+     * @param pageIndices pages to query, or null for all pages of the document
+     */
+    public float[] getPagesGeometry(PdfDocument doc, int[] pageIndices, boolean includePageBoxes) {
+        lock.lock();
+        try {
+            return nativeGetPagesGeometry(doc.mNativeDocPtr, pageIndices, includePageBoxes);
+        } finally {
+            lock.unlock();
         }
     }
 
+    /**
+     * Count what is drawn on a page, to estimate how costly it is to render.<br> Page must be opened.
+     *
+     * @return complexity or null if page is not opened
+     */
+    public PdfDocument.PageComplexity getPageComplexity(PdfDocument doc, int pageIndex) {
+        long[] values;
+        lock.lock();
+        try {
+            Long pagePtr = getPage(doc, pageIndex);
+            if (pagePtr == null) {
+                return null;
+            }
+            values = nativeGetPageComplexity(pagePtr);
+        } finally {
+            lock.unlock();
+        }
+        if (values == null) {
+            return null;
+        }
+        PdfDocument.PageComplexity complexity = new PdfDocument.PageComplexity();
+        complexity.objectCount = values[0];
+        complexity.imageCount = values[1];
+        complexity.transparency = values[2] != 0;
+        complexity.color = values[3] != 0;
+        complexity.annotationCount = values[4];
+        return complexity;
+    }
+
     /**
      * Render page fragment on {@link Surface}.<br> Page must be opened before rendering.
      */
@@ -303,11 +1013,25 @@ public class PdfiumCore {
         PdfDocument doc, Surface surface, int pageIndex,
         int startX, int startY, int drawSizeX, int drawSizeY,
         boolean renderAnnot) {
-        synchronized (lock) {
+        renderPage(doc, surface, pageIndex, startX, startY, drawSizeX, drawSizeY,
+            renderAnnot ? RENDER_FLAG_ANNOT : 0);
+    }
+
+    /**
+     * Render page fragment on {@link Surface} with given {@code RENDER_FLAG_*} flags.<br> Page must be
+     * opened before rendering.
+     */
+    public void renderPage(
+        PdfDocument doc, Surface surface, int pageIndex,
+        int startX, int startY, int drawSizeX, int drawSizeY,
+        int renderFlags) {
+        doc.renderLock.lock();
+        lock.lock();
+        try {
             try {
-                //nativeRenderPage(doc.mNativePagesPtr.get(pageIndex), surface, mCurrentDpi);
-                nativeRenderPage(doc.mNativePagesPtr.get(pageIndex), surface, mCurrentDpi,
-                    startX, startY, drawSizeX, drawSizeY, renderAnnot);
+                //nativeRenderPage(getPage(doc, pageIndex), surface, mCurrentDpi);
+                nativeRenderPage(getPage(doc, pageIndex), surface, mCurrentDpi,
+                    startX, startY, drawSizeX, drawSizeY, renderFlags);
             } catch (NullPointerException e) {
                 Log.e(TAG, "mContext may be null");
                 e.printStackTrace();
@@ -315,6 +1039,9 @@ public class PdfiumCore {
                 Log.e(TAG, "Exception throw from native");
                 e.printStackTrace();
             }
+        } finally {
+            lock.unlock();
+            doc.renderLock.unlock();
         }
     }
 
@@ -325,6 +1052,8 @@ public class PdfiumCore {
      * <ul>
      * <li>ARGB_8888 - best quality, high memory usage, higher possibility of OutOfMemoryError
      * <li>RGB_565 - little worse quality, twice less memory usage
+     * <li>ALPHA_8 - page in shades of gray, a quarter of the memory. Alpha is ink coverage,
+     * 0 where the page is white, draw it with a black paint over white
      * </ul>
      */
     public void renderPageBitmap(
@@ -343,10 +1072,26 @@ public class PdfiumCore {
         PdfDocument doc, Bitmap bitmap, int pageIndex,
         int startX, int startY, int drawSizeX, int drawSizeY,
         boolean renderAnnot) {
-        synchronized (lock) {
+        renderPageBitmap(doc, bitmap, pageIndex, startX, startY, drawSizeX, drawSizeY,
+            renderAnnot ? RENDER_FLAG_ANNOT : 0);
+    }
+
+    /**
+     * Render page fragment on {@link Bitmap} with given {@code RENDER_FLAG_*} flags, e.g.
+     * {@link #RENDER_FLAGS_DRAFT} while the page is moving.<br> Page must be opened before rendering.
+     * <p>
+     * For more info see {@link PdfiumCore#renderPageBitmap(PdfDocument, Bitmap, int, int, int, int, int)}
+     */
+    public void renderPageBitmap(
+        PdfDocument doc, Bitmap bitmap, int pageIndex,
+        int startX, int startY, int drawSizeX, int drawSizeY,
+        int renderFlags) {
+        doc.renderLock.lock();
+        lock.lock();
+        try {
             try {
-                nativeRenderPageBitmap(doc.mNativePagesPtr.get(pageIndex), bitmap, mCurrentDpi,
-                    startX, startY, drawSizeX, drawSizeY, renderAnnot);
+                nativeRenderPageBitmap(getPage(doc, pageIndex), bitmap, mCurrentDpi,
+                    startX, startY, drawSizeX, drawSizeY, renderFlags);
             } catch (NullPointerException e) {
                 Log.e(TAG, "mContext may be null");
                 e.printStackTrace();
@@ -354,6 +1099,218 @@ public class PdfiumCore {
                 Log.e(TAG, "Exception throw from native");
                 e.printStackTrace();
             }
+        } finally {
+            lock.unlock();
+            doc.renderLock.unlock();
+        }
+    }
+
+    /**
+     * Render page fragment on {@link Bitmap} in time slices of about {@code sliceMillis}. The lock
+     * serializing native calls is released between slices so calls on other documents aren't blocked
+     * by a slow page, and the render is abandoned at the next slice once {@code cancellationSignal}
+     * is cancelled.<br> Page must be opened before rendering.
+     * <p>
+     * For other parameters see {@link PdfiumCore#renderPageBitmap(PdfDocument, Bitmap, int, int, int, int, int, int)}
+     *
+     * @param colorScheme colors to draw text, paths and the page background in, null to keep the
+     *                    page colors
+     * @param cancellationSignal signal to abandon the render, may be null
+     * @return true if the page was fully rendered, false if cancelled or failed, the bitmap is then
+     * only partially drawn
+     */
+    public boolean renderPageBitmap(
+        PdfDocument doc, Bitmap bitmap, int pageIndex,
+        int startX, int startY, int drawSizeX, int drawSizeY,
+        int renderFlags, ColorScheme colorScheme, CancellationSignal cancellationSignal, int sliceMillis) {
+        doc.renderLock.lock();
+        try {
+            long renderPtr;
+            lock.lock();
+            try {
+                Long pagePtr = getPage(doc, pageIndex);
+                if (pagePtr == null) {
+                    Log.e(TAG, "Page " + pageIndex + " is not opened");
+                    return false;
+                }
+                renderPtr = nativeOpenRender(pagePtr, startX, startY, drawSizeX, drawSizeY, renderFlags,
+                    colorScheme != null ? colorScheme.toArray() : null);
+                if (renderPtr == 0) {
+                    return false;
+                }
+                // Render uses the page between slices, without the lock
+                doc.pageCache.pin(pageIndex);
+            } finally {
+                lock.unlock();
+            }
+
+            try {
+                return renderSlices(renderPtr, bitmap, cancellationSignal, sliceMillis);
+            } finally {
+                closeRender(doc, pageIndex, renderPtr);
+            }
+        } finally {
+            doc.renderLock.unlock();
+        }
+    }
+
+    /**
+     * Render several fragments of one page at the same zoom, PDFium goes through the page once for
+     * all of them instead of once per fragment. Fragments are rendered to an atlas covering all of
+     * them and copied to the bitmaps, so they should be close to each other, scattered fragments are
+     * rendered one by one.<br> Page must be opened before rendering.
+     * <p>
+     * All bitmaps must have the same configuration. Rendered in time slices, see
+     * {@link PdfiumCore#renderPageBitmap(PdfDocument, Bitmap, int, int, int, int, int, int, ColorScheme, CancellationSignal, int)}
+     *
+     * @param starts startX and startY of every bitmap
+     * @return true if all bitmaps were fully rendered
+     */
+    public boolean renderPageBitmaps(
+        PdfDocument doc, Bitmap[] bitmaps, Point[] starts, int pageIndex,
+        int drawSizeX, int drawSizeY,
+        int renderFlags, ColorScheme colorScheme, CancellationSignal cancellationSignal, int sliceMillis) {
+        if (bitmaps.length != starts.length || bitmaps.length == 0) {
+            Log.e(TAG, "Every bitmap needs its start");
+            return false;
+        }
+
+        int[] tiles = new int[bitmaps.length * 4];
+        int left = Integer.MAX_VALUE, top = Integer.MAX_VALUE;
+        int right = Integer.MIN_VALUE, bottom = Integer.MIN_VALUE;
+        long tilesArea = 0;
+        for (int i = 0; i < bitmaps.length; i++) {
+            if (bitmaps[i].getConfig() != bitmaps[0].getConfig()) {
+                Log.e(TAG, "All bitmaps of a batch must have the same configuration");
+                return false;
+            }
+            tiles[i * 4] = starts[i].x;
+            tiles[i * 4 + 1] = starts[i].y;
+            tiles[i * 4 + 2] = bitmaps[i].getWidth();
+            tiles[i * 4 + 3] = bitmaps[i].getHeight();
+            left = Math.min(left, -starts[i].x);
+            top = Math.min(top, -starts[i].y);
+            right = Math.max(right, -starts[i].x + bitmaps[i].getWidth());
+            bottom = Math.max(bottom, -starts[i].y + bitmaps[i].getHeight());
+            tilesArea += (long) bitmaps[i].getWidth() * bitmaps[i].getHeight();
+        }
+
+        doc.renderLock.lock();
+        try {
+            long atlasArea = (long) (right - left) * (bottom - top);
+            if (bitmaps.length == 1 || atlasArea > MAX_ATLAS_OVERDRAW * tilesArea) {
+                boolean rendered = true;
+                for (int i = 0; i < bitmaps.length && rendered; i++) {
+                    rendered = renderPageBitmap(doc, bitmaps[i], pageIndex, starts[i].x, starts[i].y,
+                        drawSizeX, drawSizeY, renderFlags, colorScheme, cancellationSignal, sliceMillis);
+                }
+                return rendered;
+            }
+
+            long renderPtr;
+            lock.lock();
+            try {
+                Long pagePtr = getPage(doc, pageIndex);
+                if (pagePtr == null) {
+                    Log.e(TAG, "Page " + pageIndex + " is not opened");
+                    return false;
+                }
+                renderPtr = nativeOpenAtlasRender(pagePtr, tiles, drawSizeX, drawSizeY, renderFlags,
+                    colorScheme != null ? colorScheme.toArray() : null, bitmaps[0]);
+                if (renderPtr == 0) {
+                    return false;
+                }
+                doc.pageCache.pin(pageIndex);
+            } finally {
+                lock.unlock();
+            }
+
+            try {
+                if (!renderSlices(renderPtr, null, cancellationSignal, sliceMillis)) {
+                    return false;
+                }
+                lock.lock();
+                try {
+                    return nativeCopyAtlasTiles(renderPtr, bitmaps, tiles);
+                } finally {
+                    lock.unlock();
+                }
+            } finally {
+                closeRender(doc, pageIndex, renderPtr);
+            }
+        } finally {
+            doc.renderLock.unlock();
+        }
+    }
+
+    /**
+     * Draw a thumbnail of the whole page on {@link Bitmap}. The thumbnail image embedded in the page,
+     * common in scanned documents, is decoded and scaled instead of rendering the page when it is at
+     * least {@code minEmbeddedScale} of the bitmap size, has the aspect ratio of the page and no
+     * {@code colorScheme} is given, {@link #NO_EMBEDDED_THUMBNAIL} skips it. Embedded thumbnails
+     * don't show annotations. Otherwise the page is rendered at the bitmap size in time slices, see
+     * {@link PdfiumCore#renderPageBitmap(PdfDocument, Bitmap, int, int, int, int, int, int, ColorScheme, CancellationSignal, int)}
+     * <br> Page must be opened before rendering.
+     *
+     * @return {@link #THUMBNAIL_EMBEDDED} or {@link #THUMBNAIL_RENDERED} depending on how the
+     * thumbnail was drawn, {@link #THUMBNAIL_FAILED} if cancelled or failed
+     */
+    public int renderPageThumbnail(
+        PdfDocument doc, Bitmap bitmap, int pageIndex, int renderFlags, ColorScheme colorScheme,
+        float minEmbeddedScale, CancellationSignal cancellationSignal, int sliceMillis) {
+        doc.renderLock.lock();
+        try {
+            boolean embedded = false;
+            lock.lock();
+            try {
+                Long pagePtr = getPage(doc, pageIndex);
+                if (pagePtr == null) {
+                    Log.e(TAG, "Page " + pageIndex + " is not opened");
+                    return THUMBNAIL_FAILED;
+                }
+                // The embedded image is the page in its own colors
+                if (colorScheme == null && minEmbeddedScale != NO_EMBEDDED_THUMBNAIL) {
+                    embedded = nativeRenderEmbeddedThumbnail(pagePtr, bitmap, minEmbeddedScale);
+                }
+            } finally {
+                lock.unlock();
+            }
+            if (embedded) {
+                return THUMBNAIL_EMBEDDED;
+            }
+
+            boolean rendered = renderPageBitmap(doc, bitmap, pageIndex, 0, 0,
+                bitmap.getWidth(), bitmap.getHeight(), renderFlags, colorScheme, cancellationSignal, sliceMillis);
+            return rendered ? THUMBNAIL_RENDERED : THUMBNAIL_FAILED;
+        } finally {
+            doc.renderLock.unlock();
+        }
+    }
+
+    private boolean renderSlices(long renderPtr, Bitmap bitmap, CancellationSignal cancellationSignal,
+                                 int sliceMillis) {
+        int status = RENDER_TO_BE_CONTINUED;
+        while (status == RENDER_TO_BE_CONTINUED) {
+            if (cancellationSignal != null && cancellationSignal.isCanceled()) {
+                return false;
+            }
+            lock.lock();
+            try {
+                status = nativeContinueRender(renderPtr, bitmap, sliceMillis);
+            } finally {
+                lock.unlock();
+            }
+        }
+        return status == RENDER_DONE;
+    }
+
+    private void closeRender(PdfDocument doc, int pageIndex, long renderPtr) {
+        lock.lock();
+        try {
+            nativeCloseRender(renderPtr);
+            unpinPage(doc, pageIndex);
+        } finally {
+            lock.unlock();
         }
     }
 
@@ -361,11 +1318,13 @@ public class PdfiumCore {
      * Release native resources and opened file
      */
     public void closeDocument(PdfDocument doc) {
-        synchronized (lock) {
-            for (Integer index : doc.mNativePagesPtr.keySet()) {
-                nativeClosePage(doc.mNativePagesPtr.get(index));
+        // Wait for a sliced render still holding on to one of the pages
+        doc.renderLock.lock();
+        lock.lock();
+        try {
+            for (long pagePtr : doc.pageCache.clear()) {
+                nativeClosePage(pagePtr);
             }
-            doc.mNativePagesPtr.clear();
 
             nativeCloseDocument(doc.mNativeDocPtr);
 
@@ -377,14 +1336,35 @@ public class PdfiumCore {
                 }
                 doc.parcelFileDescriptor = null;
             }
+        } finally {
+            lock.unlock();
+            doc.renderLock.unlock();
         }
     }
 
+    /**
+     * Apply ordered dithering when rendering to RGB_565 bitmaps, hides banding in gradients and
+     * photos at a small cost. Applies to all documents, off by default
+     */
+    public void setRgb565Dithering(boolean dithering) {
+        nativeSetRgb565Dithering(dithering);
+    }
+
+    /**
+     * Free buffers kept for reuse by following renders, call from
+     * {@link android.content.ComponentCallbacks2#onTrimMemory(int)}. They are freed anyway when the
+     * last document is closed
+     */
+    public void trimMemory() {
+        nativeTrimMemory();
+    }
+
     /**
      * Get metadata for given document
      */
     public PdfDocument.Meta getDocumentMeta(PdfDocument doc) {
-        synchronized (lock) {
+        lock.lock();
+        try {
             PdfDocument.Meta meta = new PdfDocument.Meta();
             meta.title = nativeGetDocumentMetaText(doc.mNativeDocPtr, "Title");
             meta.author = nativeGetDocumentMetaText(doc.mNativeDocPtr, "Author");
@@ -396,6 +1376,47 @@ public class PdfiumCore {
             meta.modDate = nativeGetDocumentMetaText(doc.mNativeDocPtr, "ModDate");
 
             return meta;
+        } finally {
+            lock.unlock();
+        }
+    }
+
+    /**
+     * Get file identifier from document trailer, null if document has none
+     *
+     * @param idType {@link #FILE_IDENTIFIER_PERMANENT} or {@link #FILE_IDENTIFIER_CHANGING}
+     */
+    public byte[] getFileIdentifier(PdfDocument doc, int idType) {
+        lock.lock();
+        try {
+            return nativeGetFileIdentifier(doc.mNativeDocPtr, idType);
+        } finally {
+            lock.unlock();
+        }
+    }
+
+    /**
+     * Get size of document source in bytes
+     */
+    public long getDocumentFileSize(PdfDocument doc) {
+        lock.lock();
+        try {
+            return nativeGetFileSize(doc.mNativeDocPtr);
+        } finally {
+            lock.unlock();
+        }
+    }
+
+    /**
+     * Get label of page, like "iv" or "A-1", null if page has no label.<br> This method does not require
+     * given page to be opened.
+     */
+    public String getPageLabel(PdfDocument doc, int pageIndex) {
+        lock.lock();
+        try {
+            return nativeGetPageLabel(doc.mNativeDocPtr, pageIndex);
+        } finally {
+            lock.unlock();
         }
     }
 
@@ -403,13 +1424,16 @@ public class PdfiumCore {
      * Get table of contents (bookmarks) for given document
      */
     public List<PdfDocument.Bookmark> getTableOfContents(PdfDocument doc) {
-        synchronized (lock) {
+        lock.lock();
+        try {
             List<PdfDocument.Bookmark> topLevel = new ArrayList<>();
             Long first = nativeGetFirstChildBookmark(doc.mNativeDocPtr, null);
             if (first != null) {
                 recursiveGetBookmark(topLevel, doc, first);
             }
             return topLevel;
+        } finally {
+            lock.unlock();
         }
     }
 
@@ -435,25 +1459,53 @@ public class PdfiumCore {
      * Get all links from given page
      */
     public List<PdfDocument.Link> getPageLinks(PdfDocument doc, int pageIndex) {
-        synchronized (lock) {
-            List<PdfDocument.Link> links = new ArrayList<>();
-            Long nativePagePtr = doc.mNativePagesPtr.get(pageIndex);
+        lock.lock();
+        try {
+            Long nativePagePtr = getPage(doc, pageIndex);
             if (nativePagePtr == null) {
-                return links;
+                return new ArrayList<>();
             }
-            long[] linkPtrs = nativeGetPageLinks(nativePagePtr);
-            for (long linkPtr : linkPtrs) {
-                Integer index = nativeGetDestPageIndex(doc.mNativeDocPtr, linkPtr);
-                String uri = nativeGetLinkURI(doc.mNativeDocPtr, linkPtr);
+            return getPageLinks(doc, nativePagePtr);
+        } finally {
+            lock.unlock();
+        }
+    }
 
-                RectF rect = nativeGetLinkRect(linkPtr);
-                if (rect != null && (index != null || uri != null)) {
-                    links.add(new PdfDocument.Link(rect, index, uri));
-                }
+    /**
+     * Get all links from given page, loading it temporarily if it's not opened
+     */
+    /*package*/ List<PdfDocument.Link> loadPageLinks(PdfDocument doc, int pageIndex) {
+        lock.lock();
+        try {
+            Long nativePagePtr = getPage(doc, pageIndex);
+            if (nativePagePtr != null) {
+                return getPageLinks(doc, nativePagePtr);
+            }
+            long pagePtr = nativeLoadPage(doc.mNativeDocPtr, pageIndex);
+            try {
+                return getPageLinks(doc, pagePtr);
+            } finally {
+                nativeClosePage(pagePtr);
+            }
+        } finally {
+            lock.unlock();
+        }
+    }
 
+    private List<PdfDocument.Link> getPageLinks(PdfDocument doc, long pagePtr) {
+        List<PdfDocument.Link> links = new ArrayList<>();
+        long[] linkPtrs = nativeGetPageLinks(pagePtr);
+        for (long linkPtr : linkPtrs) {
+            Integer index = nativeGetDestPageIndex(doc.mNativeDocPtr, linkPtr);
+            String uri = nativeGetLinkURI(doc.mNativeDocPtr, linkPtr);
+
+            RectF rect = nativeGetLinkRect(linkPtr);
+            if (rect != null && (index != null || uri != null)) {
+                links.add(new PdfDocument.Link(rect, index, uri));
             }
-            return links;
+
         }
+        return links;
     }
 
     /**
@@ -474,8 +1526,13 @@ public class PdfiumCore {
     public Point mapPageCoordsToDevice(
         PdfDocument doc, int pageIndex, int startX, int startY, int sizeX,
         int sizeY, int rotate, double pageX, double pageY) {
-        long pagePtr = doc.mNativePagesPtr.get(pageIndex);
-        return nativePageCoordsToDevice(pagePtr, startX, startY, sizeX, sizeY, rotate, pageX, pageY);
+        lock.lock();
+        try {
+            long pagePtr = getPage(doc, pageIndex);
+            return nativePageCoordsToDevice(pagePtr, startX, startY, sizeX, sizeY, rotate, pageX, pageY);
+        } finally {
+            lock.unlock();
+        }
     }
 
     /**
@@ -494,25 +1551,34 @@ public class PdfiumCore {
     }
 
     public String getPageText(PdfDocument doc, int pageIndex) {
-        synchronized (lock) {
-            Long pagePtr = doc.mNativePagesPtr.get(pageIndex);
+        lock.lock();
+        try {
+            Long pagePtr = getPage(doc, pageIndex);
             if (pagePtr == null) {
                 return null;
             }
 
-            long textPagePtr = nativeTextLoadPage(pagePtr);
-            int textCount = nativeTextCountChars(textPagePtr);
+            // Text page refers to the page until closed
+            doc.pageCache.pin(pageIndex);
+            try {
+                long textPagePtr = nativeTextLoadPage(pagePtr);
+                int textCount = nativeTextCountChars(textPagePtr);
 
-            if (textCount == 0) {
-                nativeTextClosePage(textPagePtr);
-                return "";
-            }
+                if (textCount == 0) {
+                    nativeTextClosePage(textPagePtr);
+                    return "";
+                }
 
-            char[] buf = new char[textCount];
-            int c = nativeTextGetText(textPagePtr, 0, textCount, buf);
-            nativeTextClosePage(textPagePtr);
+                char[] buf = new char[textCount];
+                int c = nativeTextGetText(textPagePtr, 0, textCount, buf);
+                nativeTextClosePage(textPagePtr);
 
-            return new String(buf, 0, c);
+                return new String(buf, 0, c);
+            } finally {
+                unpinPage(doc, pageIndex);
+            }
+        } finally {
+            lock.unlock();
         }
     }
 }
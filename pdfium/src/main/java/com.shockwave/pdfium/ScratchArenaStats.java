@@ -0,0 +1,40 @@
+package com.shockwave.pdfium;
+
+/**
+ * Usage of per thread scratch memory native code draws temporary render and text buffers from,
+ * totals of all threads
+ */
+public class ScratchArenaStats {
+    long allocations;
+    long allocatedBytes;
+    long growths;
+    long trims;
+    long reservedBytes;
+    long peakReservedBytes;
+
+    public long getAllocations() {
+        return allocations;
+    }
+
+    public long getAllocatedBytes() {
+        return allocatedBytes;
+    }
+
+    /** Number of times an arena had to allocate a larger chunk */
+    public long getGrowths() {
+        return growths;
+    }
+
+    /** Number of times an arena shrank after recent calls needed much less memory */
+    public long getTrims() {
+        return trims;
+    }
+
+    public long getReservedBytes() {
+        return reservedBytes;
+    }
+
+    public long getPeakReservedBytes() {
+        return peakReservedBytes;
+    }
+}
@@ -0,0 +1,14 @@
+package com.shockwave.pdfium;
+
+/**
+ * Rendered tiles kept compressed in native memory, off the Java heap.
+ *
+ * @see PdfiumCore#newTileCache(long)
+ */
+public class TileCache {
+
+    /*package*/ long mNativePtr;
+
+    /*package*/ TileCache() {
+    }
+}
@@ -0,0 +1,56 @@
+package com.shockwave.pdfium;
+
+/**
+ * Usage of a {@link TileCache}
+ */
+public class TileCacheStats {
+    long hits;
+    long misses;
+    long stores;
+    long evictions;
+    long tiles;
+    long compressedBytes;
+    long rawBytes;
+
+    public long getHits() {
+        return hits;
+    }
+
+    public long getMisses() {
+        return misses;
+    }
+
+    /** Share of taken tiles that were cached */
+    public float getHitRate() {
+        long requests = hits + misses;
+        return requests == 0 ? 0 : (float) hits / requests;
+    }
+
+    /** Number of tiles stored, including replaced and evicted ones */
+    public long getStores() {
+        return stores;
+    }
+
+    public long getEvictions() {
+        return evictions;
+    }
+
+    /** Number of tiles cached now */
+    public long getTiles() {
+        return tiles;
+    }
+
+    public long getCompressedBytes() {
+        return compressedBytes;
+    }
+
+    /** Bytes cached tiles take as bitmaps */
+    public long getRawBytes() {
+        return rawBytes;
+    }
+
+    /** How many times smaller cached tiles are than their bitmaps */
+    public float getCompressionRatio() {
+        return compressedBytes == 0 ? 0 : (float) rawBytes / compressedBytes;
+    }
+}
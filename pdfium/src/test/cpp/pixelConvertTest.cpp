@@ -0,0 +1,96 @@
+#include "pixelConvert.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+/*
+ * Compares every RGB_565 kernel this CPU can run with the scalar reference, bit for bit.
+ * Every kernel steps 16 pixels: widths 1..70 cover rows shorter than a step and each remainder
+ * 0..15 left to the scalar tail over several steps. Strides are padded and sources misaligned,
+ * since Bitmap rows and PDFium buffers are both.
+ */
+
+static const char *KERNELS[] = {"neon", "ssse3", "avx2"};
+
+static int failures = 0;
+
+static void fillRandom(std::vector<uint8_t> &buffer, unsigned seed) {
+    srand(seed);
+    for (size_t i = 0; i < buffer.size(); i++) {
+        // Bias a quarter of bytes to the top so dither saturation gets exercised
+        int value = rand();
+        buffer[i] = (value & 3) == 0 ? static_cast<uint8_t>(250 + (value >> 2) % 6)
+                                     : static_cast<uint8_t>(value >> 2);
+    }
+}
+
+static void compare(const char *kernel, int width, int height, int sourcePadding,
+                    int destPadding, int sourceOffset, bool dither) {
+    int sourceStride = width * 3 + sourcePadding;
+    int destStride = width * 2 + destPadding;
+
+    std::vector<uint8_t> source(sourceOffset + sourceStride * height);
+    fillRandom(source, width * 31 + height);
+    // Fill destinations alike so writes past the row end show up as mismatches in the padding
+    std::vector<uint8_t> expected(destStride * height, 0xAB);
+    std::vector<uint8_t> actual(destStride * height, 0xAB);
+
+    convertRgbTo565Scalar(&source[sourceOffset], sourceStride,
+                          reinterpret_cast<uint16_t *>(&expected[0]), destStride,
+                          width, height, dither);
+    if (!convertRgbTo565WithKernel(kernel, &source[sourceOffset], sourceStride,
+                                   reinterpret_cast<uint16_t *>(&actual[0]), destStride,
+                                   width, height, dither)) {
+        return;
+    }
+
+    if (memcmp(&expected[0], &actual[0], expected.size()) != 0) {
+        for (size_t i = 0; i < expected.size(); i++) {
+            if (expected[i] != actual[i]) {
+                fprintf(stderr, "%s: width %d height %d source stride %d dest stride %d "
+                                "offset %d dither %d: first mismatch at row %d byte %d\n",
+                        kernel, width, height, sourceStride, destStride, sourceOffset, dither,
+                        static_cast<int>(i / destStride), static_cast<int>(i % destStride));
+                break;
+            }
+        }
+        failures++;
+    }
+}
+
+int main() {
+    std::vector<uint8_t> probe(3);
+    uint16_t probeOut;
+    int ran = 0;
+
+    for (size_t k = 0; k < sizeof(KERNELS) / sizeof(KERNELS[0]); k++) {
+        const char *kernel = KERNELS[k];
+        if (!convertRgbTo565WithKernel(kernel, &probe[0], 3, &probeOut, 2, 1, 1, false)) {
+            printf("%s: not available, skipped\n", kernel);
+            continue;
+        }
+        ran++;
+
+        for (int dither = 0; dither <= 1; dither++) {
+            for (int width = 1; width <= 70; width++) {
+                compare(kernel, width, 5, 0, 0, 0, dither);
+                compare(kernel, width, 5, 7, 2, 1, dither);
+            }
+            static const int WIDE[] = {255, 256, 257, 1000, 1023, 1080};
+            for (size_t w = 0; w < sizeof(WIDE) / sizeof(WIDE[0]); w++) {
+                compare(kernel, WIDE[w], 9, 0, 0, 0, dither);
+                compare(kernel, WIDE[w], 9, 13, 6, 3, dither);
+            }
+        }
+        printf("%s: compared\n", kernel);
+    }
+
+    if (failures > 0) {
+        fprintf(stderr, "%d mismatching conversions\n", failures);
+        return 1;
+    }
+    printf("%d vector kernels match scalar (selected: %s)\n", ran, getRgbTo565KernelName());
+    return 0;
+}
@@ -136,15 +136,15 @@ class AnimationManager {
 
         @Override
         public void onAnimationCancel(Animator animation) {
-            pdfView.loadPages();
             pageFlinging = false;
+            pdfView.loadPages();
             hideHandle();
         }
 
         @Override
         public void onAnimationEnd(Animator animation) {
-            pdfView.loadPages();
             pageFlinging = false;
+            pdfView.loadPages();
             hideHandle();
         }
     }
@@ -160,15 +160,15 @@ class AnimationManager {
 
         @Override
         public void onAnimationCancel(Animator animation) {
-            pdfView.loadPages();
             pageFlinging = false;
+            pdfView.loadPages();
             hideHandle();
         }
 
         @Override
         public void onAnimationEnd(Animator animation) {
-            pdfView.loadPages();
             pageFlinging = false;
+            pdfView.loadPages();
             hideHandle();
         }
     }
@@ -0,0 +1,127 @@
+/**
+ * Copyright 2016 Bartosz Schiller
+ * <p/>
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * <p/>
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * <p/>
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package com.github.barteksc.pdfviewer;
+
+import android.graphics.Bitmap;
+
+import java.util.ArrayList;
+import java.util.List;
+import java.util.Map;
+import java.util.TreeMap;
+
+/**
+ * Bitmaps of evicted parts, reconfigured for new parts instead of allocating one per part. Bitmaps
+ * are kept by allocation size, so a part takes the smallest one it fits in whatever its config.
+ */
+class BitmapPool {
+
+    /** Bitmaps more than this times larger than needed aren't reused, they'd waste the memory */
+    private static final int MAX_SIZE_RATIO = 2;
+
+    private final long maxBytes;
+
+    private long pooledBytes;
+
+    private final TreeMap<Integer, List<Bitmap>> bitmaps = new TreeMap<>();
+
+    BitmapPool(long maxBytes) {
+        this.maxBytes = maxBytes;
+    }
+
+    /**
+     * Pooled bitmap reconfigured to the given size and config, or a new one. Its content is
+     * undefined, renders paint every pixel
+     *
+     * @throws IllegalArgumentException when the bitmap cannot be created
+     */
+    Bitmap acquire(int width, int height, Bitmap.Config config) {
+        int needed = width * height * bytesPerPixel(config);
+        synchronized (bitmaps) {
+            Map.Entry<Integer, List<Bitmap>> entry;
+            while ((entry = bitmaps.ceilingEntry(needed)) != null && entry.getKey() <= needed * MAX_SIZE_RATIO) {
+                Bitmap bitmap = take(entry);
+                try {
+                    bitmap.reconfigure(width, height, config);
+                    bitmap.setHasAlpha(config != Bitmap.Config.RGB_565);
+                    return bitmap;
+                } catch (IllegalArgumentException e) {
+                    bitmap.recycle();
+                }
+            }
+        }
+        return Bitmap.createBitmap(width, height, config);
+    }
+
+    /** Keep the bitmap for reuse, it must no longer be drawn */
+    void release(Bitmap bitmap) {
+        if (bitmap.isRecycled()) {
+            return;
+        }
+        if (!bitmap.isMutable()) {
+            bitmap.recycle();
+            return;
+        }
+
+        int size = bitmap.getAllocationByteCount();
+        synchronized (bitmaps) {
+            if (pooledBytes + size > maxBytes) {
+                bitmap.recycle();
+                return;
+            }
+            List<Bitmap> sameSize = bitmaps.get(size);
+            if (sameSize == null) {
+                sameSize = new ArrayList<>();
+                bitmaps.put(size, sameSize);
+            }
+            sameSize.add(bitmap);
+            pooledBytes += size;
+        }
+    }
+
+    /** Recycle all pooled bitmaps */
+    void clear() {
+        synchronized (bitmaps) {
+            for (List<Bitmap> sameSize : bitmaps.values()) {
+                for (Bitmap bitmap : sameSize) {
+                    bitmap.recycle();
+                }
+            }
+            bitmaps.clear();
+            pooledBytes = 0;
+        }
+    }
+
+    private Bitmap take(Map.Entry<Integer, List<Bitmap>> entry) {
+        List<Bitmap> sameSize = entry.getValue();
+        Bitmap bitmap = sameSize.remove(sameSize.size() - 1);
+        if (sameSize.isEmpty()) {
+            bitmaps.remove(entry.getKey());
+        }
+        pooledBytes -= entry.getKey();
+        return bitmap;
+    }
+
+    private static int bytesPerPixel(Bitmap.Config config) {
+        switch (config) {
+            case ALPHA_8:
+                return 1;
+            case RGB_565:
+                return 2;
+            default:
+                return 4;
+        }
+    }
+}
@@ -16,95 +16,208 @@
 package com.github.barteksc.pdfviewer;
 
 import android.graphics.RectF;
-import androidx.annotation.Nullable;
 
 import com.github.barteksc.pdfviewer.model.PagePart;
 
 import java.util.ArrayList;
-import java.util.Collection;
 import java.util.Comparator;
+import java.util.HashMap;
 import java.util.List;
-import java.util.PriorityQueue;
+import java.util.Map;
+import java.util.TreeSet;
 
-import static com.github.barteksc.pdfviewer.util.Constants.Cache.CACHE_SIZE;
 import static com.github.barteksc.pdfviewer.util.Constants.Cache.THUMBNAILS_CACHE_SIZE;
 
+/**
+ * Parts are indexed by page, zoom and bounds and kept within a memory budget. Parts of the current
+ * set, requested by the last {@link PagesLoader#loadPages()}, are evicted only when parts of older
+ * sets are gone. Older parts are evicted by GreedyDual-Size: large parts that are cheap to render
+ * again go first, parts not requested again age out.
+ */
 class CacheManager {
 
-    private final PriorityQueue<PagePart> passiveCache;
+    /** Cost of rendering any part again, on top of its share of the page content */
+    private static final float MIN_RENDER_COST = 1;
+
+    private final long budgetBytes;
+
+    /** Takes bitmaps of evicted parts */
+    private final BitmapPool bitmapPool;
+
+    /** Keeps evicted parts compressed, null to drop them */
+    private PdfFile pdfFile;
 
-    private final PriorityQueue<PagePart> activeCache;
+    /** Compresses evicted parts off the UI thread parts are cached on */
+    private RenderingHandler renderingHandler;
+
+    private long usedBytes;
+
+    private final Map<PartKey, CachedPart> index = new HashMap<>();
+
+    /** Parts of older sets, first to evict first */
+    private final TreeSet<CachedPart> passiveCache = new TreeSet<>(new CreditComparator());
+
+    /** Parts of the current set, farthest from the visible area first */
+    private final TreeSet<CachedPart> activeCache = new TreeSet<>(new OrderComparator());
 
     private final List<PagePart> thumbnails;
 
     private final Object passiveActiveLock = new Object();
 
-    private final PagePartComparator orderComparator = new PagePartComparator();
+    /** GreedyDual-Size inflation, credit of the last evicted part */
+    private double inflation;
+
+    private long sequence;
 
-    public CacheManager() {
-        activeCache = new PriorityQueue<>(CACHE_SIZE, orderComparator);
-        passiveCache = new PriorityQueue<>(CACHE_SIZE, orderComparator);
+    /**
+     * @param budgetBytes memory page parts may take, thumbnails aren't counted
+     */
+    public CacheManager(long budgetBytes, BitmapPool bitmapPool) {
+        this.budgetBytes = budgetBytes;
+        this.bitmapPool = bitmapPool;
         thumbnails = new ArrayList<>();
     }
 
-    public void cachePart(PagePart part) {
+    /**
+     * Document evicted parts are kept compressed by, null to drop them
+     *
+     * @param renderingHandler thread compressing evicted parts
+     */
+    public void setPdfFile(PdfFile pdfFile, RenderingHandler renderingHandler) {
+        synchronized (passiveActiveLock) {
+            this.pdfFile = pdfFile;
+            this.renderingHandler = renderingHandler;
+        }
+    }
+
+    /**
+     * @param pageCost estimated cost of rendering the whole page, see {@link PdfFile#getPageCost(int)}
+     */
+    public void cachePart(PagePart part, float pageCost) {
         synchronized (passiveActiveLock) {
+            CachedPart cached = new CachedPart(part, pageCost, sequence++);
+
+            // Replace the draft rendered while the view was moving
+            CachedPart replaced = index.get(cached.key);
+            if (replaced != null) {
+                remove(replaced);
+                bitmapPool.release(replaced.part.getRenderedBitmap());
+            }
+
             // If cache too big, remove and recycle
-            makeAFreeSpace();
+            makeAFreeSpace(cached.bytes);
 
             // Then add part
-            activeCache.offer(part);
+            index.put(cached.key, cached);
+            activeCache.add(cached);
+            usedBytes += cached.bytes;
         }
     }
 
     public void makeANewSet() {
         synchronized (passiveActiveLock) {
-            passiveCache.addAll(activeCache);
+            for (CachedPart cached : activeCache) {
+                cached.credit = inflation + cached.costPerByte;
+                passiveCache.add(cached);
+            }
             activeCache.clear();
         }
     }
 
-    private void makeAFreeSpace() {
+    private void makeAFreeSpace(long neededBytes) {
         synchronized (passiveActiveLock) {
-            while ((activeCache.size() + passiveCache.size()) >= CACHE_SIZE &&
-                    !passiveCache.isEmpty()) {
-                PagePart part = passiveCache.poll();
-                part.getRenderedBitmap().recycle();
+            while (usedBytes + neededBytes > budgetBytes && !passiveCache.isEmpty()) {
+                CachedPart cached = passiveCache.first();
+                inflation = cached.credit;
+                remove(cached);
+                evict(cached.part);
             }
 
-            while ((activeCache.size() + passiveCache.size()) >= CACHE_SIZE &&
-                    !activeCache.isEmpty()) {
-                activeCache.poll().getRenderedBitmap().recycle();
+            while (usedBytes + neededBytes > budgetBytes && !activeCache.isEmpty()) {
+                CachedPart cached = activeCache.first();
+                remove(cached);
+                evict(cached.part);
             }
         }
     }
 
-    public void cacheThumbnail(PagePart part) {
+    /** Compress the part before its bitmap is reused, decompressing is much faster than rendering */
+    private void evict(PagePart part) {
+        if (pdfFile != null && renderingHandler != null && !part.isDraft()) {
+            renderingHandler.storeEvictedPart(pdfFile, part);
+        } else {
+            bitmapPool.release(part.getRenderedBitmap());
+        }
+    }
+
+    private void remove(CachedPart cached) {
+        if (!passiveCache.remove(cached)) {
+            activeCache.remove(cached);
+        }
+        index.remove(cached.key);
+        usedBytes -= cached.bytes;
+    }
+
+    /**
+     * Cache a thumbnail, evicting the one of the page farthest from the current page when full, the
+     * oldest among equally far ones. A thumbnail farther than all cached ones is dropped instead
+     */
+    public void cacheThumbnail(PagePart part, int currentPage) {
         synchronized (thumbnails) {
-            // If cache too big, remove and recycle
+            if (thumbnails.contains(part)) {
+                bitmapPool.release(part.getRenderedBitmap());
+                return;
+            }
+
             while (thumbnails.size() >= THUMBNAILS_CACHE_SIZE) {
-                thumbnails.remove(0).getRenderedBitmap().recycle();
+                int farthest = 0;
+                for (int i = 1; i < thumbnails.size(); i++) {
+                    if (distance(thumbnails.get(i), currentPage) > distance(thumbnails.get(farthest), currentPage)) {
+                        farthest = i;
+                    }
+                }
+                if (distance(part, currentPage) > distance(thumbnails.get(farthest), currentPage)) {
+                    bitmapPool.release(part.getRenderedBitmap());
+                    return;
+                }
+                bitmapPool.release(thumbnails.remove(farthest).getRenderedBitmap());
             }
 
-            // Then add thumbnail
-            addWithoutDuplicates(thumbnails, part);
+            thumbnails.add(part);
         }
+    }
 
+    private static int distance(PagePart part, int page) {
+        return Math.abs(part.getPage() - page);
     }
 
-    public boolean upPartIfContained(int page, RectF pageRelativeBounds, int toOrder) {
-        PagePart fakePart = new PagePart(page, null, pageRelativeBounds, false, 0);
+    public boolean upPartIfContained(int page, RectF pageRelativeBounds, float renderWidth, int toOrder) {
+        return upPartIfContained(page, pageRelativeBounds, renderWidth, toOrder, true);
+    }
+
+    /**
+     * Keep the described part cached for the current set
+     *
+     * @param renderWidth   width the part is rendered at, parts of other zooms don't match
+     * @param draftAccepted whether a draft part is good enough, a draft is kept on screen anyway
+     *                      until the part is rendered again
+     * @return true if the part doesn't need to be rendered
+     */
+    public boolean upPartIfContained(int page, RectF pageRelativeBounds, float renderWidth, int toOrder,
+                                     boolean draftAccepted) {
+        PartKey key = new PartKey(page, pageRelativeBounds, Math.round(renderWidth));
 
-        PagePart found;
         synchronized (passiveActiveLock) {
-            if ((found = find(passiveCache, fakePart)) != null) {
-                passiveCache.remove(found);
-                found.setCacheOrder(toOrder);
-                activeCache.offer(found);
-                return true;
+            CachedPart found = index.get(key);
+            if (found == null) {
+                return false;
             }
 
-            return find(activeCache, fakePart) != null;
+            if (passiveCache.remove(found)) {
+                found.part.setCacheOrder(toOrder);
+                activeCache.add(found);
+            }
+            return draftAccepted || !found.part.isDraft();
         }
     }
 
@@ -124,32 +237,17 @@ class CacheManager {
     }
 
     /**
-     * Add part if it doesn't exist, recycle bitmap otherwise
+     * Snapshot of all cached parts, passive ones first so active parts are drawn over them
      */
-    private void addWithoutDuplicates(Collection<PagePart> collection, PagePart newPart) {
-        for (PagePart part : collection) {
-            if (part.equals(newPart)) {
-                newPart.getRenderedBitmap().recycle();
-                return;
-            }
-        }
-        collection.add(newPart);
-    }
-
-    @Nullable
-    private static PagePart find(PriorityQueue<PagePart> vector, PagePart fakePart) {
-        for (PagePart part : vector) {
-            if (part.equals(fakePart)) {
-                return part;
-            }
-        }
-        return null;
-    }
-
     public List<PagePart> getPageParts() {
         synchronized (passiveActiveLock) {
-            List<PagePart> parts = new ArrayList<>(passiveCache);
-            parts.addAll(activeCache);
+            List<PagePart> parts = new ArrayList<>(passiveCache.size() + activeCache.size());
+            for (CachedPart cached : passiveCache) {
+                parts.add(cached.part);
+            }
+            for (CachedPart cached : activeCache) {
+                parts.add(cached.part);
+            }
             return parts;
         }
     }
@@ -160,32 +258,110 @@ class CacheManager {
         }
     }
 
+    /** Memory taken by cached page parts */
+    public long getUsedBytes() {
+        synchronized (passiveActiveLock) {
+            return usedBytes;
+        }
+    }
+
+    /** Drop all parts and thumbnails, their bitmaps go to the pool */
     public void recycle() {
         synchronized (passiveActiveLock) {
-            for (PagePart part : passiveCache) {
-                part.getRenderedBitmap().recycle();
+            for (CachedPart cached : index.values()) {
+                bitmapPool.release(cached.part.getRenderedBitmap());
             }
+            index.clear();
             passiveCache.clear();
-            for (PagePart part : activeCache) {
-                part.getRenderedBitmap().recycle();
-            }
             activeCache.clear();
+            usedBytes = 0;
         }
         synchronized (thumbnails) {
             for (PagePart part : thumbnails) {
-                part.getRenderedBitmap().recycle();
+                bitmapPool.release(part.getRenderedBitmap());
             }
             thumbnails.clear();
         }
     }
 
-    class PagePartComparator implements Comparator<PagePart> {
+    /** Identifies a part by page, bounds and the width it is rendered at, which stands for zoom */
+    private static class PartKey {
+        final int page;
+        final float left, top, right, bottom;
+        final int width;
+
+        PartKey(int page, RectF bounds, int width) {
+            this.page = page;
+            this.left = bounds.left;
+            this.top = bounds.top;
+            this.right = bounds.right;
+            this.bottom = bounds.bottom;
+            this.width = width;
+        }
+
         @Override
-        public int compare(PagePart part1, PagePart part2) {
-            if (part1.getCacheOrder() == part2.getCacheOrder()) {
-                return 0;
+        public boolean equals(Object obj) {
+            if (!(obj instanceof PartKey)) {
+                return false;
             }
-            return part1.getCacheOrder() > part2.getCacheOrder() ? 1 : -1;
+
+            PartKey key = (PartKey) obj;
+            return key.page == page
+                    && key.width == width
+                    && key.left == left
+                    && key.top == top
+                    && key.right == right
+                    && key.bottom == bottom;
+        }
+
+        @Override
+        public int hashCode() {
+            int result = page;
+            result = 31 * result + width;
+            result = 31 * result + Float.floatToIntBits(left);
+            result = 31 * result + Float.floatToIntBits(top);
+            result = 31 * result + Float.floatToIntBits(right);
+            result = 31 * result + Float.floatToIntBits(bottom);
+            return result;
+        }
+    }
+
+    private static class CachedPart {
+        final PagePart part;
+        final PartKey key;
+        final long bytes;
+        /** Cost of rendering the part again per byte it takes */
+        final double costPerByte;
+        /** Evicted when lowest among older parts */
+        double credit;
+        /** Insertion order, breaks ties so distinct parts never compare equal */
+        final long sequence;
+
+        CachedPart(PagePart part, float pageCost, long sequence) {
+            this.part = part;
+            this.sequence = sequence;
+            RectF bounds = part.getPageRelativeBounds();
+            key = new PartKey(part.getPage(), bounds, part.getRenderedBitmap().getWidth());
+            bytes = part.getRenderedBitmap().getAllocationByteCount();
+            float renderCost = MIN_RENDER_COST + pageCost * bounds.width() * bounds.height();
+            costPerByte = (double) renderCost / Math.max(bytes, 1);
+        }
+    }
+
+    private static class CreditComparator implements Comparator<CachedPart> {
+        @Override
+        public int compare(CachedPart part1, CachedPart part2) {
+            int result = Double.compare(part1.credit, part2.credit);
+            return result != 0 ? result : Long.compare(part1.sequence, part2.sequence);
+        }
+    }
+
+    private static class OrderComparator implements Comparator<CachedPart> {
+        @Override
+        public int compare(CachedPart part1, CachedPart part2) {
+            // Highest order first, it is the farthest from the visible area
+            int result = Integer.compare(part2.part.getCacheOrder(), part1.part.getCacheOrder());
+            return result != 0 ? result : Long.compare(part1.sequence, part2.sequence);
         }
     }
 
@@ -18,10 +18,14 @@ package com.github.barteksc.pdfviewer;
 import android.os.AsyncTask;
 
 import com.github.barteksc.pdfviewer.source.DocumentSource;
+import com.github.barteksc.pdfviewer.source.FileSource;
+import com.github.barteksc.pdfviewer.util.Constants;
+import com.shockwave.pdfium.DocumentIndex;
 import com.shockwave.pdfium.PdfDocument;
 import com.shockwave.pdfium.PdfiumCore;
 import com.shockwave.pdfium.util.Size;
 
+import java.io.File;
 import java.lang.ref.WeakReference;
 
 class DecodingAsyncTask extends AsyncTask<Void, Void, Throwable> {
@@ -35,6 +39,8 @@ class DecodingAsyncTask extends AsyncTask<Void, Void, Throwable> {
     private DocumentSource docSource;
     private int[] userPages;
     private PdfFile pdfFile;
+    private File indexFile;
+    private byte[] indexKey;
 
     DecodingAsyncTask(DocumentSource docSource, String password, int[] userPages, PDFView pdfView, PdfiumCore pdfiumCore) {
         this.docSource = docSource;
@@ -51,9 +57,21 @@ class DecodingAsyncTask extends AsyncTask<Void, Void, Throwable> {
             PDFView pdfView = pdfViewReference.get();
             if (pdfView != null) {
                 PdfDocument pdfDocument = docSource.createDocument(pdfView.getContext(), pdfiumCore, password);
-                pdfFile = new PdfFile(pdfiumCore, pdfDocument, pdfView.getPageFitPolicy(), getViewSize(pdfView),
-                        userPages, pdfView.isSwipeVertical(), pdfView.getSpacingPx(), pdfView.isAutoSpacingEnabled(),
-                        pdfView.isFitEachPage());
+                byte[] documentKey = null;
+                if ((pdfView.isDocumentIndexEnabled() || pdfView.isDiskCacheEnabled()) && !pdfDocument.isProgressive()) {
+                    documentKey = createDocumentKey(pdfDocument);
+                }
+                DocumentIndex documentIndex = null;
+                if (pdfView.isDocumentIndexEnabled() && documentKey != null) {
+                    documentIndex = openDocumentIndex(pdfView, pdfDocument, documentKey);
+                }
+                pdfFile = new PdfFile(pdfiumCore, pdfDocument, documentIndex, pdfView.getPageFitPolicy(),
+                        getViewSize(pdfView), userPages, pdfView.isSwipeVertical(), pdfView.getSpacingPx(),
+                        pdfView.isAutoSpacingEnabled(), pdfView.isFitEachPage(), pdfView.isGrayscaleRendering());
+                if (pdfView.isDiskCacheEnabled() && documentKey != null) {
+                    File dir = new File(pdfView.getContext().getCacheDir(), Constants.Cache.TILE_CACHE_DIR);
+                    pdfFile.setDiskCache(DiskTileCache.open(pdfiumCore, dir, documentKey, Constants.Cache.DISK_CACHE_SIZE));
+                }
                 return null;
             } else {
                 return new NullPointerException("pdfView == null");
@@ -64,6 +82,30 @@ class DecodingAsyncTask extends AsyncTask<Void, Void, Throwable> {
         }
     }
 
+    /**
+     * Fingerprint of the document identifying its index and stored parts, null if it can't be told
+     * apart from other documents
+     */
+    private byte[] createDocumentKey(PdfDocument pdfDocument) {
+        long lastModified = docSource instanceof FileSource ? ((FileSource) docSource).getFile().lastModified() : 0;
+        return DocumentIndex.createKey(pdfiumCore, pdfDocument, lastModified);
+    }
+
+    /**
+     * Open index of the document, if it's not indexed yet remember where to write the index
+     */
+    private DocumentIndex openDocumentIndex(PDFView pdfView, PdfDocument pdfDocument, byte[] key) {
+        File dir = new File(pdfView.getContext().getCacheDir(), Constants.Cache.DOCUMENT_INDEX_DIR);
+        File file = new File(dir, DocumentIndex.getFileName(key));
+        DocumentIndex index = DocumentIndex.open(file, key);
+        if (index != null && index.getPageCount() == pdfiumCore.getPageCount(pdfDocument)) {
+            return index;
+        }
+        indexFile = file;
+        indexKey = key;
+        return null;
+    }
+
     private Size getViewSize(PDFView pdfView) {
         return new Size(pdfView.getWidth(), pdfView.getHeight());
     }
@@ -73,17 +115,32 @@ class DecodingAsyncTask extends AsyncTask<Void, Void, Throwable> {
         PDFView pdfView = pdfViewReference.get();
         if (pdfView != null) {
             if (t != null) {
+                disposePdfFile();
                 pdfView.loadError(t);
                 return;
             }
             if (!cancelled) {
+                if (indexFile != null) {
+                    pdfFile.startIndexing(indexFile, indexKey);
+                }
                 pdfView.loadComplete(pdfFile);
+                return;
             }
         }
+        disposePdfFile();
     }
 
     @Override
     protected void onCancelled() {
         cancelled = true;
+        // Runs after doInBackground, nobody else gets the document and its caches
+        disposePdfFile();
+    }
+
+    private void disposePdfFile() {
+        if (pdfFile != null) {
+            pdfFile.dispose();
+            pdfFile = null;
+        }
     }
 }
@@ -0,0 +1,834 @@
+/**
+ * Copyright 2016 Bartosz Schiller
+ * <p/>
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * <p/>
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * <p/>
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package com.github.barteksc.pdfviewer;
+
+import android.graphics.Bitmap;
+import android.graphics.RectF;
+import android.os.Handler;
+import android.os.HandlerThread;
+import android.os.SystemClock;
+import android.util.Log;
+import android.util.SparseArray;
+import android.util.SparseBooleanArray;
+
+import com.shockwave.pdfium.ColorScheme;
+import com.shockwave.pdfium.DocumentIndex;
+import com.shockwave.pdfium.PdfiumCore;
+
+import java.io.File;
+import java.io.IOException;
+import java.io.RandomAccessFile;
+import java.nio.ByteBuffer;
+import java.nio.MappedByteBuffer;
+import java.nio.channels.FileChannel;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.Collections;
+import java.util.Comparator;
+import java.util.HashMap;
+import java.util.HashSet;
+import java.util.Iterator;
+import java.util.List;
+import java.util.Map;
+import java.util.Set;
+import java.util.zip.CRC32;
+
+/**
+ * Rendered parts and thumbnails of a document kept compressed in the app cache dir, so reopening
+ * the document paints its pages without rendering, or even parsing, them. Records are appended to
+ * segment files of the document, which are memory mapped for reading, and written on a background
+ * thread so rendering doesn't wait for the disk. Every record carries a checksum, a record torn by a
+ * crash is dropped when it's read or when the segment is scanned. Least recently used segments of
+ * all documents are deleted once they exceed the budget.<br>
+ * Render costs and colorless state of pages are stored too, so parts are laid out and configured
+ * as they were rendered before the page is opened.
+ */
+class DiskTileCache {
+
+    private static final String TAG = DiskTileCache.class.getName();
+
+    private static final int MAGIC = 0x50445443; // "PDTC"
+
+    private static final int VERSION = 2;
+
+    private static final String SEGMENT_SUFFIX = ".tiles";
+
+    /** Record types, every record is its type, length of its body and the body */
+    private static final int TILE_RECORD = 0x54494C45; // "TILE"
+    private static final int PAGE_RECORD = 0x50414745; // "PAGE"
+
+    private static final int RECORD_HEADER_SIZE = 4 + 4;
+
+    /** Page, bounds, bitmap size, config, flags and colors */
+    private static final int KEY_SIZE = 4 + 4 * 4 + 4 + 4 + 1 + 1 + 5 * 4;
+
+    /** Page, render cost, colorless state and CRC32 of them */
+    private static final int PAGE_INFO_SIZE = 4 + 4 + 1 + 4;
+
+    /** Colorless states of page records */
+    private static final byte PAGE_COLORED = 0;
+    private static final byte PAGE_COLORLESS_WITH_ANNOTATIONS = 1;
+    private static final byte PAGE_COLORLESS = 2;
+
+    private static final int FLAG_THUMBNAIL = 1;
+    private static final int FLAG_ANNOTATIONS = 1 << 1;
+    private static final int FLAG_COLOR_SCHEME = 1 << 2;
+
+    /** Records are appended to a segment until it reaches this size, then a new one is started */
+    private static final int SEGMENT_SIZE = 4 * 1024 * 1024;
+
+    /** Compressed tiles waiting to be written may take this much, further tiles aren't stored */
+    private static final long MAX_PENDING_BYTES = 8 * 1024 * 1024;
+
+    /** Written records are synced and the budget enforced this long after the last write */
+    private static final long FLUSH_DELAY_MILLIS = 1000;
+
+    /** Segments read from are marked as recently used at most this often */
+    private static final long TOUCH_INTERVAL_MILLIS = 60 * 1000;
+
+    /** Segments being appended to by any cache, so two views of the same document don't append to the same one */
+    private static final Set<File> writtenSegments = new HashSet<>();
+
+    private static class Segment {
+        final File file;
+        /** Bytes of complete records, guarded by the cache */
+        int length;
+        /** Mapping of the file, mapped again when records past its end are read */
+        MappedByteBuffer buffer;
+        /** Last time the segment was marked as used, in {@link SystemClock#uptimeMillis()} */
+        long touched;
+
+        Segment(File file) {
+            this.file = file;
+        }
+    }
+
+    private static class Entry {
+        final Segment segment;
+        final int offset;
+        final int length;
+
+        Entry(Segment segment, int offset, int length) {
+            this.segment = segment;
+            this.offset = offset;
+            this.length = length;
+        }
+    }
+
+    /** Identifies a rendered tile of a document page */
+    private static final class Key {
+        final int page;
+        final float left, top, right, bottom;
+        final int width, height;
+        final byte config;
+        final byte flags;
+        final int[] colors;
+
+        Key(int page, RectF bounds, int width, int height, byte config, int flags, int[] colors) {
+            this.page = page;
+            this.left = bounds.left;
+            this.top = bounds.top;
+            this.right = bounds.right;
+            this.bottom = bounds.bottom;
+            this.width = width;
+            this.height = height;
+            this.config = config;
+            this.flags = (byte) flags;
+            this.colors = colors;
+        }
+
+        Key(ByteBuffer buffer) {
+            page = buffer.getInt();
+            left = buffer.getFloat();
+            top = buffer.getFloat();
+            right = buffer.getFloat();
+            bottom = buffer.getFloat();
+            width = buffer.getInt();
+            height = buffer.getInt();
+            config = buffer.get();
+            flags = buffer.get();
+            colors = new int[5];
+            for (int i = 0; i < colors.length; i++) {
+                colors[i] = buffer.getInt();
+            }
+        }
+
+        void write(ByteBuffer buffer) {
+            buffer.putInt(page)
+                    .putFloat(left).putFloat(top).putFloat(right).putFloat(bottom)
+                    .putInt(width).putInt(height)
+                    .put(config).put(flags);
+            for (int color : colors) {
+                buffer.putInt(color);
+            }
+        }
+
+        @Override
+        public boolean equals(Object obj) {
+            if (!(obj instanceof Key)) {
+                return false;
+            }
+            Key other = (Key) obj;
+            return page == other.page
+                    && left == other.left && top == other.top && right == other.right && bottom == other.bottom
+                    && width == other.width && height == other.height
+                    && config == other.config && flags == other.flags
+                    && Arrays.equals(colors, other.colors);
+        }
+
+        @Override
+        public int hashCode() {
+            int hash = page;
+            hash = hash * 31 + Float.floatToIntBits(left);
+            hash = hash * 31 + Float.floatToIntBits(top);
+            hash = hash * 31 + Float.floatToIntBits(right);
+            hash = hash * 31 + Float.floatToIntBits(bottom);
+            hash = hash * 31 + width;
+            hash = hash * 31 + height;
+            hash = hash * 31 + config;
+            hash = hash * 31 + flags;
+            return hash * 31 + Arrays.hashCode(colors);
+        }
+    }
+
+    private final PdfiumCore pdfiumCore;
+    private final File dir;
+    private final byte[] documentKey;
+    /** Segments of this document are named prefix.number.tiles */
+    private final String prefix;
+    private final long maxBytes;
+
+    /** Guarded by this */
+    private final Map<Key, Entry> entries = new HashMap<>();
+    private final List<Segment> segments = new ArrayList<>();
+    private final Set<Key> pendingKeys = new HashSet<>();
+    private long pendingBytes;
+    private int nextSegment;
+    private boolean closed;
+
+    /** Stored state of pages, guarded by this */
+    private final SparseArray<Float> pageCosts = new SparseArray<>();
+    private final SparseArray<Byte> pageColorStates = new SparseArray<>();
+
+    /** Started on the first write, so a cache only read from, or closed unused, has no thread. Guarded by this */
+    private HandlerThread writerThread;
+    private Handler writer;
+
+    /** Segment being appended to, used on the writer thread only */
+    private Segment output;
+    private RandomAccessFile outputFile;
+    private boolean flushScheduled;
+
+    private final Runnable flush = new Runnable() {
+        @Override
+        public void run() {
+            flushScheduled = false;
+            sync();
+            trim();
+        }
+    };
+
+    private DiskTileCache(PdfiumCore pdfiumCore, File dir, byte[] documentKey, long maxBytes) {
+        this.pdfiumCore = pdfiumCore;
+        this.dir = dir;
+        this.documentKey = documentKey;
+        String name = DocumentIndex.getFileName(documentKey);
+        this.prefix = name.substring(0, name.lastIndexOf('.'));
+        this.maxBytes = maxBytes;
+    }
+
+    /**
+     * Index stored records of the document, segments that are corrupted or of other versions are
+     * deleted. Reads the segments, so it should be called off the main thread
+     *
+     * @param documentKey key of the document, see {@link DocumentIndex#createKey}
+     * @param maxBytes    size segments of all documents may take
+     */
+    static DiskTileCache open(PdfiumCore pdfiumCore, File dir, byte[] documentKey, long maxBytes) {
+        DiskTileCache cache = new DiskTileCache(pdfiumCore, dir, documentKey, maxBytes);
+        cache.scanSegments();
+        return cache;
+    }
+
+    /** Add stored render costs and colorless state of pages, see {@link PdfFile#openPage(int)} */
+    synchronized void loadPageInfo(SparseArray<Float> costs, SparseBooleanArray colorlessPages) {
+        for (int i = 0; i < pageCosts.size(); i++) {
+            costs.put(pageCosts.keyAt(i), pageCosts.valueAt(i));
+        }
+        for (int i = 0; i < pageColorStates.size(); i++) {
+            byte state = pageColorStates.valueAt(i);
+            if (state != PAGE_COLORED) {
+                colorlessPages.put(pageColorStates.keyAt(i), state == PAGE_COLORLESS);
+            }
+        }
+    }
+
+    /**
+     * Store render cost and colorless state of an opened page, unless they're stored already
+     *
+     * @param colorless     whether the page has only gray content
+     * @param noAnnotations whether a colorless page has no annotations
+     */
+    void storePageInfo(final int docPage, final float cost, boolean colorless, boolean noAnnotations) {
+        final byte state = !colorless ? PAGE_COLORED : noAnnotations ? PAGE_COLORLESS : PAGE_COLORLESS_WITH_ANNOTATIONS;
+        synchronized (this) {
+            Float storedCost = pageCosts.get(docPage);
+            Byte storedState = pageColorStates.get(docPage);
+            if (closed || (storedCost != null && storedCost == cost && storedState != null && storedState == state)) {
+                return;
+            }
+            pageCosts.put(docPage, cost);
+            pageColorStates.put(docPage, state);
+        }
+        post(new Runnable() {
+            @Override
+            public void run() {
+                ByteBuffer record = ByteBuffer.allocate(RECORD_HEADER_SIZE + PAGE_INFO_SIZE);
+                record.putInt(PAGE_RECORD).putInt(PAGE_INFO_SIZE).putInt(docPage).putFloat(cost).put(state);
+                record.putInt(pageInfoChecksum(record.array(), RECORD_HEADER_SIZE));
+                record.flip();
+                append(record, null, null);
+            }
+        });
+    }
+
+    /**
+     * Decompress the stored tile into the bitmap
+     *
+     * @param docPage     page of the document
+     * @param bounds      part of the page the tile shows
+     * @param colorScheme colors the tile was rendered in, null for the page colors
+     * @return false if the tile isn't stored or is corrupted
+     */
+    boolean read(int docPage, RectF bounds, boolean thumbnail, boolean annotations, ColorScheme colorScheme,
+                 Bitmap bitmap) {
+        Key key = createKey(docPage, bounds, thumbnail, annotations, colorScheme, bitmap);
+        if (key == null) {
+            return false;
+        }
+
+        ByteBuffer data;
+        synchronized (this) {
+            Entry entry = entries.get(key);
+            if (entry == null) {
+                return false;
+            }
+            ByteBuffer buffer = map(entry.segment, entry.offset + entry.length);
+            if (buffer == null) {
+                return false;
+            }
+            data = buffer.duplicate();
+            data.limit(entry.offset + entry.length).position(entry.offset);
+            touch(entry.segment);
+        }
+
+        if (pdfiumCore.decompressTile(data, bitmap)) {
+            return true;
+        }
+        Log.w(TAG, "Stored tile of page " + docPage + " is corrupted");
+        synchronized (this) {
+            entries.remove(key);
+        }
+        return false;
+    }
+
+    /**
+     * Compress the tile and write it in background, unless it's stored already or too many tiles
+     * are waiting to be written
+     *
+     * @see #read(int, RectF, boolean, boolean, ColorScheme, Bitmap)
+     */
+    void write(int docPage, RectF bounds, boolean thumbnail, boolean annotations, ColorScheme colorScheme,
+               Bitmap bitmap) {
+        final Key key = createKey(docPage, bounds, thumbnail, annotations, colorScheme, bitmap);
+        if (key == null) {
+            return;
+        }
+        synchronized (this) {
+            if (closed || pendingBytes >= MAX_PENDING_BYTES || entries.containsKey(key) || pendingKeys.contains(key)) {
+                return;
+            }
+            pendingKeys.add(key);
+        }
+
+        final byte[] data = pdfiumCore.compressTile(bitmap);
+        if (data == null) {
+            synchronized (this) {
+                pendingKeys.remove(key);
+            }
+            return;
+        }
+        synchronized (this) {
+            pendingBytes += data.length;
+        }
+
+        boolean posted = post(new Runnable() {
+            @Override
+            public void run() {
+                ByteBuffer header = ByteBuffer.allocate(RECORD_HEADER_SIZE + KEY_SIZE);
+                header.putInt(TILE_RECORD).putInt(KEY_SIZE + data.length);
+                key.write(header);
+                header.flip();
+                append(header, ByteBuffer.wrap(data), key);
+                synchronized (DiskTileCache.this) {
+                    pendingKeys.remove(key);
+                    pendingBytes -= data.length;
+                }
+            }
+        });
+        if (!posted) {
+            synchronized (this) {
+                pendingKeys.remove(key);
+                pendingBytes -= data.length;
+            }
+        }
+    }
+
+    /** Stop writing, tiles waiting to be written are written first. The cache can't be used afterwards */
+    synchronized void close() {
+        if (closed) {
+            return;
+        }
+        closed = true;
+        entries.clear();
+        if (writer == null) {
+            return;
+        }
+        writer.post(new Runnable() {
+            @Override
+            public void run() {
+                closeOutput();
+            }
+        });
+        writerThread.quitSafely();
+    }
+
+    /**
+     * Run on the writer thread, started by the first call
+     *
+     * @return false if the cache is closed
+     */
+    private synchronized boolean post(Runnable runnable) {
+        if (closed) {
+            return false;
+        }
+        if (writer == null) {
+            writerThread = new HandlerThread("PDF tile writer");
+            writerThread.setPriority(Thread.MIN_PRIORITY);
+            writerThread.start();
+            writer = new Handler(writerThread.getLooper());
+        }
+        return writer.post(runnable);
+    }
+
+    private static int pageInfoChecksum(byte[] record, int offset) {
+        CRC32 crc = new CRC32();
+        crc.update(record, offset, PAGE_INFO_SIZE - 4);
+        return (int) crc.getValue();
+    }
+
+    private static Key createKey(int docPage, RectF bounds, boolean thumbnail, boolean annotations,
+                                 ColorScheme colorScheme, Bitmap bitmap) {
+        byte config;
+        switch (bitmap.getConfig()) {
+            case ARGB_8888:
+                config = 1;
+                break;
+            case RGB_565:
+                config = 2;
+                break;
+            case ALPHA_8:
+                config = 3;
+                break;
+            default:
+                return null;
+        }
+        int flags = (thumbnail ? FLAG_THUMBNAIL : 0) | (annotations ? FLAG_ANNOTATIONS : 0);
+        int[] colors = new int[5];
+        if (colorScheme != null) {
+            flags |= FLAG_COLOR_SCHEME;
+            colors[0] = colorScheme.getBackground();
+            colors[1] = colorScheme.getPathFill();
+            colors[2] = colorScheme.getPathStroke();
+            colors[3] = colorScheme.getTextFill();
+            colors[4] = colorScheme.getTextStroke();
+        }
+        return new Key(docPage, bounds, bitmap.getWidth(), bitmap.getHeight(), config, flags, colors);
+    }
+
+    private ByteBuffer createSegmentHeader() {
+        ByteBuffer header = ByteBuffer.allocate(4 + 4 + 4 + documentKey.length);
+        header.putInt(MAGIC).putInt(VERSION).putInt(documentKey.length).put(documentKey);
+        header.flip();
+        return header;
+    }
+
+    private void scanSegments() {
+        File[] files = dir.listFiles();
+        if (files == null) {
+            return;
+        }
+        List<Integer> numbers = new ArrayList<>();
+        for (File file : files) {
+            String name = file.getName();
+            if (!name.startsWith(prefix + ".") || !name.endsWith(SEGMENT_SUFFIX)) {
+                continue;
+            }
+            try {
+                numbers.add(Integer.parseInt(name.substring(prefix.length() + 1, name.length() - SEGMENT_SUFFIX.length())));
+            } catch (NumberFormatException e) {
+                // Not a segment
+            }
+        }
+        Collections.sort(numbers);
+
+        for (int number : numbers) {
+            Segment segment = new Segment(segmentFile(number));
+            synchronized (this) {
+                nextSegment = number + 1;
+            }
+            synchronized (writtenSegments) {
+                if (writtenSegments.contains(segment.file)) {
+                    // Being appended to by another view, its records are read next time
+                    continue;
+                }
+            }
+            try {
+                if (scan(segment)) {
+                    synchronized (this) {
+                        segments.add(segment);
+                    }
+                    continue;
+                }
+            } catch (IOException e) {
+                Log.e(TAG, "Cannot read tile segment " + segment.file, e);
+            }
+            segment.file.delete();
+        }
+    }
+
+    /**
+     * Index records of the segment, a torn record at its end is cut off
+     *
+     * @return false if the segment isn't valid
+     */
+    private boolean scan(Segment segment) throws IOException {
+        RandomAccessFile file = new RandomAccessFile(segment.file, "rw");
+        try {
+            long size = file.length();
+            if (size > Integer.MAX_VALUE) {
+                return false;
+            }
+            MappedByteBuffer buffer = file.getChannel().map(FileChannel.MapMode.READ_ONLY, 0, size);
+            ByteBuffer header = createSegmentHeader();
+            if (buffer.remaining() < header.remaining()) {
+                return false;
+            }
+            ByteBuffer stored = buffer.duplicate();
+            stored.limit(header.remaining());
+            if (!stored.equals(header)) {
+                return false;
+            }
+            buffer.position(header.remaining());
+
+            int end = buffer.position();
+            Map<Key, Entry> found = new HashMap<>();
+            SparseArray<Float> costs = new SparseArray<>();
+            SparseArray<Byte> colorStates = new SparseArray<>();
+            while (buffer.remaining() >= RECORD_HEADER_SIZE) {
+                int type = buffer.getInt();
+                int length = buffer.getInt();
+                if (length < 0 || length > buffer.remaining()) {
+                    break;
+                }
+                int next = buffer.position() + length;
+                if (type == TILE_RECORD && length >= KEY_SIZE) {
+                    Key key = new Key(buffer);
+                    found.put(key, new Entry(segment, buffer.position(), next - buffer.position()));
+                } else if (type == PAGE_RECORD && length == PAGE_INFO_SIZE) {
+                    byte[] body = new byte[PAGE_INFO_SIZE];
+                    buffer.get(body);
+                    ByteBuffer info = ByteBuffer.wrap(body);
+                    int page = info.getInt();
+                    float cost = info.getFloat();
+                    byte state = info.get();
+                    if (info.getInt() == pageInfoChecksum(body, 0)) {
+                        costs.put(page, cost);
+                        colorStates.put(page, state);
+                    } else {
+                        Log.w(TAG, "Stored state of page " + page + " is corrupted");
+                    }
+                } else {
+                    break;
+                }
+                buffer.position(next);
+                end = next;
+            }
+
+            if (end < size) {
+                Log.w(TAG, "Cutting off torn records of tile segment " + segment.file);
+                file.setLength(end);
+            }
+            segment.length = end;
+            segment.buffer = buffer;
+            segment.touched = SystemClock.uptimeMillis();
+            synchronized (this) {
+                // Records of later segments replace earlier ones
+                entries.putAll(found);
+                for (int i = 0; i < costs.size(); i++) {
+                    pageCosts.put(costs.keyAt(i), costs.valueAt(i));
+                    pageColorStates.put(colorStates.keyAt(i), colorStates.valueAt(i));
+                }
+            }
+            return true;
+        } finally {
+            file.close();
+        }
+    }
+
+    private File segmentFile(int number) {
+        return new File(dir, prefix + "." + number + SEGMENT_SUFFIX);
+    }
+
+    /** Mapping of the segment covering end, caller holds the lock */
+    private ByteBuffer map(Segment segment, int end) {
+        if (segment.buffer != null && segment.buffer.capacity() >= end) {
+            return segment.buffer;
+        }
+        try {
+            RandomAccessFile file = new RandomAccessFile(segment.file, "r");
+            try {
+                segment.buffer = file.getChannel().map(FileChannel.MapMode.READ_ONLY, 0, segment.length);
+            } finally {
+                file.close();
+            }
+            return segment.buffer;
+        } catch (IOException e) {
+            // Deleted to fit the budget
+            forget(segment);
+            return null;
+        }
+    }
+
+    /** Mark the segment as recently used so it's deleted last, caller holds the lock */
+    private void touch(final Segment segment) {
+        long now = SystemClock.uptimeMillis();
+        if (now - segment.touched < TOUCH_INTERVAL_MILLIS) {
+            return;
+        }
+        segment.touched = now;
+        post(new Runnable() {
+            @Override
+            public void run() {
+                segment.file.setLastModified(System.currentTimeMillis());
+            }
+        });
+    }
+
+    /** Drop records of a deleted segment, caller holds the lock */
+    private void forget(Segment segment) {
+        segments.remove(segment);
+        Iterator<Entry> iterator = entries.values().iterator();
+        while (iterator.hasNext()) {
+            if (iterator.next().segment == segment) {
+                iterator.remove();
+            }
+        }
+    }
+
+    /**
+     * Append the record on the writer thread, tile records are indexed once written
+     *
+     * @param payload rest of the record, may be null
+     * @param key     key of a tile record, null for other records
+     */
+    private void append(ByteBuffer header, ByteBuffer payload, Key key) {
+        int recordSize = header.remaining() + (payload != null ? payload.remaining() : 0);
+        try {
+            Segment segment = openOutput(recordSize);
+            FileChannel channel = outputFile.getChannel();
+            ByteBuffer[] buffers = payload != null ? new ByteBuffer[]{header, payload} : new ByteBuffer[]{header};
+            while (buffers[buffers.length - 1].hasRemaining()) {
+                channel.write(buffers);
+            }
+            synchronized (this) {
+                if (key != null && !closed) {
+                    int offset = segment.length + RECORD_HEADER_SIZE + KEY_SIZE;
+                    entries.put(key, new Entry(segment, offset, recordSize - RECORD_HEADER_SIZE - KEY_SIZE));
+                }
+                segment.length += recordSize;
+            }
+        } catch (IOException e) {
+            Log.e(TAG, "Cannot write tile", e);
+            // The segment may end with a torn record, append to a new one
+            closeOutput();
+            return;
+        }
+
+        if (!flushScheduled) {
+            flushScheduled = true;
+            writer.postDelayed(flush, FLUSH_DELAY_MILLIS);
+        }
+    }
+
+    /** Segment the record fits in, a new one when the last one is full or written by another cache */
+    private Segment openOutput(int recordSize) throws IOException {
+        if (output != null) {
+            if (output.length + recordSize <= SEGMENT_SIZE) {
+                return output;
+            }
+            closeOutput();
+        }
+
+        Segment last;
+        synchronized (this) {
+            last = segments.isEmpty() ? null : segments.get(segments.size() - 1);
+        }
+        if (last != null && last.length + recordSize <= SEGMENT_SIZE && claim(last.file)) {
+            RandomAccessFile file = new RandomAccessFile(last.file, "rw");
+            // Another view may have appended to it since it was scanned
+            if (file.length() == last.length) {
+                file.seek(last.length);
+                output = last;
+                outputFile = file;
+                return output;
+            }
+            file.close();
+            release(last.file);
+        }
+
+        Segment segment;
+        do {
+            synchronized (this) {
+                segment = new Segment(segmentFile(nextSegment++));
+            }
+        } while (segment.file.exists() || !claim(segment.file));
+        dir.mkdirs();
+        RandomAccessFile file = new RandomAccessFile(segment.file, "rw");
+        try {
+            ByteBuffer header = createSegmentHeader();
+            file.setLength(0);
+            while (header.hasRemaining()) {
+                file.getChannel().write(header);
+            }
+        } catch (IOException e) {
+            file.close();
+            release(segment.file);
+            throw e;
+        }
+        segment.touched = SystemClock.uptimeMillis();
+        synchronized (this) {
+            segment.length = (int) file.length();
+            segments.add(segment);
+        }
+        output = segment;
+        outputFile = file;
+        return output;
+    }
+
+    private void sync() {
+        if (outputFile == null) {
+            return;
+        }
+        try {
+            outputFile.getChannel().force(false);
+        } catch (IOException e) {
+            Log.e(TAG, "Cannot sync tile segment", e);
+        }
+    }
+
+    private void closeOutput() {
+        if (outputFile == null) {
+            return;
+        }
+        sync();
+        try {
+            outputFile.close();
+        } catch (IOException e) {
+            // Already synced
+        }
+        release(output.file);
+        outputFile = null;
+        output = null;
+    }
+
+    /** Delete least recently used segments of all documents over the budget, on the writer thread */
+    private void trim() {
+        File[] files = dir.listFiles();
+        if (files == null) {
+            return;
+        }
+        List<File> tileFiles = new ArrayList<>();
+        List<Long> lastModified = new ArrayList<>();
+        long total = 0;
+        for (File file : files) {
+            if (file.getName().endsWith(SEGMENT_SUFFIX)) {
+                tileFiles.add(file);
+                // Read once, sorting must not see it change
+                lastModified.add(file.lastModified());
+                total += file.length();
+            }
+        }
+        if (total <= maxBytes) {
+            return;
+        }
+
+        Integer[] order = new Integer[tileFiles.size()];
+        for (int i = 0; i < order.length; i++) {
+            order[i] = i;
+        }
+        final List<Long> times = lastModified;
+        Arrays.sort(order, new Comparator<Integer>() {
+            @Override
+            public int compare(Integer a, Integer b) {
+                return times.get(a).compareTo(times.get(b));
+            }
+        });
+
+        for (int i = 0; i < order.length && total > maxBytes; i++) {
+            File file = tileFiles.get(order[i]);
+            synchronized (writtenSegments) {
+                if (writtenSegments.contains(file)) {
+                    continue;
+                }
+            }
+            long length = file.length();
+            if (!file.delete()) {
+                continue;
+            }
+            total -= length;
+            synchronized (this) {
+                for (Segment segment : new ArrayList<>(segments)) {
+                    if (segment.file.equals(file)) {
+                        forget(segment);
+                    }
+                }
+            }
+        }
+    }
+
+    private static boolean claim(File file) {
+        synchronized (writtenSegments) {
+            return writtenSegments.add(file);
+        }
+    }
+
+    private static void release(File file) {
+        synchronized (writtenSegments) {
+            writtenSegments.remove(file);
+        }
+    }
+}
@@ -186,6 +186,11 @@ class DragPinchManager implements GestureDetector.OnGestureListener, GestureDete
         return true;
     }
 
+    /** Whether the user is dragging or pinching the view */
+    boolean isMoving() {
+        return scrolling || scaling;
+    }
+
     private void onScrollEnd(MotionEvent event) {
         pdfView.loadPages();
         hideHandle();
@@ -279,9 +284,9 @@ class DragPinchManager implements GestureDetector.OnGestureListener, GestureDete
 
     @Override
     public void onScaleEnd(ScaleGestureDetector detector) {
+        scaling = false;
         pdfView.loadPages();
         hideHandle();
-        scaling = false;
     }
 
     @Override
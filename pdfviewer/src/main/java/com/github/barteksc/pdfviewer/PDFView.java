@@ -15,12 +15,12 @@
  */
 package com.github.barteksc.pdfviewer;
 
+import android.app.ActivityManager;
 import android.content.Context;
+import android.content.pm.ApplicationInfo;
 import android.graphics.Bitmap;
 import android.graphics.Canvas;
 import android.graphics.Color;
-import android.graphics.ColorMatrix;
-import android.graphics.ColorMatrixColorFilter;
 import android.graphics.Paint;
 import android.graphics.Paint.Style;
 import android.graphics.PaintFlagsDrawFilter;
@@ -35,6 +35,7 @@ import android.os.HandlerThread;
 import android.util.AttributeSet;
 import android.util.Log;
 import android.widget.RelativeLayout;
+import androidx.core.util.ObjectsCompat;
 
 import com.github.barteksc.pdfviewer.exception.PageRenderingException;
 import com.github.barteksc.pdfviewer.link.DefaultLinkHandler;
@@ -53,22 +54,28 @@ import com.github.barteksc.pdfviewer.model.PagePart;
 import com.github.barteksc.pdfviewer.scroll.ScrollHandle;
 import com.github.barteksc.pdfviewer.source.AssetSource;
 import com.github.barteksc.pdfviewer.source.ByteArraySource;
+import com.github.barteksc.pdfviewer.source.ByteBufferSource;
 import com.github.barteksc.pdfviewer.source.DocumentSource;
 import com.github.barteksc.pdfviewer.source.FileSource;
 import com.github.barteksc.pdfviewer.source.InputStreamSource;
+import com.github.barteksc.pdfviewer.source.ProgressiveFileSource;
 import com.github.barteksc.pdfviewer.source.UriSource;
 import com.github.barteksc.pdfviewer.util.Constants;
 import com.github.barteksc.pdfviewer.util.FitPolicy;
 import com.github.barteksc.pdfviewer.util.MathUtils;
 import com.github.barteksc.pdfviewer.util.SnapEdge;
 import com.github.barteksc.pdfviewer.util.Util;
+import com.shockwave.pdfium.ColorScheme;
+import com.shockwave.pdfium.DataAvailability;
 import com.shockwave.pdfium.PdfDocument;
 import com.shockwave.pdfium.PdfiumCore;
+import com.shockwave.pdfium.TileCacheStats;
 import com.shockwave.pdfium.util.Size;
 import com.shockwave.pdfium.util.SizeF;
 
 import java.io.File;
 import java.io.InputStream;
+import java.nio.ByteBuffer;
 import java.util.ArrayList;
 import java.util.Collections;
 import java.util.List;
@@ -117,6 +124,9 @@ public class PDFView extends RelativeLayout {
     /** Rendered parts go to the cache manager */
     CacheManager cacheManager;
 
+    /** Bitmaps of evicted parts, reused for new ones */
+    BitmapPool bitmapPool;
+
     /** Animation manager manage all offset and zoom animation */
     private AnimationManager animationManager;
 
@@ -154,12 +164,18 @@ public class PDFView extends RelativeLayout {
     /** Async task used during the loading phase to decode a PDF document */
     private DecodingAsyncTask decodingAsyncTask;
 
+    /** Source of the document being loaded or shown */
+    private DocumentSource docSource;
+
     /** The thread {@link #renderingHandler} will run on */
     private HandlerThread renderingHandlerThread;
     /** Handler always waiting in the background and rendering tasks */
     RenderingHandler renderingHandler;
 
-    private PagesLoader pagesLoader;
+    PagesLoader pagesLoader;
+
+    /** Requests thumbnails of pages ahead of the scroll */
+    private Prefetcher prefetcher;
 
     Callbacks callbacks = new Callbacks();
 
@@ -183,10 +199,23 @@ public class PDFView extends RelativeLayout {
 
     private boolean doubletapEnabled = true;
 
-    private boolean nightMode = false;
+    /** Colors PDFium renders text, paths and page background in, null for the page colors */
+    private volatile ColorScheme colorScheme = null;
 
     private boolean pageSnap = true;
 
+    /** Persist document structure index, so reopening the same document doesn't walk it */
+    private boolean documentIndex = true;
+
+    /** Store rendered parts and thumbnails on disk, so reopening the same document paints them at once */
+    private boolean diskCache = true;
+
+    /** Render pages without color content to 8-bit bitmaps */
+    private boolean grayscaleRendering = false;
+
+    /** Render parts without anti-aliasing while the view is moving, replaced when it settles */
+    private boolean draftRendering = true;
+
     /** Pdfium core for loading and rendering PDFs */
     private PdfiumCore pdfiumCore;
 
@@ -249,10 +278,13 @@ public class PDFView extends RelativeLayout {
             return;
         }
 
-        cacheManager = new CacheManager();
+        long cacheBudget = getCacheBudget(context);
+        bitmapPool = new BitmapPool((long) (cacheBudget * Constants.Cache.BITMAP_POOL_RATIO));
+        cacheManager = new CacheManager(cacheBudget, bitmapPool);
         animationManager = new AnimationManager(this);
         dragPinchManager = new DragPinchManager(this, animationManager);
         pagesLoader = new PagesLoader(this);
+        prefetcher = new Prefetcher(this);
 
         paint = new Paint();
         debugPaint = new Paint();
@@ -273,6 +305,24 @@ public class PDFView extends RelativeLayout {
         }
 
         recycled = false;
+        this.docSource = docSource;
+        if (docSource instanceof InputStreamSource) {
+            // Pages not streamed yet are rendered once their data arrives
+            final InputStreamSource streamSource = (InputStreamSource) docSource;
+            streamSource.setOnDataAvailableListener(new Runnable() {
+                @Override
+                public void run() {
+                    post(new Runnable() {
+                        @Override
+                        public void run() {
+                            if (PDFView.this.docSource == streamSource) {
+                                loadPages();
+                            }
+                        }
+                    });
+                }
+            });
+        }
         // Start decoding document
         decodingAsyncTask = new DecodingAsyncTask(docSource, password, userPages, this, pdfiumCore);
         decodingAsyncTask.executeOnExecutor(AsyncTask.THREAD_POOL_EXECUTOR);
@@ -379,22 +429,30 @@ public class PDFView extends RelativeLayout {
     }
 
     public void setNightMode(boolean nightMode) {
-        this.nightMode = nightMode;
-        if (nightMode) {
-            ColorMatrix colorMatrixInverted =
-                    new ColorMatrix(new float[]{
-                            -1, 0, 0, 0, 255,
-                            0, -1, 0, 0, 255,
-                            0, 0, -1, 0, 255,
-                            0, 0, 0, 1, 0});
-
-            ColorMatrixColorFilter filter = new ColorMatrixColorFilter(colorMatrixInverted);
-            paint.setColorFilter(filter);
-        } else {
-            paint.setColorFilter(null);
+        setColorScheme(nightMode ? ColorScheme.NIGHT : null);
+    }
+
+    /**
+     * Render text, paths and page background in the given colors, images keep theirs. Null for the
+     * page colors
+     */
+    public void setColorScheme(ColorScheme colorScheme) {
+        if (ObjectsCompat.equals(this.colorScheme, colorScheme)) {
+            return;
+        }
+        this.colorScheme = colorScheme;
+        if (pdfFile != null && renderingHandler != null) {
+            // Cached parts have the old colors
+            cacheManager.recycle();
+            pdfFile.clearCompressedParts();
+            loadPages();
         }
     }
 
+    public ColorScheme getColorScheme() {
+        return colorScheme;
+    }
+
     void enableDoubletap(boolean enableDoubletap) {
         this.doubletapEnabled = enableDoubletap;
     }
@@ -418,14 +476,21 @@ public class PDFView extends RelativeLayout {
         // Stop tasks
         if (renderingHandler != null) {
             renderingHandler.stop();
-            renderingHandler.removeMessages(RenderingHandler.MSG_RENDER_TASK);
+            renderingHandler.removeRenderingTasks();
         }
         if (decodingAsyncTask != null) {
             decodingAsyncTask.cancel(true);
         }
+        if (docSource instanceof InputStreamSource) {
+            ((InputStreamSource) docSource).close();
+        }
+        docSource = null;
 
         // Clear caches
+        cacheManager.setPdfFile(null, null);
         cacheManager.recycle();
+        bitmapPool.clear();
+        prefetcher.reset();
 
         if (scrollHandle != null && isScrollHandleInit) {
             scrollHandle.destroyLayout();
@@ -607,7 +672,7 @@ public class PDFView extends RelativeLayout {
 
         Drawable bg = getBackground();
         if (bg == null) {
-            canvas.drawColor(nightMode ? Color.BLACK : Color.WHITE);
+            canvas.drawColor(colorScheme != null ? colorScheme.getBackground() : Color.WHITE);
         } else {
             bg.draw(canvas);
         }
@@ -723,6 +788,12 @@ public class PDFView extends RelativeLayout {
             return;
         }
 
+        if (renderedBitmap.getConfig() == Bitmap.Config.ALPHA_8) {
+            // Grayscale part holds ink coverage, cover what's below and draw the ink in the text color
+            paint.setColor(colorScheme != null ? colorScheme.getBackground() : Color.WHITE);
+            canvas.drawRect(dstRect, paint);
+            paint.setColor(colorScheme != null ? colorScheme.getTextFill() : Color.BLACK);
+        }
         canvas.drawBitmap(renderedBitmap, srcRect, dstRect, paint);
 
         if (Constants.DEBUG_MODE) {
@@ -745,14 +816,25 @@ public class PDFView extends RelativeLayout {
             return;
         }
 
-        // Cancel all current tasks
-        renderingHandler.removeMessages(RenderingHandler.MSG_RENDER_TASK);
+        // Tasks not requested again are dropped, the render in progress is kept only if still needed
+        renderingHandler.markTasksStale();
         cacheManager.makeANewSet();
 
+        // Prefetch first, so pages also loaded by the pages loader keep their priority
+        prefetcher.prefetch();
         pagesLoader.loadPages();
+        renderingHandler.removeStaleTasks();
         redraw();
     }
 
+    /** Memory for cached parts, a share of the heap the app may use */
+    private static long getCacheBudget(Context context) {
+        ActivityManager activityManager = (ActivityManager) context.getSystemService(Context.ACTIVITY_SERVICE);
+        boolean largeHeap = (context.getApplicationInfo().flags & ApplicationInfo.FLAG_LARGE_HEAP) != 0;
+        int memoryClass = largeHeap ? activityManager.getLargeMemoryClass() : activityManager.getMemoryClass();
+        return (long) (memoryClass * 1024L * 1024L * Constants.Cache.CACHE_MEMORY_RATIO);
+    }
+
     /** Called when the PDF is loaded */
     void loadComplete(PdfFile pdfFile) {
         state = State.LOADED;
@@ -769,6 +851,12 @@ public class PDFView extends RelativeLayout {
         renderingHandler = new RenderingHandler(renderingHandlerThread.getLooper(), this);
         renderingHandler.start();
 
+        long compressedCacheBudget = (long) (getCacheBudget(getContext()) * Constants.Cache.COMPRESSED_CACHE_RATIO);
+        if (compressedCacheBudget > 0) {
+            pdfFile.openTileCache(compressedCacheBudget);
+            cacheManager.setPdfFile(pdfFile, renderingHandler);
+        }
+
         if (scrollHandle != null) {
             scrollHandle.setupLayout(this);
             isScrollHandleInit = true;
@@ -805,6 +893,12 @@ public class PDFView extends RelativeLayout {
      * @param part The created PagePart.
      */
     public void onBitmapRendered(PagePart part) {
+        if (!ObjectsCompat.equals(part.getColorScheme(), colorScheme)) {
+            // Rendered or posted before the colors changed
+            bitmapPool.release(part.getRenderedBitmap());
+            return;
+        }
+
         // when it is first rendered part
         if (state == State.LOADED) {
             state = State.SHOWN;
@@ -812,9 +906,9 @@ public class PDFView extends RelativeLayout {
         }
 
         if (part.isThumbnail()) {
-            cacheManager.cacheThumbnail(part);
+            cacheManager.cacheThumbnail(part, getCurrentPage());
         } else {
-            cacheManager.cachePart(part);
+            cacheManager.cachePart(part, pdfFile.getPageCost(part.getPage()));
         }
         redraw();
     }
@@ -900,6 +994,7 @@ public class PDFView extends RelativeLayout {
 
         currentXOffset = offsetX;
         currentYOffset = offsetY;
+        prefetcher.onMove(swipeVertical ? offsetY : offsetX, zoom);
         float positionOffset = getPositionOffset();
 
         if (moveHandle && scrollHandle != null && !documentFitsView()) {
@@ -1269,6 +1364,61 @@ public class PDFView extends RelativeLayout {
         this.pageSnap = pageSnap;
     }
 
+    public boolean isDocumentIndexEnabled() {
+        return documentIndex;
+    }
+
+    private void enableDocumentIndex(boolean documentIndex) {
+        this.documentIndex = documentIndex;
+    }
+
+    public boolean isDiskCacheEnabled() {
+        return diskCache;
+    }
+
+    private void enableDiskCache(boolean diskCache) {
+        this.diskCache = diskCache;
+    }
+
+    public boolean isGrayscaleRendering() {
+        return grayscaleRendering;
+    }
+
+    private void enableGrayscaleRendering(boolean grayscaleRendering) {
+        this.grayscaleRendering = grayscaleRendering;
+    }
+
+    public boolean isDraftRendering() {
+        return draftRendering;
+    }
+
+    private void enableDraftRendering(boolean draftRendering) {
+        this.draftRendering = draftRendering;
+    }
+
+    /** Whether parts requested now should be rendered as drafts */
+    boolean isRenderingDraft() {
+        return draftRendering && isMoving();
+    }
+
+    /** Whether the view is dragged, zoomed or flung */
+    boolean isMoving() {
+        return dragPinchManager.isMoving() || animationManager.isFlinging();
+    }
+
+    /**
+     * Share of pages prefetched while scrolling whose thumbnail was ready when they came into view,
+     * recent scrolling weighs more
+     */
+    public float getPrefetchHitRate() {
+        return prefetcher.getHitRate();
+    }
+
+    /** Hit rate and compression ratio of evicted parts kept compressed, null if they aren't kept */
+    public TileCacheStats getCompressedCacheStats() {
+        return pdfFile != null ? pdfFile.getCompressedPartStats() : null;
+    }
+
     public boolean doRenderDuringScale() {
         return renderDuringScale;
     }
@@ -1297,6 +1447,14 @@ public class PDFView extends RelativeLayout {
         return pdfFile.getPageLinks(page);
     }
 
+    /** Will be null if document is not loaded or page has no label */
+    public String getPageLabel(int page) {
+        if (pdfFile == null) {
+            return null;
+        }
+        return pdfFile.getPageLabel(page);
+    }
+
     /** Use an asset file as the pdf source */
     public Configurator fromAsset(String assetName) {
         return new Configurator(new AssetSource(assetName));
@@ -1317,11 +1475,29 @@ public class PDFView extends RelativeLayout {
         return new Configurator(new ByteArraySource(bytes));
     }
 
-    /** Use stream as the pdf source. Stream will be written to bytearray, because native code does not support Java Streams */
+    /** Use direct bytebuffer as the pdf source, document is read in place without copying */
+    public Configurator fromByteBuffer(ByteBuffer buffer) {
+        return new Configurator(new ByteBufferSource(buffer));
+    }
+
+    /** Use stream as the pdf source. Stream will be written to a temporary file, because native code does not support Java Streams */
     public Configurator fromStream(InputStream stream) {
         return new Configurator(new InputStreamSource(stream));
     }
 
+    /** Use stream of known length as the pdf source, document is shown while the stream is still being read */
+    public Configurator fromStream(InputStream stream, long length) {
+        return new Configurator(new InputStreamSource(stream, length));
+    }
+
+    /**
+     * Use file that is still being downloaded as the pdf source. Call {@link #loadPages()} when more data
+     * arrives to render pages that were not available before.
+     */
+    public Configurator fromProgressiveFile(File file, long fileLength, DataAvailability availability) {
+        return new Configurator(new ProgressiveFileSource(file, fileLength, availability));
+    }
+
     /** Use custom source as pdf source */
     public Configurator fromSource(DocumentSource docSource) {
         return new Configurator(docSource);
@@ -1385,7 +1561,15 @@ public class PDFView extends RelativeLayout {
 
         private boolean pageSnap = false;
 
-        private boolean nightMode = false;
+        private ColorScheme colorScheme = null;
+
+        private boolean documentIndex = true;
+
+        private boolean diskCache = true;
+
+        private boolean grayscaleRendering = false;
+
+        private boolean draftRendering = true;
 
         private Configurator(DocumentSource documentSource) {
             this.documentSource = documentSource;
@@ -1522,7 +1706,49 @@ public class PDFView extends RelativeLayout {
         }
 
         public Configurator nightMode(boolean nightMode) {
-            this.nightMode = nightMode;
+            this.colorScheme = nightMode ? ColorScheme.NIGHT : null;
+            return this;
+        }
+
+        /**
+         * Render text, paths and page background in the given colors, e.g. {@link ColorScheme#SEPIA},
+         * images keep theirs. Overrides {@link #nightMode(boolean)}
+         */
+        public Configurator colorScheme(ColorScheme colorScheme) {
+            this.colorScheme = colorScheme;
+            return this;
+        }
+
+        /** Store index of page sizes, labels, outline and links in cache dir to speed up reopening */
+        public Configurator documentIndex(boolean documentIndex) {
+            this.documentIndex = documentIndex;
+            return this;
+        }
+
+        /**
+         * Store rendered parts and thumbnails in cache dir, so reopening the document paints the
+         * pages shown before without rendering them, see {@link Constants.Cache#DISK_CACHE_SIZE}
+         */
+        public Configurator diskCache(boolean diskCache) {
+            this.diskCache = diskCache;
+            return this;
+        }
+
+        /**
+         * Render pages that have only gray content to ALPHA_8 bitmaps, a quarter of the memory of
+         * ARGB_8888, so more of them fit in the cache. Meant for scanned or text documents
+         */
+        public Configurator grayscaleRendering(boolean grayscaleRendering) {
+            this.grayscaleRendering = grayscaleRendering;
+            return this;
+        }
+
+        /**
+         * Render parts requested while scrolling, flinging or pinching without anti-aliasing and
+         * smoothing, they're rendered again in full quality once the view settles
+         */
+        public Configurator draftRendering(boolean draftRendering) {
+            this.draftRendering = draftRendering;
             return this;
         }
 
@@ -1549,7 +1775,7 @@ public class PDFView extends RelativeLayout {
             PDFView.this.callbacks.setOnPageError(onPageErrorListener);
             PDFView.this.callbacks.setLinkHandler(linkHandler);
             PDFView.this.setSwipeEnabled(enableSwipe);
-            PDFView.this.setNightMode(nightMode);
+            PDFView.this.setColorScheme(colorScheme);
             PDFView.this.enableDoubletap(enableDoubletap);
             PDFView.this.setDefaultPage(defaultPage);
             PDFView.this.setSwipeVertical(!swipeHorizontal);
@@ -1562,6 +1788,10 @@ public class PDFView extends RelativeLayout {
             PDFView.this.setFitEachPage(fitEachPage);
             PDFView.this.setPageSnap(pageSnap);
             PDFView.this.setPageFling(pageFling);
+            PDFView.this.enableDocumentIndex(documentIndex);
+            PDFView.this.enableDiskCache(diskCache);
+            PDFView.this.enableGrayscaleRendering(grayscaleRendering);
+            PDFView.this.enableDraftRendering(draftRendering);
 
             if (pageNumbers != null) {
                 PDFView.this.load(documentSource, password, pageNumbers);
@@ -32,12 +32,17 @@ class PagesLoader {
 
     private PDFView pdfView;
     private int cacheOrder;
+    private boolean draft;
     private float xOffset;
     private float yOffset;
     private float pageRelativePartWidth;
     private float pageRelativePartHeight;
     private float partRenderWidth;
     private float partRenderHeight;
+    /** Position and size of the page being loaded at the current zoom */
+    private float pageX, pageY, pageWidth, pageHeight;
+    /** Visible area of the document at the current zoom */
+    private final RectF viewBounds = new RectF();
     private final RectF thumbnailRect = new RectF(0, 0, 1, 1);
     private final int preloadOffset;
 
@@ -81,12 +86,14 @@ class PagesLoader {
     private class GridSize {
         int rows;
         int cols;
+        float partSize;
 
         @Override
         public String toString() {
             return "GridSize{" +
                     "rows=" + rows +
                     ", cols=" + cols +
+                    ", partSize=" + partSize +
                     '}';
         }
     }
@@ -100,8 +107,9 @@ class PagesLoader {
         SizeF size = pdfView.pdfFile.getPageSize(pageIndex);
         float ratioX = 1f / size.getWidth();
         float ratioY = 1f / size.getHeight();
-        final float partHeight = (Constants.PART_SIZE * ratioY) / pdfView.getZoom();
-        final float partWidth = (Constants.PART_SIZE * ratioX) / pdfView.getZoom();
+        grid.partSize = pdfView.pdfFile.getPartSize(pageIndex, pdfView.getZoom());
+        final float partHeight = (grid.partSize * ratioY) / pdfView.getZoom();
+        final float partWidth = (grid.partSize * ratioX) / pdfView.getZoom();
         grid.rows = MathUtils.ceil(1f / partHeight);
         grid.cols = MathUtils.ceil(1f / partWidth);
     }
@@ -109,8 +117,8 @@ class PagesLoader {
     private void calculatePartSize(GridSize grid) {
         pageRelativePartWidth = 1f / (float) grid.cols;
         pageRelativePartHeight = 1f / (float) grid.rows;
-        partRenderWidth = Constants.PART_SIZE / pageRelativePartWidth;
-        partRenderHeight = Constants.PART_SIZE / pageRelativePartHeight;
+        partRenderWidth = grid.partSize / pageRelativePartWidth;
+        partRenderHeight = grid.partSize / pageRelativePartHeight;
     }
 
 
@@ -250,6 +258,15 @@ class PagesLoader {
 
     private int loadPage(int page, int firstRow, int lastRow, int firstCol, int lastCol,
                          int nbOfPartsLoadable) {
+        float zoom = pdfView.getZoom();
+        SizeF pageSize = pdfView.pdfFile.getScaledPageSize(page, zoom);
+        float pageOffset = pdfView.pdfFile.getPageOffset(page, zoom);
+        float secondaryOffset = pdfView.pdfFile.getSecondaryPageOffset(page, zoom);
+        pageX = pdfView.isSwipeVertical() ? secondaryOffset : pageOffset;
+        pageY = pdfView.isSwipeVertical() ? pageOffset : secondaryOffset;
+        pageWidth = pageSize.getWidth();
+        pageHeight = pageSize.getHeight();
+
         int loaded = 0;
         for (int row = firstRow; row <= lastRow; row++) {
             for (int col = firstCol; col <= lastCol; col++) {
@@ -284,10 +301,21 @@ class PagesLoader {
         RectF pageRelativeBounds = new RectF(relX, relY, relX + relWidth, relY + relHeight);
 
         if (renderWidth > 0 && renderHeight > 0) {
-            if (!pdfView.cacheManager.upPartIfContained(page, pageRelativeBounds, cacheOrder)) {
+            if (!pdfView.cacheManager.upPartIfContained(page, pageRelativeBounds, renderWidth, cacheOrder, draft)) {
+                float left = pageX + relX * pageWidth;
+                float top = pageY + relY * pageHeight;
+                float right = left + relWidth * pageWidth;
+                float bottom = top + relHeight * pageHeight;
+                boolean visible = left < viewBounds.right && right > viewBounds.left
+                        && top < viewBounds.bottom && bottom > viewBounds.top;
+                float dx = (left + right) / 2 - viewBounds.centerX();
+                float dy = (top + bottom) / 2 - viewBounds.centerY();
+
                 pdfView.renderingHandler.addRenderingTask(page, renderWidth, renderHeight,
                         pageRelativeBounds, false, cacheOrder, pdfView.isBestQuality(),
-                        pdfView.isAnnotationRendering());
+                        pdfView.isAnnotationRendering(), draft,
+                        visible ? RenderingHandler.PRIORITY_VISIBLE : RenderingHandler.PRIORITY_PRELOAD,
+                        dx * dx + dy * dy);
             }
 
             cacheOrder++;
@@ -297,20 +325,38 @@ class PagesLoader {
     }
 
     private void loadThumbnail(int page) {
+        loadThumbnail(page, RenderingHandler.PRIORITY_THUMBNAIL, 0);
+    }
+
+    /**
+     * @param distance distance of the page from the view, pages closer are rendered first within a
+     *                 priority class
+     * @return true if the thumbnail is requested, false if it's already cached
+     */
+    boolean loadThumbnail(int page, int priority, float distance) {
+        if (containsThumbnail(page)) {
+            return false;
+        }
         SizeF pageSize = pdfView.pdfFile.getPageSize(page);
         float thumbnailWidth = pageSize.getWidth() * Constants.THUMBNAIL_RATIO;
         float thumbnailHeight = pageSize.getHeight() * Constants.THUMBNAIL_RATIO;
-        if (!pdfView.cacheManager.containsThumbnail(page, thumbnailRect)) {
-            pdfView.renderingHandler.addRenderingTask(page,
-                    thumbnailWidth, thumbnailHeight, thumbnailRect,
-                    true, 0, pdfView.isBestQuality(), pdfView.isAnnotationRendering());
-        }
+        pdfView.renderingHandler.addRenderingTask(page,
+                thumbnailWidth, thumbnailHeight, thumbnailRect,
+                true, 0, pdfView.isBestQuality(), pdfView.isAnnotationRendering(), false, priority, distance);
+        return true;
+    }
+
+    boolean containsThumbnail(int page) {
+        return pdfView.cacheManager.containsThumbnail(page, thumbnailRect);
     }
 
     void loadPages() {
         cacheOrder = 1;
+        draft = pdfView.isRenderingDraft();
         xOffset = -MathUtils.max(pdfView.getCurrentXOffset(), 0);
         yOffset = -MathUtils.max(pdfView.getCurrentYOffset(), 0);
+        viewBounds.set(-pdfView.getCurrentXOffset(), -pdfView.getCurrentYOffset(),
+                -pdfView.getCurrentXOffset() + pdfView.getWidth(), -pdfView.getCurrentYOffset() + pdfView.getHeight());
 
         loadVisible();
     }
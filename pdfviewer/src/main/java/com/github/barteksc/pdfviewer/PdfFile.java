@@ -16,24 +16,49 @@
 package com.github.barteksc.pdfviewer;
 
 import android.graphics.Bitmap;
+import android.graphics.Point;
 import android.graphics.Rect;
 import android.graphics.RectF;
+import android.os.CancellationSignal;
+import android.util.Log;
+import android.util.SparseArray;
 import android.util.SparseBooleanArray;
 
+import androidx.core.util.ObjectsCompat;
+
 import com.github.barteksc.pdfviewer.exception.PageRenderingException;
+import com.github.barteksc.pdfviewer.model.PagePart;
+import com.github.barteksc.pdfviewer.util.Constants;
 import com.github.barteksc.pdfviewer.util.FitPolicy;
 import com.github.barteksc.pdfviewer.util.PageSizeCalculator;
+import com.shockwave.pdfium.ColorScheme;
+import com.shockwave.pdfium.DocumentIndex;
 import com.shockwave.pdfium.PdfDocument;
 import com.shockwave.pdfium.PdfiumCore;
+import com.shockwave.pdfium.TileCache;
+import com.shockwave.pdfium.TileCacheStats;
 import com.shockwave.pdfium.util.Size;
 import com.shockwave.pdfium.util.SizeF;
 
+import java.io.File;
+import java.io.IOException;
+import java.io.InterruptedIOException;
 import java.util.ArrayList;
 import java.util.List;
 
+import static com.shockwave.pdfium.PdfiumCore.PAGE_GEOMETRY_STRIDE;
+
 class PdfFile {
 
-    private static final Object lock = new Object();
+    private static final String TAG = PdfFile.class.getName();
+
+    /** Render cost a single part should roughly stay under, in page objects */
+    private static final float PART_COST = 250;
+    /** Images have to be decoded and scaled, so they count as several objects */
+    private static final int IMAGE_COST = 20;
+
+    /** Guards opened pages of this document only, so other documents aren't blocked */
+    private final Object lock = new Object();
     private PdfDocument pdfDocument;
     private PdfiumCore pdfiumCore;
     private int pagesCount = 0;
@@ -43,6 +68,10 @@ class PdfFile {
     private List<SizeF> pageSizes = new ArrayList<>();
     /** Opened pages with indicator whether opening was successful */
     private SparseBooleanArray openedPages = new SparseBooleanArray();
+    /** Estimated render cost of opened pages, see {@link #getPartSize(int, float)} */
+    private SparseArray<Float> pageCosts = new SparseArray<>();
+    /** Opened pages with only gray content, with indicator whether they have no annotations either */
+    private SparseBooleanArray colorlessPages = new SparseBooleanArray();
     /** Page with maximum width */
     private Size originalMaxWidthPageSize = new Size(0, 0);
     /** Page with maximum height */
@@ -69,22 +98,40 @@ class PdfFile {
      * else the largest page fits and other pages scale relatively
      */
     private final boolean fitEachPage;
+    /** Whether colorless pages are rendered in gray, which needs page complexity like adaptive part size */
+    private final boolean grayscaleRendering;
     /**
      * The pages the user want to display in order
      * (ex: 0, 2, 2, 8, 8, 1, 1, 1)
      */
     private int[] originalUserPages;
-
-    PdfFile(PdfiumCore pdfiumCore, PdfDocument pdfDocument, FitPolicy pageFitPolicy, Size viewSize, int[] originalUserPages,
-            boolean isVertical, int spacing, boolean autoSpacing, boolean fitEachPage) {
+    /** Evicted parts kept compressed in native memory, null if disabled */
+    private TileCache tileCache;
+    /** Parts and thumbnails stored on disk, null if disabled */
+    private DiskTileCache diskCache;
+    /** Persisted index of document structure, null if document isn't indexed yet */
+    private DocumentIndex documentIndex;
+    /** Thread writing document index in background */
+    private Thread indexWriter;
+    /** Guards handing the document over to the index writer when disposed while indexing */
+    private final Object indexLock = new Object();
+    /** Guarded by {@link #indexLock} */
+    private boolean indexing;
+    private boolean closeAfterIndexing;
+
+    PdfFile(PdfiumCore pdfiumCore, PdfDocument pdfDocument, DocumentIndex documentIndex, FitPolicy pageFitPolicy,
+            Size viewSize, int[] originalUserPages, boolean isVertical, int spacing, boolean autoSpacing,
+            boolean fitEachPage, boolean grayscaleRendering) {
         this.pdfiumCore = pdfiumCore;
         this.pdfDocument = pdfDocument;
+        this.documentIndex = documentIndex;
         this.pageFitPolicy = pageFitPolicy;
         this.originalUserPages = originalUserPages;
         this.isVertical = isVertical;
         this.spacingPx = spacing;
         this.autoSpacing = autoSpacing;
         this.fitEachPage = fitEachPage;
+        this.grayscaleRendering = grayscaleRendering;
         setup(viewSize);
     }
 
@@ -95,8 +142,10 @@ class PdfFile {
             pagesCount = pdfiumCore.getPageCount(pdfDocument);
         }
 
+        Size[] pageSizes = documentIndex != null ? getIndexedPageSizes() :
+                pdfiumCore.getPageSizes(pdfDocument, originalUserPages);
         for (int i = 0; i < pagesCount; i++) {
-            Size pageSize = pdfiumCore.getPageSize(pdfDocument, documentPage(i));
+            Size pageSize = pageSizes[i];
             if (pageSize.getWidth() > originalMaxWidthPageSize.getWidth()) {
                 originalMaxWidthPageSize = pageSize;
             }
@@ -106,9 +155,51 @@ class PdfFile {
             originalPageSizes.add(pageSize);
         }
 
+        if (pdfDocument.isProgressive()) {
+            fillMissingPageSizes();
+        }
+
         recalculatePageSizes(viewSize);
     }
 
+    private Size[] getIndexedPageSizes() {
+        float[] geometry = documentIndex.getPagesGeometry();
+        if (originalUserPages != null) {
+            float[] userGeometry = new float[originalUserPages.length * PAGE_GEOMETRY_STRIDE];
+            for (int i = 0; i < originalUserPages.length; i++) {
+                int page = originalUserPages[i];
+                if (page >= 0 && page < documentIndex.getPageCount()) {
+                    System.arraycopy(geometry, page * PAGE_GEOMETRY_STRIDE, userGeometry, i * PAGE_GEOMETRY_STRIDE,
+                            PAGE_GEOMETRY_STRIDE);
+                }
+            }
+            geometry = userGeometry;
+        }
+        return pdfiumCore.getPageSizes(geometry);
+    }
+
+    /**
+     * Sizes of pages that are not downloaded yet are unknown, assume they match the first known page
+     */
+    private void fillMissingPageSizes() {
+        Size knownSize = null;
+        for (Size size : originalPageSizes) {
+            if (size.getWidth() > 0 && size.getHeight() > 0) {
+                knownSize = size;
+                break;
+            }
+        }
+        if (knownSize == null) {
+            return;
+        }
+        for (int i = 0; i < originalPageSizes.size(); i++) {
+            Size size = originalPageSizes.get(i);
+            if (size.getWidth() <= 0 || size.getHeight() <= 0) {
+                originalPageSizes.set(i, knownSize);
+            }
+        }
+    }
+
     /**
      * Call after view size change to recalculate page sizes, offsets and document length
      *
@@ -272,9 +363,16 @@ class PdfFile {
 
         synchronized (lock) {
             if (openedPages.indexOfKey(docPage) < 0) {
+                if (!pdfiumCore.isPageAvailable(pdfDocument, docPage)) {
+                    // Not downloaded yet, don't mark as failed so it's retried later
+                    return false;
+                }
                 try {
                     pdfiumCore.openPage(pdfDocument, docPage);
                     openedPages.put(docPage, true);
+                    if (Constants.ADAPTIVE_PART_SIZE || grayscaleRendering) {
+                        measurePage(docPage);
+                    }
                     return true;
                 } catch (Exception e) {
                     openedPages.put(docPage, false);
@@ -285,6 +383,77 @@ class PdfFile {
         }
     }
 
+    /** Walks all page objects, so it runs only when adaptive part size or grayscale rendering needs it */
+    private void measurePage(int docPage) {
+        PdfDocument.PageComplexity complexity = pdfiumCore.getPageComplexity(pdfDocument, docPage);
+        float cost = estimateCost(complexity);
+        pageCosts.put(docPage, cost);
+        boolean colorless = complexity != null && !complexity.hasColor();
+        boolean noAnnotations = complexity != null && complexity.getAnnotationCount() == 0;
+        if (colorless) {
+            colorlessPages.put(docPage, noAnnotations);
+        }
+        if (diskCache != null && complexity != null) {
+            diskCache.storePageInfo(docPage, cost, colorless, noAnnotations);
+        }
+    }
+
+    private static float estimateCost(PdfDocument.PageComplexity complexity) {
+        if (complexity == null) {
+            return 0;
+        }
+        float cost = complexity.getObjectCount() + complexity.getImageCount() * (IMAGE_COST - 1);
+        return complexity.hasTransparency() ? cost * 2 : cost;
+    }
+
+    /** Estimated cost of rendering the whole page, 0 until the page is opened */
+    public float getPageCost(int pageIndex) {
+        int docPage = documentPage(pageIndex);
+        synchronized (lock) {
+            Float cost = pageCosts.get(docPage);
+            return cost != null ? cost : 0;
+        }
+    }
+
+    /**
+     * Size of the parts the page is split into at given zoom. Pages with little content are rendered
+     * in a few large parts, crowded ones in small parts, so that a part takes about the same time to
+     * render. {@link Constants#PART_SIZE} until the page is opened.
+     */
+    public float getPartSize(int pageIndex, float zoom) {
+        int docPage = documentPage(pageIndex);
+        Float cost;
+        synchronized (lock) {
+            cost = pageCosts.get(docPage);
+        }
+        if (!Constants.ADAPTIVE_PART_SIZE || cost == null) {
+            return Constants.PART_SIZE;
+        }
+
+        SizeF size = getScaledPageSize(pageIndex, zoom);
+        float costPerPixel = cost / (size.getWidth() * size.getHeight());
+        float partSize = Constants.MAX_PART_SIZE;
+        while (partSize / 2 >= Constants.MIN_PART_SIZE && partSize * partSize * costPerPixel > PART_COST) {
+            partSize /= 2;
+        }
+        return partSize;
+    }
+
+    /**
+     * Whether an opened page has no color content and can be rendered in shades of gray
+     *
+     * @param annotationRendering whether annotations, which may be in color, are rendered too
+     */
+    public boolean isPageColorless(int pageIndex, boolean annotationRendering) {
+        int docPage = documentPage(pageIndex);
+        synchronized (lock) {
+            if (colorlessPages.indexOfKey(docPage) < 0) {
+                return false;
+            }
+            return !annotationRendering || colorlessPages.get(docPage);
+        }
+    }
+
     public boolean pageHasError(int pageIndex) {
         int docPage = documentPage(pageIndex);
         return !openedPages.get(docPage, false);
@@ -296,6 +465,147 @@ class PdfFile {
                 bounds.left, bounds.top, bounds.width(), bounds.height(), annotationRendering);
     }
 
+    /**
+     * Render in time slices, stops early once cancellationSignal is cancelled
+     *
+     * @param colorScheme colors of text, paths and background, null for the page colors
+     * @return true if the bitmap was fully rendered
+     */
+    public boolean renderPageBitmap(Bitmap bitmap, int pageIndex, Rect bounds, boolean annotationRendering,
+                                    ColorScheme colorScheme, CancellationSignal cancellationSignal) {
+        int docPage = documentPage(pageIndex);
+        return pdfiumCore.renderPageBitmap(pdfDocument, bitmap, docPage,
+                bounds.left, bounds.top, bounds.width(), bounds.height(),
+                annotationRendering ? PdfiumCore.RENDER_FLAG_ANNOT : 0, colorScheme,
+                cancellationSignal, PdfiumCore.DEFAULT_RENDER_SLICE_MILLIS);
+    }
+
+    /**
+     * Draw a thumbnail of the whole page, from the image embedded in the page when there is one big
+     * enough, rendered otherwise
+     *
+     * @return true if the bitmap was fully drawn
+     */
+    public boolean renderPageThumbnail(Bitmap bitmap, int pageIndex, boolean annotationRendering,
+                                       ColorScheme colorScheme, CancellationSignal cancellationSignal) {
+        int docPage = documentPage(pageIndex);
+        float minEmbeddedScale = Constants.EMBEDDED_THUMBNAILS
+                ? PdfiumCore.DEFAULT_MIN_EMBEDDED_THUMBNAIL_SCALE : PdfiumCore.NO_EMBEDDED_THUMBNAIL;
+        return pdfiumCore.renderPageThumbnail(pdfDocument, bitmap, docPage,
+                annotationRendering ? PdfiumCore.RENDER_FLAG_ANNOT : 0, colorScheme, minEmbeddedScale,
+                cancellationSignal, PdfiumCore.DEFAULT_RENDER_SLICE_MILLIS) != PdfiumCore.THUMBNAIL_FAILED;
+    }
+
+    /** Keep evicted parts compressed in native memory, see {@link #storeCompressedPart(PagePart, ColorScheme)} */
+    void openTileCache(long budget) {
+        tileCache = pdfiumCore.newTileCache(budget);
+    }
+
+    /**
+     * Keep the part compressed, so it doesn't have to be rendered again after its bitmap is reused.
+     * Drafts, thumbnails and parts requested in other colors than the current ones aren't kept
+     *
+     * @param colorScheme colors pages are rendered in now, null for the page colors
+     */
+    public void storeCompressedPart(PagePart part, ColorScheme colorScheme) {
+        TileCache cache = tileCache;
+        if (cache != null && !part.isDraft() && !part.isThumbnail()
+                && ObjectsCompat.equals(part.getColorScheme(), colorScheme)) {
+            pdfiumCore.putTile(cache, part.getPage(), part.getPageRelativeBounds(), colorScheme,
+                    part.getRenderedBitmap());
+        }
+    }
+
+    /**
+     * Decompress the part stored with the colors and the size and configuration of the bitmap into it
+     *
+     * @param colorScheme colors the part is requested in, null for the page colors
+     * @return false if the part isn't stored, it has to be rendered
+     */
+    public boolean takeCompressedPart(int pageIndex, RectF bounds, ColorScheme colorScheme, Bitmap bitmap) {
+        TileCache cache = tileCache;
+        return cache != null && pdfiumCore.takeTile(cache, pageIndex, bounds, colorScheme, bitmap);
+    }
+
+    /** Drop compressed parts, e.g. when pages are rendered in other colors */
+    public void clearCompressedParts() {
+        TileCache cache = tileCache;
+        if (cache != null) {
+            pdfiumCore.clearTileCache(cache);
+        }
+    }
+
+    /** Null if compressed parts aren't kept */
+    public TileCacheStats getCompressedPartStats() {
+        TileCache cache = tileCache;
+        return cache != null ? pdfiumCore.getTileCacheStats(cache) : null;
+    }
+
+    /**
+     * Store rendered parts and thumbnails on disk, so reopening the document paints them without
+     * rendering. Render costs and colorless state of pages stored earlier are known from now on, so
+     * parts are laid out before pages are opened
+     */
+    void setDiskCache(DiskTileCache diskCache) {
+        this.diskCache = diskCache;
+        if (diskCache != null) {
+            synchronized (lock) {
+                diskCache.loadPageInfo(pageCosts, colorlessPages);
+            }
+        }
+    }
+
+    /**
+     * Read the part or thumbnail stored with the size and configuration of the bitmap into it, the
+     * page doesn't have to be opened
+     *
+     * @param colorScheme colors the part was rendered in, null for the page colors
+     * @return false if it isn't stored, it has to be rendered
+     */
+    public boolean readStoredPart(int pageIndex, RectF bounds, boolean thumbnail, boolean annotationRendering,
+                                  ColorScheme colorScheme, Bitmap bitmap) {
+        DiskTileCache cache = diskCache;
+        int docPage = documentPage(pageIndex);
+        return cache != null && docPage >= 0
+                && cache.read(docPage, bounds, thumbnail, annotationRendering, colorScheme, bitmap);
+    }
+
+    /**
+     * Store the rendered part or thumbnail on disk in background, drafts shouldn't be stored
+     *
+     * @see #readStoredPart(int, RectF, boolean, boolean, ColorScheme, Bitmap)
+     */
+    public void storePart(int pageIndex, RectF bounds, boolean thumbnail, boolean annotationRendering,
+                          ColorScheme colorScheme, Bitmap bitmap) {
+        DiskTileCache cache = diskCache;
+        int docPage = documentPage(pageIndex);
+        if (cache != null && docPage >= 0) {
+            cache.write(docPage, bounds, thumbnail, annotationRendering, colorScheme, bitmap);
+        }
+    }
+
+    /**
+     * Render parts of one page at the same zoom in a single pass over the page, bounds of all parts
+     * must have the same size
+     *
+     * @param draft render with {@link PdfiumCore#RENDER_FLAGS_DRAFT}, faster but without anti-aliasing
+     * @param colorScheme colors of text, paths and background, null for the page colors
+     * @return true if all bitmaps were fully rendered
+     */
+    public boolean renderPageBitmaps(List<Bitmap> bitmaps, int pageIndex, List<Rect> bounds, boolean annotationRendering,
+                                     boolean draft, ColorScheme colorScheme, CancellationSignal cancellationSignal) {
+        int docPage = documentPage(pageIndex);
+        Point[] starts = new Point[bounds.size()];
+        for (int i = 0; i < starts.length; i++) {
+            starts[i] = new Point(bounds.get(i).left, bounds.get(i).top);
+        }
+        Rect first = bounds.get(0);
+        return pdfiumCore.renderPageBitmaps(pdfDocument, bitmaps.toArray(new Bitmap[0]), starts, docPage,
+                first.width(), first.height(),
+                (annotationRendering ? PdfiumCore.RENDER_FLAG_ANNOT : 0) | (draft ? PdfiumCore.RENDER_FLAGS_DRAFT : 0),
+                colorScheme, cancellationSignal, PdfiumCore.DEFAULT_RENDER_SLICE_MILLIS);
+    }
+
     public PdfDocument.Meta getMetaData() {
         if (pdfDocument == null) {
             return null;
@@ -307,14 +617,62 @@ class PdfFile {
         if (pdfDocument == null) {
             return new ArrayList<>();
         }
+        if (documentIndex != null) {
+            return documentIndex.getTableOfContents();
+        }
         return pdfiumCore.getTableOfContents(pdfDocument);
     }
 
     public List<PdfDocument.Link> getPageLinks(int pageIndex) {
         int docPage = documentPage(pageIndex);
+        if (documentIndex != null) {
+            return documentIndex.getPageLinks(docPage);
+        }
         return pdfiumCore.getPageLinks(pdfDocument, docPage);
     }
 
+    public String getPageLabel(int pageIndex) {
+        int docPage = documentPage(pageIndex);
+        if (docPage < 0 || pdfDocument == null) {
+            return null;
+        }
+        if (documentIndex != null) {
+            return documentIndex.getPageLabel(docPage);
+        }
+        return pdfiumCore.getPageLabel(pdfDocument, docPage);
+    }
+
+    /**
+     * Write index of the document in background, so next time it's opened setup doesn't walk the document
+     */
+    public void startIndexing(final File indexFile, final byte[] key) {
+        final PdfiumCore core = pdfiumCore;
+        final PdfDocument document = pdfDocument;
+        indexing = true;
+        indexWriter = new Thread(new Runnable() {
+            @Override
+            public void run() {
+                try {
+                    DocumentIndex.write(indexFile, key, core, document);
+                    DocumentIndex.trim(indexFile.getParentFile(), Constants.Cache.DOCUMENT_INDEX_SIZE);
+                } catch (InterruptedIOException e) {
+                    // Document closed before indexing finished
+                } catch (IOException e) {
+                    Log.e(TAG, "Cannot write document index", e);
+                } finally {
+                    synchronized (indexLock) {
+                        indexing = false;
+                        if (closeAfterIndexing) {
+                            core.closeDocument(document);
+                        }
+                    }
+                }
+            }
+        }, "PDF document indexer");
+        indexWriter.setPriority(Thread.MIN_PRIORITY);
+        indexWriter.start();
+    }
+
     public RectF mapRectToDevice(int pageIndex, int startX, int startY, int sizeX, int sizeY,
                                  RectF rect) {
         int docPage = documentPage(pageIndex);
@@ -322,9 +680,28 @@ class PdfFile {
     }
 
     public void dispose() {
-        if (pdfiumCore != null && pdfDocument != null) {
+        boolean closeDocument = pdfiumCore != null && pdfDocument != null;
+        synchronized (indexLock) {
+            if (indexing) {
+                // Indexer stops at the next page and closes the document, no need to wait for it here
+                indexWriter.interrupt();
+                closeAfterIndexing = true;
+                closeDocument = false;
+            }
+        }
+        indexWriter = null;
+
+        if (closeDocument) {
             pdfiumCore.closeDocument(pdfDocument);
         }
+        if (tileCache != null) {
+            pdfiumCore.closeTileCache(tileCache);
+            tileCache = null;
+        }
+        if (diskCache != null) {
+            diskCache.close();
+            diskCache = null;
+        }
 
         pdfDocument = null;
         originalUserPages = null;
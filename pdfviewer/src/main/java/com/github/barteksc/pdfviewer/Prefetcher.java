@@ -0,0 +1,175 @@
+/**
+ * Copyright 2016 Bartosz Schiller
+ * <p/>
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * <p/>
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * <p/>
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package com.github.barteksc.pdfviewer;
+
+import android.os.SystemClock;
+import android.util.SparseBooleanArray;
+
+import com.github.barteksc.pdfviewer.util.Constants;
+
+import static com.github.barteksc.pdfviewer.util.Constants.Cache.THUMBNAILS_CACHE_SIZE;
+
+/**
+ * Predicts where the view is going from how it moved lately and requests thumbnails of the pages
+ * ahead at the lowest priority, so pages scrolling in show at least their thumbnail. Rendering the
+ * thumbnail opens the page, so its parts start sooner too. Prefetching backs off while most
+ * prefetched pages are never shown.
+ */
+class Prefetcher {
+
+    /** Weight of the latest movement in the velocity estimate */
+    private static final float VELOCITY_SMOOTHING = 0.5f;
+
+    /** Movements further apart than this don't give a velocity */
+    private static final long MAX_SAMPLE_GAP_MILLIS = 100;
+
+    /** Prefetched pages needed before the hit rate is trusted */
+    private static final int MIN_SAMPLES = 8;
+
+    /** Statistics are halved past this many prefetched pages, so the hit rate follows recent reading */
+    private static final int MAX_SAMPLES = 64;
+
+    private final PDFView pdfView;
+
+    private float lastOffset;
+    private float lastZoom;
+    private long lastTime = -1;
+
+    /** Along the swipe axis in px per ms, positive toward the end of the document */
+    private float velocity;
+
+    /** Direction of the last movement, 1 toward the end of the document, -1 toward the start */
+    private int direction = 1;
+
+    /** Prefetched pages not shown yet */
+    private final SparseBooleanArray prefetched = new SparseBooleanArray();
+
+    private int requested;
+    private int hits;
+
+    Prefetcher(PDFView pdfView) {
+        this.pdfView = pdfView;
+    }
+
+    /** Called whenever the view moves, offset is along the swipe axis */
+    void onMove(float offset, float zoom) {
+        long now = SystemClock.uptimeMillis();
+        if (lastTime < 0 || zoom != lastZoom || now - lastTime > MAX_SAMPLE_GAP_MILLIS) {
+            velocity = 0;
+        } else if (now > lastTime) {
+            // Offsets decrease toward the end of the document
+            float sample = (lastOffset - offset) / (now - lastTime);
+            velocity = velocity * (1 - VELOCITY_SMOOTHING) + sample * VELOCITY_SMOOTHING;
+            if (velocity != 0) {
+                direction = velocity > 0 ? 1 : -1;
+            }
+        }
+        lastOffset = offset;
+        lastZoom = zoom;
+        lastTime = now;
+    }
+
+    /**
+     * Request thumbnails of pages the view is heading to, at least the next page in the last
+     * direction. Called while loading pages, so requests not repeated are dropped
+     */
+    void prefetch() {
+        PdfFile pdfFile = pdfView.pdfFile;
+        int pageCount = pdfFile.getPagesCount();
+        if (!Constants.Prefetch.ENABLED || pageCount == 0) {
+            return;
+        }
+
+        float zoom = pdfView.getZoom();
+        boolean vertical = pdfView.isSwipeVertical();
+        float viewStart = -(vertical ? pdfView.getCurrentYOffset() : pdfView.getCurrentXOffset());
+        float viewLength = vertical ? pdfView.getHeight() : pdfView.getWidth();
+        int firstVisible = pdfFile.getPageAtOffset(viewStart, zoom);
+        int lastVisible = pdfFile.getPageAtOffset(viewStart + viewLength, zoom);
+
+        for (int page = firstVisible; page <= lastVisible; page++) {
+            countShown(page);
+        }
+        forgetFarPages(firstVisible, lastVisible);
+
+        int budget = Math.min(Constants.Prefetch.MAX_PAGES, THUMBNAILS_CACHE_SIZE - (lastVisible - firstVisible + 1));
+        if (requested >= MIN_SAMPLES && hits < requested * Constants.Prefetch.MIN_HIT_RATE) {
+            budget = Math.min(budget, 1);
+        }
+        float ahead = pdfView.isMoving() ? Math.abs(velocity) * Constants.Prefetch.LOOKAHEAD_MILLIS : 0;
+
+        if (direction > 0) {
+            int last = Math.max(pdfFile.getPageAtOffset(viewStart + viewLength + ahead, zoom), lastVisible + 1);
+            for (int page = lastVisible + 1; page <= last && page < pageCount && budget > 0; page++, budget--) {
+                request(page, page - lastVisible);
+            }
+        } else {
+            int first = Math.min(pdfFile.getPageAtOffset(viewStart - ahead, zoom), firstVisible - 1);
+            for (int page = firstVisible - 1; page >= first && page >= 0 && budget > 0; page--, budget--) {
+                request(page, firstVisible - page);
+            }
+        }
+    }
+
+    /** Share of prefetched pages whose thumbnail was ready when they were shown */
+    float getHitRate() {
+        return requested == 0 ? 0 : (float) hits / requested;
+    }
+
+    void reset() {
+        lastTime = -1;
+        velocity = 0;
+        direction = 1;
+        prefetched.clear();
+        requested = 0;
+        hits = 0;
+    }
+
+    private void request(int page, float distance) {
+        if (!pdfView.pagesLoader.loadThumbnail(page, RenderingHandler.PRIORITY_PREFETCH, distance)) {
+            return;
+        }
+        if (prefetched.indexOfKey(page) < 0) {
+            prefetched.put(page, true);
+            requested++;
+            if (requested > MAX_SAMPLES) {
+                requested /= 2;
+                hits /= 2;
+            }
+        }
+    }
+
+    private void countShown(int page) {
+        if (prefetched.indexOfKey(page) < 0) {
+            return;
+        }
+        prefetched.delete(page);
+        if (pdfView.pagesLoader.containsThumbnail(page)) {
+            hits++;
+        }
+    }
+
+    /** Pages prefetched before the view turned around are misses */
+    private void forgetFarPages(int firstVisible, int lastVisible) {
+        int margin = 2 * Constants.Prefetch.MAX_PAGES;
+        for (int i = prefetched.size() - 1; i >= 0; i--) {
+            int page = prefetched.keyAt(i);
+            if (page < firstVisible - margin || page > lastVisible + margin) {
+                prefetched.removeAt(i);
+            }
+        }
+    }
+}
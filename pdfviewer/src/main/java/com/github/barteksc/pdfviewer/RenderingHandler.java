@@ -20,25 +20,45 @@ import android.graphics.Color;
 import android.graphics.Matrix;
 import android.graphics.Rect;
 import android.graphics.RectF;
+import android.os.CancellationSignal;
 import android.os.Handler;
 import android.os.Looper;
 import android.os.Message;
 import android.util.Log;
+import androidx.core.util.ObjectsCompat;
 
 import com.github.barteksc.pdfviewer.exception.PageRenderingException;
 import com.github.barteksc.pdfviewer.model.PagePart;
+import com.github.barteksc.pdfviewer.util.Constants;
+import com.shockwave.pdfium.ColorScheme;
+
+import java.util.ArrayList;
+import java.util.Collections;
+import java.util.Comparator;
+import java.util.Iterator;
+import java.util.List;
+import java.util.PriorityQueue;
+
+import static com.github.barteksc.pdfviewer.util.Constants.RENDER_BATCH_SIZE;
 
 /**
- * A {@link Handler} that will process incoming {@link RenderingTask} messages
- * and alert {@link PDFView#onBitmapRendered(PagePart)} when the portion of the
- * PDF is ready to render.
+ * A {@link Handler} that will render queued {@link RenderingTask}s, most important first, and
+ * alert {@link PDFView#onBitmapRendered(PagePart)} when the portion of the PDF is ready to render.
  */
 class RenderingHandler extends Handler {
     /**
-     * {@link Message#what} kind of message this handler processes.
+     * {@link Message#what} kind of message this handler processes, one is pending while tasks are
+     * queued
      */
     static final int MSG_RENDER_TASK = 1;
 
+    /** Priority classes, lower is rendered first */
+    static final int PRIORITY_VISIBLE = 0;
+    static final int PRIORITY_PRELOAD = 1;
+    static final int PRIORITY_THUMBNAIL = 2;
+    /** Thumbnails of pages the view is predicted to reach */
+    static final int PRIORITY_PREFETCH = 3;
+
     private static final String TAG = RenderingHandler.class.getName();
 
     private PDFView pdfView;
@@ -48,23 +68,102 @@ class RenderingHandler extends Handler {
     private Matrix renderMatrix = new Matrix();
     private boolean running = false;
 
+    private final Object tasksLock = new Object();
+    /** Tasks not started yet, most important first, guarded by {@link #tasksLock} */
+    private final PriorityQueue<RenderingTask> queuedTasks = new PriorityQueue<>(16, new PriorityComparator());
+    /** Order of requests, guarded by {@link #tasksLock} */
+    private long sequence;
+    /** Tasks being rendered on the handler thread, guarded by {@link #tasksLock} */
+    private List<RenderingTask> runningTasks = Collections.emptyList();
+    private CancellationSignal runningSignal;
+
     RenderingHandler(Looper looper, PDFView pdfView) {
         super(looper);
         this.pdfView = pdfView;
     }
 
     void addRenderingTask(int page, float width, float height, RectF bounds, boolean thumbnail, int cacheOrder, boolean bestQuality, boolean annotationRendering) {
-        RenderingTask task = new RenderingTask(width, height, bounds, page, thumbnail, cacheOrder, bestQuality, annotationRendering);
-        Message msg = obtainMessage(MSG_RENDER_TASK, task);
-        sendMessage(msg);
+        addRenderingTask(page, width, height, bounds, thumbnail, cacheOrder, bestQuality, annotationRendering, false,
+                thumbnail ? PRIORITY_THUMBNAIL : PRIORITY_VISIBLE, 0);
+    }
+
+    /**
+     * @param priority one of PRIORITY_* classes
+     * @param distance distance of the part from the center of the view, squared, parts closer to the
+     *                 center are rendered first within a priority class
+     */
+    void addRenderingTask(int page, float width, float height, RectF bounds, boolean thumbnail, int cacheOrder, boolean bestQuality, boolean annotationRendering, boolean draft,
+                          int priority, float distance) {
+        RenderingTask task = new RenderingTask(width, height, bounds, page, thumbnail, cacheOrder, bestQuality, annotationRendering, draft);
+        task.colorScheme = pdfView.getColorScheme();
+        task.priority = priority;
+        task.distance = distance;
+        synchronized (tasksLock) {
+            // Already being rendered, don't queue it again
+            if (runningSignal != null && !runningSignal.isCanceled()) {
+                for (RenderingTask running : runningTasks) {
+                    if (running.rendersSameAs(task)) {
+                        running.stale = false;
+                        running.cacheOrder = cacheOrder;
+                        return;
+                    }
+                }
+            }
+
+            // Already queued, requeue it with the new priority
+            Iterator<RenderingTask> iterator = queuedTasks.iterator();
+            while (iterator.hasNext()) {
+                if (iterator.next().rendersSameAs(task)) {
+                    iterator.remove();
+                    break;
+                }
+            }
+            task.sequence = sequence++;
+            queuedTasks.add(task);
+            if (!hasMessages(MSG_RENDER_TASK)) {
+                sendEmptyMessage(MSG_RENDER_TASK);
+            }
+        }
+    }
+
+    /**
+     * Compress an evicted part on this thread, instead of the UI thread parts are cached on, then
+     * give its bitmap back to the pool. Runs before queued renders, so they can take the bitmap
+     */
+    void storeEvictedPart(final PdfFile pdfFile, final PagePart part) {
+        postAtFrontOfQueue(new Runnable() {
+            @Override
+            public void run() {
+                pdfFile.storeCompressedPart(part, pdfView.getColorScheme());
+                pdfView.bitmapPool.release(part.getRenderedBitmap());
+            }
+        });
+    }
+
+    /** Drop all tasks not started yet */
+    void removeRenderingTasks() {
+        synchronized (tasksLock) {
+            removeMessages(MSG_RENDER_TASK);
+            queuedTasks.clear();
+        }
     }
 
     @Override
     public void handleMessage(Message message) {
-        RenderingTask task = (RenderingTask) message.obj;
+        List<RenderingTask> batch;
+        CancellationSignal cancellationSignal = new CancellationSignal();
+        synchronized (tasksLock) {
+            RenderingTask task = queuedTasks.poll();
+            if (task == null) {
+                return;
+            }
+            batch = takeBatch(task);
+            runningTasks = batch;
+            runningSignal = cancellationSignal;
+        }
         try {
-            final PagePart part = proceed(task);
-            if (part != null) {
+            List<PagePart> parts = proceed(batch, cancellationSignal);
+            for (final PagePart part : parts) {
                 if (running) {
                     pdfView.post(new Runnable() {
                         @Override
@@ -83,34 +182,190 @@ class RenderingHandler extends Handler {
                     pdfView.onPageError(ex);
                 }
             });
+        } finally {
+            synchronized (tasksLock) {
+                runningTasks = Collections.emptyList();
+                runningSignal = null;
+                if (!queuedTasks.isEmpty() && !hasMessages(MSG_RENDER_TASK)) {
+                    sendEmptyMessage(MSG_RENDER_TASK);
+                }
+            }
         }
     }
 
-    private PagePart proceed(RenderingTask renderingTask) throws PageRenderingException {
+    /**
+     * Take the most important queued parts of the same page and zoom, so the page is rendered once
+     * for all of them
+     */
+    private List<RenderingTask> takeBatch(RenderingTask first) {
+        List<RenderingTask> candidates = new ArrayList<>();
+        for (RenderingTask task : queuedTasks) {
+            if (first.canBatchWith(task)) {
+                candidates.add(task);
+            }
+        }
+        Collections.sort(candidates, queuedTasks.comparator());
+
+        List<RenderingTask> batch = new ArrayList<>();
+        batch.add(first);
+        for (RenderingTask task : candidates) {
+            if (batch.size() >= RENDER_BATCH_SIZE) {
+                break;
+            }
+            batch.add(task);
+            queuedTasks.remove(task);
+        }
+        return batch;
+    }
+
+    private List<PagePart> proceed(List<RenderingTask> batch, CancellationSignal cancellationSignal)
+            throws PageRenderingException {
         PdfFile pdfFile = pdfView.pdfFile;
-        pdfFile.openPage(renderingTask.page);
+        int page = batch.get(0).page;
+        List<PagePart> parts = new ArrayList<>();
 
-        int w = Math.round(renderingTask.width);
-        int h = Math.round(renderingTask.height);
+        // Stored parts don't need the page opened, so a reopened document paints without parsing it
+        batch = takeStoredParts(pdfFile, batch, parts);
+        if (batch.isEmpty()) {
+            return parts;
+        }
 
-        if (w == 0 || h == 0 || pdfFile.pageHasError(renderingTask.page)) {
-            return null;
+        float partSize = pdfFile.getPartSize(page, pdfView.getZoom());
+        if (pdfFile.openPage(page) && pdfFile.getPartSize(page, pdfView.getZoom()) != partSize) {
+            // Parts were laid out before the page content was known, lay them out again
+            pdfView.post(new Runnable() {
+                @Override
+                public void run() {
+                    pdfView.loadPages();
+                }
+            });
+            if (!batch.get(0).thumbnail) {
+                return parts;
+            }
         }
 
-        Bitmap render;
-        try {
-            render = Bitmap.createBitmap(w, h, renderingTask.bestQuality ? Bitmap.Config.ARGB_8888 : Bitmap.Config.RGB_565);
-        } catch (IllegalArgumentException e) {
-            Log.e(TAG, "Cannot create bitmap", e);
-            return null;
+        if (pdfFile.pageHasError(page)) {
+            return parts;
+        }
+
+        // All tasks of a batch have the same quality, annotation, draft rendering and colors
+        boolean grayscale = isRenderedGrayscale(pdfFile, batch.get(0));
+        Bitmap.Config config = getConfig(batch.get(0), grayscale);
+        // Ink coverage of grayscale parts is drawn in the scheme colors instead
+        ColorScheme colorScheme = grayscale ? null : batch.get(0).colorScheme;
+
+        List<RenderingTask> tasks = new ArrayList<>();
+        List<Bitmap> renders = new ArrayList<>();
+        List<Rect> bounds = new ArrayList<>();
+        for (RenderingTask renderingTask : batch) {
+            int w = Math.round(renderingTask.width);
+            int h = Math.round(renderingTask.height);
+            if (w == 0 || h == 0) {
+                continue;
+            }
+
+            Bitmap render;
+            try {
+                render = pdfView.bitmapPool.acquire(w, h, config);
+            } catch (IllegalArgumentException e) {
+                Log.e(TAG, "Cannot create bitmap", e);
+                continue;
+            }
+            calculateBounds(w, h, renderingTask.bounds);
+
+            tasks.add(renderingTask);
+            renders.add(render);
+            bounds.add(new Rect(roundedRenderBounds));
+        }
+        if (tasks.isEmpty()) {
+            return parts;
+        }
+
+        RenderingTask first = tasks.get(0);
+        boolean rendered;
+        if (first.thumbnail) {
+            // Thumbnails are never batched
+            rendered = pdfFile.renderPageThumbnail(renders.get(0), page, first.annotationRendering, colorScheme, cancellationSignal);
+        } else {
+            rendered = pdfFile.renderPageBitmaps(renders, page, bounds, first.annotationRendering, first.draft, colorScheme, cancellationSignal);
+        }
+        if (!rendered) {
+            for (Bitmap render : renders) {
+                pdfView.bitmapPool.release(render);
+            }
+            return parts;
+        }
+
+        for (int i = 0; i < tasks.size(); i++) {
+            RenderingTask renderingTask = tasks.get(i);
+            if (!renderingTask.draft) {
+                pdfFile.storePart(page, renderingTask.bounds, renderingTask.thumbnail,
+                        renderingTask.annotationRendering, colorScheme, renders.get(i));
+            }
+        }
+
+        synchronized (tasksLock) {
+            for (int i = 0; i < tasks.size(); i++) {
+                RenderingTask renderingTask = tasks.get(i);
+                parts.add(new PagePart(renderingTask.page, renders.get(i),
+                        renderingTask.bounds, renderingTask.thumbnail,
+                        renderingTask.cacheOrder, renderingTask.draft, renderingTask.colorScheme));
+            }
+        }
+        return parts;
+    }
+
+    /**
+     * Add parts evicted earlier and kept compressed, or stored on disk, no need to render them again
+     *
+     * @return tasks that have to be rendered
+     */
+    private List<RenderingTask> takeStoredParts(PdfFile pdfFile, List<RenderingTask> batch, List<PagePart> parts) {
+        boolean grayscale = isRenderedGrayscale(pdfFile, batch.get(0));
+        Bitmap.Config config = getConfig(batch.get(0), grayscale);
+        ColorScheme colorScheme = grayscale ? null : batch.get(0).colorScheme;
+
+        List<RenderingTask> remaining = new ArrayList<>();
+        for (RenderingTask renderingTask : batch) {
+            int w = Math.round(renderingTask.width);
+            int h = Math.round(renderingTask.height);
+            if (w == 0 || h == 0) {
+                continue;
+            }
+
+            Bitmap bitmap;
+            try {
+                bitmap = pdfView.bitmapPool.acquire(w, h, config);
+            } catch (IllegalArgumentException e) {
+                remaining.add(renderingTask);
+                continue;
+            }
+            boolean stored = (!renderingTask.thumbnail
+                    && pdfFile.takeCompressedPart(renderingTask.page, renderingTask.bounds, renderingTask.colorScheme, bitmap))
+                    || pdfFile.readStoredPart(renderingTask.page, renderingTask.bounds, renderingTask.thumbnail,
+                    renderingTask.annotationRendering, colorScheme, bitmap);
+            if (!stored) {
+                pdfView.bitmapPool.release(bitmap);
+                remaining.add(renderingTask);
+                continue;
+            }
+            synchronized (tasksLock) {
+                parts.add(new PagePart(renderingTask.page, bitmap, renderingTask.bounds, renderingTask.thumbnail,
+                        renderingTask.cacheOrder, false, renderingTask.colorScheme));
+            }
         }
-        calculateBounds(w, h, renderingTask.bounds);
+        return remaining;
+    }
 
-        pdfFile.renderPageBitmap(render, renderingTask.page, roundedRenderBounds, renderingTask.annotationRendering);
+    private boolean isRenderedGrayscale(PdfFile pdfFile, RenderingTask task) {
+        return pdfView.isGrayscaleRendering() && pdfFile.isPageColorless(task.page, task.annotationRendering);
+    }
 
-        return new PagePart(renderingTask.page, render,
-                renderingTask.bounds, renderingTask.thumbnail,
-                renderingTask.cacheOrder);
+    private static Bitmap.Config getConfig(RenderingTask task, boolean grayscale) {
+        if (grayscale) {
+            return Bitmap.Config.ALPHA_8;
+        }
+        return task.bestQuality ? Bitmap.Config.ARGB_8888 : Bitmap.Config.RGB_565;
     }
 
     private void calculateBounds(int width, int height, RectF pageSliceBounds) {
@@ -123,8 +378,53 @@ class RenderingHandler extends Handler {
         renderBounds.round(roundedRenderBounds);
     }
 
+    /**
+     * Mark queued tasks and the tasks being rendered as no longer needed, unless they're requested
+     * again before {@link #removeStaleTasks()}
+     */
+    void markTasksStale() {
+        synchronized (tasksLock) {
+            for (RenderingTask task : queuedTasks) {
+                task.stale = true;
+            }
+            for (RenderingTask task : runningTasks) {
+                task.stale = true;
+            }
+        }
+    }
+
+    /**
+     * Drop queued tasks not requested again since {@link #markTasksStale()}, and abandon the render
+     * in progress if none of its tasks was
+     */
+    void removeStaleTasks() {
+        synchronized (tasksLock) {
+            Iterator<RenderingTask> iterator = queuedTasks.iterator();
+            while (iterator.hasNext()) {
+                if (iterator.next().stale) {
+                    iterator.remove();
+                }
+            }
+
+            if (runningSignal == null) {
+                return;
+            }
+            for (RenderingTask task : runningTasks) {
+                if (!task.stale) {
+                    return;
+                }
+            }
+            runningSignal.cancel();
+        }
+    }
+
     void stop() {
         running = false;
+        synchronized (tasksLock) {
+            if (runningSignal != null) {
+                runningSignal.cancel();
+            }
+        }
     }
 
     void start() {
@@ -147,7 +447,19 @@ class RenderingHandler extends Handler {
 
         boolean annotationRendering;
 
-        RenderingTask(float width, float height, RectF bounds, int page, boolean thumbnail, int cacheOrder, boolean bestQuality, boolean annotationRendering) {
+        boolean draft;
+
+        ColorScheme colorScheme;
+
+        int priority;
+
+        float distance;
+
+        long sequence;
+
+        boolean stale;
+
+        RenderingTask(float width, float height, RectF bounds, int page, boolean thumbnail, int cacheOrder, boolean bestQuality, boolean annotationRendering, boolean draft) {
             this.page = page;
             this.width = width;
             this.height = height;
@@ -156,6 +468,42 @@ class RenderingHandler extends Handler {
             this.cacheOrder = cacheOrder;
             this.bestQuality = bestQuality;
             this.annotationRendering = annotationRendering;
+            this.draft = draft;
+        }
+
+        boolean canBatchWith(RenderingTask task) {
+            // Parts of one page at the same zoom share the page render size
+            return page == task.page
+                    && !thumbnail && !task.thumbnail
+                    && bestQuality == task.bestQuality
+                    && annotationRendering == task.annotationRendering
+                    && draft == task.draft
+                    && ObjectsCompat.equals(colorScheme, task.colorScheme)
+                    && Math.round(width / bounds.width()) == Math.round(task.width / task.bounds.width())
+                    && Math.round(height / bounds.height()) == Math.round(task.height / task.bounds.height());
+        }
+
+        boolean rendersSameAs(RenderingTask task) {
+            return page == task.page
+                    && thumbnail == task.thumbnail
+                    && bestQuality == task.bestQuality
+                    && annotationRendering == task.annotationRendering
+                    && draft == task.draft
+                    && ObjectsCompat.equals(colorScheme, task.colorScheme)
+                    && Math.round(width) == Math.round(task.width)
+                    && Math.round(height) == Math.round(task.height)
+                    && bounds.equals(task.bounds);
+        }
+    }
+
+    private static class PriorityComparator implements Comparator<RenderingTask> {
+        @Override
+        public int compare(RenderingTask task1, RenderingTask task2) {
+            if (task1.priority != task2.priority) {
+                return task1.priority < task2.priority ? -1 : 1;
+            }
+            int result = Float.compare(task1.distance, task2.distance);
+            return result != 0 ? result : Long.compare(task1.sequence, task2.sequence);
         }
     }
 }
@@ -18,6 +18,8 @@ package com.github.barteksc.pdfviewer.model;
 import android.graphics.Bitmap;
 import android.graphics.RectF;
 
+import com.shockwave.pdfium.ColorScheme;
+
 public class PagePart {
 
     private int page;
@@ -30,13 +32,31 @@ public class PagePart {
 
     private int cacheOrder;
 
+    /** Rendered with draft flags while the view was moving, to be replaced when it settles */
+    private boolean draft;
+
+    /** Colors the part was requested in, null for the page colors */
+    private ColorScheme colorScheme;
+
     public PagePart(int page, Bitmap renderedBitmap, RectF pageRelativeBounds, boolean thumbnail, int cacheOrder) {
+        this(page, renderedBitmap, pageRelativeBounds, thumbnail, cacheOrder, false);
+    }
+
+    public PagePart(int page, Bitmap renderedBitmap, RectF pageRelativeBounds, boolean thumbnail, int cacheOrder,
+                    boolean draft) {
+        this(page, renderedBitmap, pageRelativeBounds, thumbnail, cacheOrder, draft, null);
+    }
+
+    public PagePart(int page, Bitmap renderedBitmap, RectF pageRelativeBounds, boolean thumbnail, int cacheOrder,
+                    boolean draft, ColorScheme colorScheme) {
         super();
         this.page = page;
         this.renderedBitmap = renderedBitmap;
         this.pageRelativeBounds = pageRelativeBounds;
         this.thumbnail = thumbnail;
         this.cacheOrder = cacheOrder;
+        this.draft = draft;
+        this.colorScheme = colorScheme;
     }
 
     public int getCacheOrder() {
@@ -59,6 +79,14 @@ public class PagePart {
         return thumbnail;
     }
 
+    public boolean isDraft() {
+        return draft;
+    }
+
+    public ColorScheme getColorScheme() {
+        return colorScheme;
+    }
+
     public void setCacheOrder(int cacheOrder) {
         this.cacheOrder = cacheOrder;
     }
@@ -38,6 +38,6 @@ public class AssetSource implements DocumentSource {
     public PdfDocument createDocument(Context context, PdfiumCore core, String password) throws IOException {
         File f = FileUtils.fileFromAsset(context, assetName);
         ParcelFileDescriptor pfd = ParcelFileDescriptor.open(f, ParcelFileDescriptor.MODE_READ_ONLY);
-        return core.newDocument(pfd, password);
+        return core.newDocument(pfd, password, PdfiumCore.OPEN_MODE_MMAP);
     }
 }
@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2016 Bartosz Schiller.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package com.github.barteksc.pdfviewer.source;
+
+import android.content.Context;
+
+import com.shockwave.pdfium.PdfDocument;
+import com.shockwave.pdfium.PdfiumCore;
+
+import java.io.IOException;
+import java.nio.ByteBuffer;
+
+public class ByteBufferSource implements DocumentSource {
+
+    private ByteBuffer data;
+
+    public ByteBufferSource(ByteBuffer data) {
+        this.data = data;
+    }
+
+    @Override
+    public PdfDocument createDocument(Context context, PdfiumCore core, String password) throws IOException {
+        return core.newDocument(data, password);
+    }
+}
@@ -28,13 +28,28 @@ public class FileSource implements DocumentSource {
 
     private File file;
 
+    private int openMode;
+
     public FileSource(File file) {
+        this(file, PdfiumCore.OPEN_MODE_PREAD);
+    }
+
+    /**
+     * @param openMode how file data is read, see {@link PdfiumCore#OPEN_MODE_MMAP} for when mapping
+     *                 the file is safe. Defaults to {@link PdfiumCore#OPEN_MODE_PREAD}
+     */
+    public FileSource(File file, int openMode) {
         this.file = file;
+        this.openMode = openMode;
+    }
+
+    public File getFile() {
+        return file;
     }
 
     @Override
     public PdfDocument createDocument(Context context, PdfiumCore core, String password) throws IOException {
         ParcelFileDescriptor pfd = ParcelFileDescriptor.open(file, ParcelFileDescriptor.MODE_READ_ONLY);
-        return core.newDocument(pfd, password);
+        return core.newDocument(pfd, password, openMode);
     }
 }
@@ -16,24 +16,209 @@
 package com.github.barteksc.pdfviewer.source;
 
 import android.content.Context;
+import android.os.ParcelFileDescriptor;
+import android.os.SystemClock;
 
-import com.github.barteksc.pdfviewer.util.Util;
+import com.shockwave.pdfium.DataAvailability;
 import com.shockwave.pdfium.PdfDocument;
 import com.shockwave.pdfium.PdfiumCore;
 
+import java.io.File;
+import java.io.FileOutputStream;
 import java.io.IOException;
 import java.io.InputStream;
+import java.io.InterruptedIOException;
+import java.io.OutputStream;
 
+/**
+ * Source reading a stream into an unlinked temporary file in bounded chunks, so the document is never
+ * held in memory. When stream length is known, document is opened progressively while the stream is
+ * still being copied. {@link com.github.barteksc.pdfviewer.PDFView} renders pages as their data arrives
+ * and stops copying when the document is closed.
+ */
 public class InputStreamSource implements DocumentSource {
 
+    private static final int CHUNK_SIZE = 64 * 1024;
+
+    private static final long POLL_INTERVAL_MS = 50;
+
+    /** Listener is called at most this often while the stream is copied */
+    private static final long NOTIFY_INTERVAL_MS = 250;
+
     private InputStream inputStream;
 
+    private long length;
+
+    private volatile StreamCopier copier;
+
+    private volatile Runnable onDataAvailable;
+
     public InputStreamSource(InputStream inputStream) {
+        this(inputStream, -1);
+    }
+
+    /**
+     * @param length total stream length, enables showing the document before the stream is fully read
+     */
+    public InputStreamSource(InputStream inputStream, long length) {
         this.inputStream = inputStream;
+        this.length = length;
     }
 
     @Override
     public PdfDocument createDocument(Context context, PdfiumCore core, String password) throws IOException {
-        return core.newDocument(Util.toByteArray(inputStream), password);
+        File tempFile = File.createTempFile("stream", ".pdf", context.getCacheDir());
+        OutputStream outputStream = null;
+        ParcelFileDescriptor pfd;
+        try {
+            outputStream = new FileOutputStream(tempFile);
+            pfd = ParcelFileDescriptor.open(tempFile, ParcelFileDescriptor.MODE_READ_ONLY);
+        } catch (IOException e) {
+            if (outputStream != null) {
+                outputStream.close();
+            }
+            throw e;
+        } finally {
+            // Data stays reachable through open descriptors and is freed when they are closed
+            tempFile.delete();
+        }
+
+        if (length <= 0) {
+            try {
+                copy(inputStream, outputStream, null);
+            } catch (IOException e) {
+                pfd.close();
+                throw e;
+            }
+            return core.newDocument(pfd, password, PdfiumCore.OPEN_MODE_MMAP);
+        }
+
+        StreamCopier copier = new StreamCopier(inputStream, outputStream);
+        this.copier = copier;
+        copier.start();
+        PdfDocument document = core.newProgressiveDocument(pfd, length, copier);
+        try {
+            while (!core.isDocumentAvailable(document, password)) {
+                if (copier.error != null) {
+                    throw copier.error;
+                }
+                Thread.sleep(POLL_INTERVAL_MS);
+            }
+        } catch (InterruptedException e) {
+            copier.cancel();
+            core.closeDocument(document);
+            throw new InterruptedIOException("Waiting for document data interrupted");
+        } catch (IOException e) {
+            copier.cancel();
+            core.closeDocument(document);
+            throw e;
+        }
+        return document;
+    }
+
+    /**
+     * Called on the copying thread when more of the stream is available, so pages waiting for their
+     * data can be rendered
+     */
+    public void setOnDataAvailableListener(Runnable onDataAvailable) {
+        this.onDataAvailable = onDataAvailable;
+    }
+
+    /**
+     * Stop copying the stream, e.g. when the document is closed or loading is cancelled. Pages not
+     * available yet won't be
+     */
+    public void close() {
+        StreamCopier copier = this.copier;
+        if (copier != null) {
+            copier.cancel();
+        }
+    }
+
+    private void copy(InputStream in, OutputStream out, StreamCopier copier) throws IOException {
+        byte[] buffer = new byte[CHUNK_SIZE];
+        long notified = 0;
+        try {
+            int n;
+            while (-1 != (n = in.read(buffer))) {
+                if (copier != null && copier.cancelled) {
+                    break;
+                }
+                out.write(buffer, 0, n);
+                if (copier != null) {
+                    copier.written += n;
+                    long now = SystemClock.uptimeMillis();
+                    if (now - notified >= NOTIFY_INTERVAL_MS) {
+                        notified = now;
+                        notifyDataAvailable();
+                    }
+                }
+            }
+            if (copier != null && !copier.cancelled) {
+                notifyDataAvailable();
+            }
+        } finally {
+            out.close();
+            in.close();
+        }
+    }
+
+    private void notifyDataAvailable() {
+        Runnable listener = onDataAvailable;
+        if (listener != null) {
+            listener.run();
+        }
+    }
+
+    private class StreamCopier extends Thread implements DataAvailability {
+
+        private final InputStream in;
+        private final OutputStream out;
+        volatile long written = 0;
+        volatile IOException error;
+        volatile boolean cancelled;
+
+        StreamCopier(InputStream in, OutputStream out) {
+            super("PDF stream copier");
+            setDaemon(true);
+            this.in = in;
+            this.out = out;
+        }
+
+        @Override
+        public void run() {
+            try {
+                copy(in, out, this);
+                if (!cancelled && written < length) {
+                    // Data past the end would never become available, waiting for it must fail
+                    throw new IOException("Stream ended at " + written + " of " + length + " bytes");
+                }
+            } catch (IOException e) {
+                if (!cancelled) {
+                    error = e;
+                }
+            }
+        }
+
+        /** Closing the stream unblocks a pending read */
+        void cancel() {
+            cancelled = true;
+            interrupt();
+            try {
+                in.close();
+            } catch (IOException e) {
+                // Stopping anyway
+            }
+        }
+
+        @Override
+        public long getAvailableLength() {
+            return written;
+        }
+
+        @Override
+        public void onDataRequested(long[] ranges) {
+            // Stream can only be read sequentially
+        }
     }
 }
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2016 Bartosz Schiller.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package com.github.barteksc.pdfviewer.source;
+
+import android.content.Context;
+import android.os.ParcelFileDescriptor;
+
+import com.shockwave.pdfium.DataAvailability;
+import com.shockwave.pdfium.PdfDocument;
+import com.shockwave.pdfium.PdfiumCore;
+
+import java.io.File;
+import java.io.IOException;
+import java.io.InterruptedIOException;
+
+/**
+ * Source for a file that is still being downloaded. Document is shown as soon as PDFium can load it,
+ * which for linearized files happens long before the download finishes. Pages that are not downloaded yet
+ * are rendered after {@link com.github.barteksc.pdfviewer.PDFView#loadPages()} is called once more data arrives.
+ */
+public class ProgressiveFileSource implements DocumentSource {
+
+    private static final long POLL_INTERVAL_MS = 50;
+
+    private final File file;
+    private final long fileLength;
+    private final DataAvailability availability;
+
+    /**
+     * @param file         file being written by the downloader
+     * @param fileLength   final length of the file
+     * @param availability tells how much of the file is written and receives download hints
+     */
+    public ProgressiveFileSource(File file, long fileLength, DataAvailability availability) {
+        this.file = file;
+        this.fileLength = fileLength;
+        this.availability = availability;
+    }
+
+    @Override
+    public PdfDocument createDocument(Context context, PdfiumCore core, String password) throws IOException {
+        ParcelFileDescriptor pfd = ParcelFileDescriptor.open(file, ParcelFileDescriptor.MODE_READ_ONLY);
+        PdfDocument document = core.newProgressiveDocument(pfd, fileLength, availability);
+        try {
+            while (!core.isDocumentAvailable(document, password)) {
+                Thread.sleep(POLL_INTERVAL_MS);
+            }
+        } catch (InterruptedException e) {
+            core.closeDocument(document);
+            throw new InterruptedIOException("Waiting for document data interrupted");
+        } catch (IOException e) {
+            core.closeDocument(document);
+            throw e;
+        }
+        return document;
+    }
+}
@@ -35,6 +35,6 @@ public class UriSource implements DocumentSource {
     @Override
     public PdfDocument createDocument(Context context, PdfiumCore core, String password) throws IOException {
         ParcelFileDescriptor pfd = context.getContentResolver().openFileDescriptor(uri, "r");
-        return core.newDocument(pfd, password);
+        return core.newDocument(pfd, password, PdfiumCore.OPEN_MODE_CACHED);
     }
 }
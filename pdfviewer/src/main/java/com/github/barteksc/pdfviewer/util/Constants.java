@@ -22,6 +22,9 @@ public class Constants {
     /** Between 0 and 1, the thumbnails quality (default 0.3). Increasing this value may cause performance decrease */
     public static float THUMBNAIL_RATIO = 0.3f;
 
+    /** Show thumbnail images embedded in pages, common in scanned documents, instead of rendering thumbnails */
+    public static boolean EMBEDDED_THUMBNAILS = true;
+
     /**
      * The size of the rendered parts (default 256)
      * Tinier : a little bit slower to have the whole page rendered but more reactive.
@@ -29,15 +32,66 @@ public class Constants {
      */
     public static float PART_SIZE = 256;
 
+    /** Choose size of the parts of every page from its content instead of always using {@link #PART_SIZE} */
+    public static boolean ADAPTIVE_PART_SIZE = true;
+
+    /** Smallest part size chosen for crowded pages */
+    public static float MIN_PART_SIZE = 128;
+
+    /** Largest part size chosen for nearly empty pages */
+    public static float MAX_PART_SIZE = 512;
+
+    /** Maximum number of parts of one page rendered together in a single pass over the page */
+    public static int RENDER_BATCH_SIZE = 16;
+
     /** Part of document above and below screen that should be preloaded, in dp */
     public static int PRELOAD_OFFSET = 20;
 
     public static class Cache {
 
-        /** The size of the cache (number of bitmaps kept) */
+        /** Maximum number of parts requested for one position of the view */
         public static int CACHE_SIZE = 120;
 
+        /** Share of the app memory class page parts may take */
+        public static float CACHE_MEMORY_RATIO = 0.25f;
+
+        /** Memory bitmaps of evicted parts may take until reused, relative to the cache memory */
+        public static float BITMAP_POOL_RATIO = 0.25f;
+
+        /**
+         * Native memory evicted parts may take compressed, relative to the cache memory. Mostly
+         * white pages compress many times, 0 to render evicted parts again instead
+         */
+        public static float COMPRESSED_CACHE_RATIO = 0.5f;
+
         public static int THUMBNAILS_CACHE_SIZE = 8;
+
+        /** Directory in application cache dir where document indexes are stored */
+        public static String DOCUMENT_INDEX_DIR = "pdf-index";
+
+        /** Bytes document indexes may take, least recently opened are deleted first */
+        public static long DOCUMENT_INDEX_SIZE = 16 * 1024 * 1024;
+
+        /** Directory in application cache dir where rendered parts and thumbnails are stored */
+        public static String TILE_CACHE_DIR = "pdf-tiles";
+
+        /** Bytes stored parts of all documents may take on disk, least recently read are deleted first */
+        public static long DISK_CACHE_SIZE = 64 * 1024 * 1024;
+    }
+
+    public static class Prefetch {
+
+        /** Request thumbnails of pages ahead of the scroll */
+        public static boolean ENABLED = true;
+
+        /** How far ahead the view is predicted while moving, in ms at the current velocity */
+        public static long LOOKAHEAD_MILLIS = 400;
+
+        /** Maximum number of pages prefetched ahead of the view */
+        public static int MAX_PAGES = 4;
+
+        /** Below this share of prefetched pages shown in time, only the next page is prefetched */
+        public static float MIN_HIT_RATE = 0.3f;
     }
 
     public static class Pinch {